@@ -0,0 +1,225 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "CircuitBreaker.h"
+
+#include <algorithm>
+
+#include "NetworkScheduler.h"
+
+CircuitBreaker::CircuitBreaker(const Options& options):
+    options_(options),
+    epoch_(Clock::now())
+{
+    options_.window = std::max<int64_t>(options_.window, 1);
+    options_.windowBuckets = std::max(options_.windowBuckets, 1);
+    options_.halfOpenTrials = std::max(options_.halfOpenTrials, 1);
+}
+
+void CircuitBreaker::attach(NetworkClient& client) {
+    client.addRequestObserver(this);
+}
+
+void CircuitBreaker::detach(NetworkClient& client) {
+    client.removeRequestObserver(this);
+    std::lock_guard<std::mutex> lock(mutex_);
+    admitted_.erase(&client);
+}
+
+CircuitBreaker::State CircuitBreaker::state(const std::string& host) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = hosts_.find(NetworkScheduler::hostFromUrl(host));
+    if (it == hosts_.end()) {
+        return csClosed;
+    }
+    if (it->second.state == csOpen && Clock::now() >= it->second.openUntil) {
+        return csHalfOpen;
+    }
+    return it->second.state;
+}
+
+std::vector<CircuitBreaker::HostStats> CircuitBreaker::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Clock::time_point now = Clock::now();
+    std::vector<HostStats> result;
+    for (const auto& it : hosts_) {
+        result.emplace_back();
+        fillStats(it.first, it.second, now, result.back());
+    }
+    return result;
+}
+
+void CircuitBreaker::reset(const std::string& host) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    HostState& state = hostState(host);
+    state.state = csClosed;
+    state.trialsInFlight = 0;
+    state.trialSuccesses = 0;
+    state.buckets.assign(options_.windowBuckets, Bucket());
+}
+
+bool CircuitBreaker::admitRequest(NetworkClient& client, std::string& reason) {
+    std::string host = NetworkScheduler::hostFromUrl(client.url());
+    Clock::time_point now = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    HostState& state = hostState(host);
+    if (state.state == csOpen && now >= state.openUntil) {
+        state.state = csHalfOpen;
+        state.trialsInFlight = 0;
+        state.trialSuccesses = 0;
+    }
+    bool trial = false;
+    if (state.state == csHalfOpen) {
+        if (state.trialsInFlight + state.trialSuccesses >= options_.halfOpenTrials) {
+            state.rejected++;
+            reason = "Circuit breaker is half-open for " + host;
+            return false;
+        }
+        state.trialsInFlight++;
+        trial = true;
+    } else if (state.state == csOpen) {
+        state.rejected++;
+        reason = "Circuit breaker is open for " + host;
+        return false;
+    }
+    Admitted& admitted = admitted_[&client];
+    admitted.host = host;
+    admitted.trial = trial;
+    return true;
+}
+
+void CircuitBreaker::onRequestFinish(NetworkClient& client) {
+    int result = client.getCurlResult();
+    if (result == NetworkClient::RequestRejected) {
+        // Rejected by this breaker or by another observer after this one admitted it: not an outcome of the host,
+        // but a trial slot taken by the request has to be released
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto admitted = admitted_.find(&client);
+        if (admitted != admitted_.end()) {
+            if (admitted->second.trial) {
+                HostState& state = hostState(admitted->second.host);
+                state.trialsInFlight = std::max(state.trialsInFlight - 1, 0);
+            }
+            admitted_.erase(admitted);
+        }
+        return;
+    }
+    int code = client.responseCode();
+    bool failed = result != CURLE_OK || (options_.failOnServerError && code >= 500);
+    int64_t latency = client.responseTimings().total;
+    bool slow = options_.slowCallDuration > 0 && latency >= options_.slowCallDuration * 1000;
+    Clock::time_point now = Clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto admitted = admitted_.find(&client);
+    if (admitted == admitted_.end()) {
+        return;
+    }
+    HostState& state = hostState(admitted->second.host);
+    bool trial = admitted->second.trial;
+    admitted_.erase(admitted);
+
+    if (trial) {
+        state.trialsInFlight = std::max(state.trialsInFlight - 1, 0);
+        if (state.state != csHalfOpen) {
+            return;
+        }
+        if (failed || slow) {
+            open(state, now);
+        } else if (++state.trialSuccesses >= options_.halfOpenTrials) {
+            state.state = csClosed;
+            state.buckets.assign(options_.windowBuckets, Bucket());
+        }
+        return;
+    }
+
+    int64_t index = bucketIndex(now);
+    Bucket& bucket = state.buckets[static_cast<size_t>(index % options_.windowBuckets)];
+    if (bucket.index != index) {
+        bucket = Bucket();
+        bucket.index = index;
+    }
+    bucket.requests++;
+    bucket.failures += failed ? 1 : 0;
+    bucket.slowCalls += slow ? 1 : 0;
+    bucket.latencySum += latency;
+
+    if (state.state != csClosed) {
+        return;
+    }
+    Bucket totals = windowTotals(state, now);
+    if (totals.requests < static_cast<uint64_t>(std::max(options_.minRequests, 1))) {
+        return;
+    }
+    double failureRate = static_cast<double>(totals.failures) / totals.requests;
+    double slowRate = static_cast<double>(totals.slowCalls) / totals.requests;
+    if (failureRate >= options_.failureRateThreshold
+        || (options_.slowCallDuration > 0 && slowRate >= options_.slowCallRateThreshold)) {
+        open(state, now);
+    }
+}
+
+CircuitBreaker::HostState& CircuitBreaker::hostState(const std::string& host) {
+    HostState& state = hosts_[NetworkScheduler::hostFromUrl(host)];
+    if (state.buckets.empty()) {
+        state.buckets.resize(options_.windowBuckets);
+    }
+    return state;
+}
+
+int64_t CircuitBreaker::bucketIndex(Clock::time_point time) const {
+    int64_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(time - epoch_).count();
+    return elapsed / std::max<int64_t>(options_.window / options_.windowBuckets, 1);
+}
+
+CircuitBreaker::Bucket CircuitBreaker::windowTotals(const HostState& state, Clock::time_point now) const {
+    int64_t current = bucketIndex(now);
+    Bucket totals;
+    for (const auto& bucket : state.buckets) {
+        if (bucket.index >= 0 && current - bucket.index < options_.windowBuckets) {
+            totals.requests += bucket.requests;
+            totals.failures += bucket.failures;
+            totals.slowCalls += bucket.slowCalls;
+            totals.latencySum += bucket.latencySum;
+        }
+    }
+    return totals;
+}
+
+void CircuitBreaker::open(HostState& state, Clock::time_point now) {
+    state.state = csOpen;
+    state.openUntil = now + std::chrono::milliseconds(options_.openDuration);
+    state.trialsInFlight = 0;
+    state.trialSuccesses = 0;
+    state.timesOpened++;
+}
+
+void CircuitBreaker::fillStats(const std::string& host, const HostState& state, Clock::time_point now, HostStats& stats) const {
+    stats.host = host;
+    stats.state = state.state == csOpen && now >= state.openUntil ? csHalfOpen : state.state;
+    Bucket totals = windowTotals(state, now);
+    stats.requests = totals.requests;
+    stats.failures = totals.failures;
+    stats.slowCalls = totals.slowCalls;
+    stats.failureRate = totals.requests ? static_cast<double>(totals.failures) / totals.requests : 0;
+    stats.meanLatency = totals.requests ? totals.latencySum / 1000.0 / totals.requests : 0;
+    stats.rejected = state.rejected;
+    stats.timesOpened = state.timesOpened;
+}
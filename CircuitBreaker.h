@@ -0,0 +1,181 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef CURL_CPP_WRAPPER_CIRCUIT_BREAKER_H
+#define CURL_CPP_WRAPPER_CIRCUIT_BREAKER_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "NetworkClient.h"
+
+/**
+ * Per-host circuit breaker. Results of requests made by attached clients are counted in a rolling
+ * time window; when the share of failed (or slow) requests to a host gets above the threshold,
+ * the circuit of that host opens and further requests fail immediately with
+ * NetworkClient::RequestRejected. After openDuration a limited number of trial requests is let
+ * through (half-open state): if they succeed, the circuit closes, otherwise it opens again.
+ * Hosts are keyed as NetworkScheduler::hostFromUrl() does. One breaker can be shared by clients
+ * on different threads.
+ */
+class CircuitBreaker: public NetworkClient::RequestObserver
+{
+public:
+    enum State
+    {
+        csClosed = 0,
+        csOpen,
+        csHalfOpen
+    };
+
+    struct Options
+    {
+        /**
+         * Length of the rolling window in milliseconds, it is divided into windowBuckets buckets.
+         */
+        int64_t window;
+        int windowBuckets;
+        /**
+         * The circuit doesn't open until the window has at least this number of requests.
+         */
+        int minRequests;
+        /**
+         * Share of failed requests (0..1) which opens the circuit.
+         */
+        double failureRateThreshold;
+        /**
+         * Requests longer than slowCallDuration milliseconds are slow (0 disables).
+         * The circuit opens when their share reaches slowCallRateThreshold.
+         */
+        int64_t slowCallDuration;
+        double slowCallRateThreshold;
+        /**
+         * Time in milliseconds before an open circuit lets trial requests through.
+         */
+        int64_t openDuration;
+        /**
+         * Number of trial requests in the half-open state, all of them must succeed to close the circuit.
+         */
+        int halfOpenTrials;
+        /**
+         * Whether 5xx responses count as failures (transfer errors always do).
+         */
+        bool failOnServerError;
+
+        Options(): window(10000), windowBuckets(10), minRequests(10), failureRateThreshold(0.5),
+            slowCallDuration(0), slowCallRateThreshold(1.0), openDuration(5000), halfOpenTrials(1),
+            failOnServerError(true) {
+        }
+    };
+
+    struct HostStats
+    {
+        std::string host;
+        State state;
+        /**
+         * Counters of the rolling window.
+         */
+        uint64_t requests;
+        uint64_t failures;
+        uint64_t slowCalls;
+        double failureRate;
+        double meanLatency; // milliseconds
+        /**
+         * Totals since the host was first seen.
+         */
+        uint64_t rejected;
+        uint64_t timesOpened;
+
+        HostStats(): state(csClosed), requests(0), failures(0), slowCalls(0), failureRate(0), meanLatency(0),
+            rejected(0), timesOpened(0) {
+        }
+    };
+
+    explicit CircuitBreaker(const Options& options = Options());
+    CircuitBreaker(CircuitBreaker const&) = delete;
+    void operator=(CircuitBreaker const& x) = delete;
+
+    void attach(NetworkClient& client);
+    void detach(NetworkClient& client);
+
+    State state(const std::string& host) const;
+    std::vector<HostStats> stats() const;
+
+    /**
+     * Closes the circuit of the host and clears its window.
+     */
+    void reset(const std::string& host);
+
+    bool admitRequest(NetworkClient& client, std::string& reason) override;
+    void onRequestFinish(NetworkClient& client) override;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Bucket
+    {
+        int64_t index;
+        uint64_t requests;
+        uint64_t failures;
+        uint64_t slowCalls;
+        int64_t latencySum; // microseconds
+
+        Bucket(): index(-1), requests(0), failures(0), slowCalls(0), latencySum(0) {
+        }
+    };
+
+    struct HostState
+    {
+        State state;
+        Clock::time_point openUntil;
+        int trialsInFlight;
+        int trialSuccesses;
+        std::vector<Bucket> buckets;
+        uint64_t rejected;
+        uint64_t timesOpened;
+
+        HostState(): state(csClosed), trialsInFlight(0), trialSuccesses(0), rejected(0), timesOpened(0) {
+        }
+    };
+
+    struct Admitted
+    {
+        std::string host;
+        bool trial;
+    };
+
+    HostState& hostState(const std::string& host);
+    int64_t bucketIndex(Clock::time_point time) const;
+    Bucket windowTotals(const HostState& state, Clock::time_point now) const;
+    void open(HostState& state, Clock::time_point now);
+    void fillStats(const std::string& host, const HostState& state, Clock::time_point now, HostStats& stats) const;
+
+    Options options_;
+    Clock::time_point epoch_;
+    mutable std::mutex mutex_;
+    std::map<std::string, HostState> hosts_;
+    std::map<NetworkClient*, Admitted> admitted_;
+};
+
+#endif
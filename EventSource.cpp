@@ -0,0 +1,370 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+#include "EventSource.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <cstring>
+
+namespace {
+
+const char Bom[] = "\xEF\xBB\xBF";
+
+bool FieldIs(const char* field, size_t size, const char* name) {
+    return size == strlen(name) && !memcmp(field, name, size);
+}
+
+bool IsEventStream(const char* contentType) {
+    static const char MimeType[] = "text/event-stream";
+    const size_t length = sizeof(MimeType) - 1;
+    if (!contentType || strlen(contentType) < length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (tolower(static_cast<unsigned char>(contentType[i])) != MimeType[i]) {
+            return false;
+        }
+    }
+    char next = contentType[length];
+    return next == '\0' || next == ';' || next == ' ';
+}
+
+}
+
+EventStreamParser::EventStreamParser():
+    maxEventSize_(1024 * 1024),
+    retry_(-1),
+    pendingCR_(false),
+    bomBytes_(0)
+{
+}
+
+void EventStreamParser::setEventCallback(EventCallback callback) {
+    callback_ = std::move(callback);
+}
+
+void EventStreamParser::setMaxEventSize(size_t size) {
+    maxEventSize_ = size;
+}
+
+bool EventStreamParser::feed(const char* data, size_t size) {
+    if (!error_.empty()) {
+        return false;
+    }
+    const char* p = data;
+    const char* end = data + size;
+    // Optional UTF-8 byte order mark at the beginning of the stream
+    while (bomBytes_ < 3 && p < end) {
+        if (*p != Bom[bomBytes_]) {
+            line_.append(Bom, bomBytes_);
+            bomBytes_ = 3;
+            break;
+        }
+        ++bomBytes_;
+        ++p;
+    }
+    while (p < end) {
+        if (pendingCR_) {
+            pendingCR_ = false;
+            if (*p == '\n') {
+                ++p;
+                continue;
+            }
+        }
+        const char* eol = p;
+        while (eol < end && *eol != '\n' && *eol != '\r') {
+            ++eol;
+        }
+        size_t length = eol - p;
+        if (line_.size() + length > maxEventSize_) {
+            return setError("Line is too long");
+        }
+        if (eol == end) {
+            line_.append(p, length);
+            break;
+        }
+        pendingCR_ = *eol == '\r';
+        bool success;
+        if (line_.empty()) {
+            // The whole line is in this chunk, no need to copy it
+            success = processLine(p, length);
+        } else {
+            line_.append(p, length);
+            success = processLine(line_.data(), line_.size());
+            line_.clear();
+        }
+        if (!success) {
+            return false;
+        }
+        p = eol + 1;
+    }
+    return true;
+}
+
+void EventStreamParser::reset() {
+    line_.clear();
+    data_.clear();
+    type_.clear();
+    pendingCR_ = false;
+    bomBytes_ = 0;
+    error_.clear();
+}
+
+const std::string& EventStreamParser::lastEventId() const {
+    return lastEventId_;
+}
+
+void EventStreamParser::setLastEventId(const std::string& id) {
+    lastEventId_ = id;
+}
+
+int EventStreamParser::retry() const {
+    return retry_;
+}
+
+bool EventStreamParser::hasError() const {
+    return !error_.empty();
+}
+
+std::string EventStreamParser::errorString() const {
+    return error_;
+}
+
+bool EventStreamParser::processLine(const char* line, size_t size) {
+    if (!size) {
+        return dispatch();
+    }
+    if (line[0] == ':') {
+        // Comment, often sent as a keepalive
+        return true;
+    }
+    const char* colon = static_cast<const char*>(memchr(line, ':', size));
+    size_t fieldSize = colon ? colon - line : size;
+    const char* value = colon ? colon + 1 : line + size;
+    if (value < line + size && *value == ' ') {
+        ++value;
+    }
+    size_t valueSize = line + size - value;
+
+    if (FieldIs(line, fieldSize, "data")) {
+        if (data_.size() + valueSize + 1 > maxEventSize_) {
+            return setError("Event is too large");
+        }
+        data_.append(value, valueSize);
+        data_ += '\n';
+    } else if (FieldIs(line, fieldSize, "event")) {
+        type_.assign(value, valueSize);
+    } else if (FieldIs(line, fieldSize, "id")) {
+        if (!memchr(value, '\0', valueSize)) {
+            lastEventId_.assign(value, valueSize);
+        }
+    } else if (FieldIs(line, fieldSize, "retry")) {
+        long long retry = 0;
+        size_t i = 0;
+        for (; i < valueSize && value[i] >= '0' && value[i] <= '9'; i++) {
+            retry = std::min<long long>(retry * 10 + (value[i] - '0'), INT_MAX);
+        }
+        if (valueSize && i == valueSize) {
+            retry_ = static_cast<int>(retry);
+        }
+    }
+    // Unknown fields are ignored
+    return true;
+}
+
+bool EventStreamParser::dispatch() {
+    if (data_.empty()) {
+        type_.clear();
+        return true;
+    }
+    data_.pop_back();
+    event_.id = lastEventId_;
+    if (type_.empty()) {
+        event_.type = "message";
+    } else {
+        event_.type.swap(type_);
+        type_.clear();
+    }
+    // Swapping keeps the capacity of both buffers for the next events
+    event_.data.swap(data_);
+    data_.clear();
+    if (callback_ && !callback_(event_)) {
+        return setError("Stopped by callback");
+    }
+    return true;
+}
+
+bool EventStreamParser::setError(const char* error) {
+    error_ = error;
+    return false;
+}
+
+EventSource::EventSource(NetworkClient& client, const Options& options):
+    client_(client),
+    options_(options),
+    stopped_(false),
+    contentTypeChecked_(false),
+    badContentType_(false),
+    reconnectDelay_(options.reconnectDelay),
+    connects_(0),
+    events_(0)
+{
+    parser_.setMaxEventSize(options.maxEventSize);
+    parser_.setEventCallback([this](const EventStreamParser::Event& event) {
+        ++events_;
+        if (callback_ && !callback_(event)) {
+            stopped_ = true;
+            return false;
+        }
+        return true;
+    });
+}
+
+void EventSource::setEventCallback(EventStreamParser::EventCallback callback) {
+    callback_ = std::move(callback);
+}
+
+bool EventSource::run(const std::string& url) {
+    stopped_ = false;
+    error_.clear();
+    client_.addRequestObserver(this);
+    bool success = true;
+    int attempts = 0;
+    while (!stopped_) {
+        parser_.reset();
+        contentTypeChecked_ = false;
+        badContentType_ = false;
+        client_.addQueryHeader("Accept", "text/event-stream");
+        client_.addQueryHeader("Cache-Control", "no-cache");
+        if (!parser_.lastEventId().empty()) {
+            client_.addQueryHeader("Last-Event-ID", parser_.lastEventId());
+        }
+        client_.setBodyCallback([this](const char* data, size_t size) {
+            return onData(data, size);
+        });
+        uint64_t eventsBefore = events_;
+        ++connects_;
+        client_.doGet(url);
+        if (parser_.retry() >= 0) {
+            reconnectDelay_ = parser_.retry();
+        }
+        if (stopped_) {
+            break;
+        }
+        if (parser_.hasError()) {
+            error_ = parser_.errorString();
+            success = false;
+            break;
+        }
+        int code = client_.responseCode();
+        if (code == 204) {
+            break;
+        }
+        if (badContentType_) {
+            error_ = "Unexpected content type of the event stream";
+            success = false;
+            break;
+        }
+        if (code > 0 && code != 200 && code < 500) {
+            error_ = "Unexpected response code " + std::to_string(code);
+            success = false;
+            break;
+        }
+        if (events_ != eventsBefore) {
+            attempts = 0;
+        }
+        if (options_.maxReconnectAttempts >= 0 && attempts >= options_.maxReconnectAttempts) {
+            error_ = client_.getCurlResult() != CURLE_OK ? client_.errorString() : "Event stream closed by server";
+            success = false;
+            break;
+        }
+        ++attempts;
+        if (!waitReconnect()) {
+            break;
+        }
+    }
+    client_.removeRequestObserver(this);
+    return success;
+}
+
+void EventSource::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+    }
+    stopCondition_.notify_all();
+    client_.cancel();
+}
+
+void EventSource::setLastEventId(const std::string& id) {
+    parser_.setLastEventId(id);
+}
+
+std::string EventSource::lastEventId() const {
+    return parser_.lastEventId();
+}
+
+int EventSource::reconnectDelay() const {
+    return reconnectDelay_;
+}
+
+EventSource::Stats EventSource::stats() const {
+    Stats stats;
+    stats.connects = connects_;
+    stats.events = events_;
+    return stats;
+}
+
+std::string EventSource::errorString() const {
+    return error_;
+}
+
+bool EventSource::admitRequest(NetworkClient& client, std::string& reason) {
+    (void)client;
+    // Closes the gap between the check in run() and the start of the transfer, where cancel() has no effect
+    if (stopped_) {
+        reason = "Event source stopped";
+        return false;
+    }
+    return true;
+}
+
+bool EventSource::onData(const char* data, size_t size) {
+    if (!contentTypeChecked_) {
+        contentTypeChecked_ = true;
+        char* contentType = nullptr;
+        curl_easy_getinfo(client_.getCurlHandle(), CURLINFO_CONTENT_TYPE, &contentType);
+        if (!IsEventStream(contentType)) {
+            badContentType_ = true;
+            return false;
+        }
+    }
+    return !stopped_ && parser_.feed(data, size);
+}
+
+bool EventSource::waitReconnect() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopCondition_.wait_for(lock, std::chrono::milliseconds(reconnectDelay_.load()), [this] {
+        return stopped_.load();
+    });
+    return !stopped_;
+}
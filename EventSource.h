@@ -0,0 +1,192 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef CURL_CPP_WRAPPER_EVENT_SOURCE_H
+#define CURL_CPP_WRAPPER_EVENT_SOURCE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "NetworkClient.h"
+
+/**
+ * Incremental parser of text/event-stream (Server-Sent Events). Input may be split into chunks
+ * at any byte, so it can be fed directly from NetworkClient::setBodyCallback().
+ * Only the current line and the data of the current event are buffered.
+ */
+class EventStreamParser
+{
+public:
+    struct Event
+    {
+        std::string id;
+        /**
+         * "message" if the event has no event field.
+         */
+        std::string type;
+        std::string data;
+    };
+
+    /**
+     * Returning false stops parsing with an error.
+     */
+    typedef std::function<bool(const Event& event)> EventCallback;
+
+    EventStreamParser();
+
+    void setEventCallback(EventCallback callback);
+
+    /**
+     * Events larger than this (and lines longer than this) are a parse error. Default is 1 MB.
+     */
+    void setMaxEventSize(size_t size);
+
+    bool feed(const char* data, size_t size);
+
+    /**
+     * Drops the incomplete event, e.g. when the connection is lost. The last event id
+     * and the retry value are kept.
+     */
+    void reset();
+
+    const std::string& lastEventId() const;
+    void setLastEventId(const std::string& id);
+
+    /**
+     * Reconnection time in milliseconds set by the stream, -1 if there was no valid retry field.
+     */
+    int retry() const;
+
+    bool hasError() const;
+    std::string errorString() const;
+
+private:
+    bool processLine(const char* line, size_t size);
+    bool dispatch();
+    bool setError(const char* error);
+
+    EventCallback callback_;
+    size_t maxEventSize_;
+    std::string line_;
+    std::string data_;
+    std::string type_;
+    std::string lastEventId_;
+    Event event_;
+    int retry_;
+    bool pendingCR_;
+    int bomBytes_;
+    std::string error_;
+};
+
+/**
+ * Consumer of a Server-Sent Events stream. Events are parsed while they are received,
+ * the connection is reestablished with Last-Event-ID when it is lost or the stream ends,
+ * after the delay set by the server with "retry:".
+ */
+class EventSource : public NetworkClient::RequestObserver
+{
+public:
+    struct Options
+    {
+        /**
+         * Delay before reconnecting in milliseconds until the server sets one.
+         */
+        int reconnectDelay;
+        /**
+         * Reconnection attempts in a row without receiving an event before run() gives up, -1 means unlimited.
+         */
+        int maxReconnectAttempts;
+        size_t maxEventSize;
+
+        Options(): reconnectDelay(3000), maxReconnectAttempts(-1), maxEventSize(1024 * 1024) {
+        }
+    };
+
+    struct Stats
+    {
+        uint64_t connects;
+        uint64_t events;
+
+        Stats(): connects(0), events(0) {
+        }
+    };
+
+    explicit EventSource(NetworkClient& client, const Options& options = Options());
+    EventSource(EventSource const&) = delete;
+    void operator=(EventSource const& x) = delete;
+
+    /**
+     * Called on the thread of run(). Returning false stops run().
+     */
+    void setEventCallback(EventStreamParser::EventCallback callback);
+
+    /**
+     * Receives events until stop() is called, the callback returns false or the server
+     * responds with 204 No Content. Server errors (5xx) and network errors cause a reconnect,
+     * other responses than 200 with Content-Type text/event-stream end it with an error.
+     * @return false on error, see errorString()
+     */
+    bool run(const std::string& url);
+
+    /**
+     * Makes run() return as soon as possible. Can be called from any thread.
+     */
+    void stop();
+
+    /**
+     * Id to send in Last-Event-ID with the first request, e.g. saved from a previous session.
+     */
+    void setLastEventId(const std::string& id);
+    std::string lastEventId() const;
+
+    /**
+     * Current delay before reconnecting in milliseconds.
+     */
+    int reconnectDelay() const;
+
+    Stats stats() const;
+    std::string errorString() const;
+
+    bool admitRequest(NetworkClient& client, std::string& reason) override;
+
+private:
+    bool onData(const char* data, size_t size);
+    bool waitReconnect();
+
+    NetworkClient& client_;
+    Options options_;
+    EventStreamParser parser_;
+    EventStreamParser::EventCallback callback_;
+    mutable std::mutex mutex_;
+    std::condition_variable stopCondition_;
+    std::atomic<bool> stopped_;
+    bool contentTypeChecked_;
+    bool badContentType_;
+    std::atomic<int> reconnectDelay_;
+    std::atomic<uint64_t> connects_;
+    std::atomic<uint64_t> events_;
+    std::string error_;
+};
+
+#endif
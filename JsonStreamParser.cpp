@@ -0,0 +1,418 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "JsonStreamParser.h"
+
+namespace {
+
+const size_t MaxDepth = 512;
+
+bool IsWhitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool IsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+int HexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+bool IsValidNumber(const std::string& str) {
+    size_t i = 0, n = str.size();
+    if (i < n && str[i] == '-') i++;
+    if (i < n && str[i] == '0') {
+        i++;
+    } else if (i < n && IsDigit(str[i])) {
+        while (i < n && IsDigit(str[i])) i++;
+    } else {
+        return false;
+    }
+    if (i < n && str[i] == '.') {
+        i++;
+        if (i == n || !IsDigit(str[i])) return false;
+        while (i < n && IsDigit(str[i])) i++;
+    }
+    if (i < n && (str[i] == 'e' || str[i] == 'E')) {
+        i++;
+        if (i < n && (str[i] == '+' || str[i] == '-')) i++;
+        if (i == n || !IsDigit(str[i])) return false;
+        while (i < n && IsDigit(str[i])) i++;
+    }
+    return i == n;
+}
+
+}
+
+#define JSON_NOTIFY(call) \
+    if (handler_ && !handler_->call) { \
+        return fail("Stopped by handler"); \
+    }
+
+JsonStreamParser::JsonStreamParser(Handler* handler): handler_(handler) {
+    reset();
+}
+
+void JsonStreamParser::setHandler(Handler* handler) {
+    handler_ = handler;
+}
+
+void JsonStreamParser::setElementCallback(ElementCallback callback) {
+    elementCallback_ = std::move(callback);
+}
+
+void JsonStreamParser::reset() {
+    state_ = stValue;
+    stack_.clear();
+    token_.clear();
+    literal_.clear();
+    stringIsKey_ = false;
+    escape_ = false;
+    unicodeDigits_ = 0;
+    unicodeValue_ = 0;
+    highSurrogate_ = 0;
+    chunk_ = nullptr;
+    capturing_ = false;
+    captureStart_ = 0;
+    element_.clear();
+    offset_ = 0;
+    error_.clear();
+}
+
+bool JsonStreamParser::feed(const char* data, size_t size) {
+    if (!error_.empty()) {
+        return false;
+    }
+    chunk_ = data;
+    for (size_t i = 0; i < size; i++) {
+        bool consumed = false;
+        while (!consumed) {
+            if (!processChar(data[i], i, consumed)) {
+                chunk_ = nullptr;
+                return false;
+            }
+        }
+        offset_++;
+    }
+    if (capturing_) {
+        // The element continues in the next chunk
+        element_.append(data + captureStart_, size - captureStart_);
+        captureStart_ = 0;
+    }
+    chunk_ = nullptr;
+    return true;
+}
+
+bool JsonStreamParser::finish() {
+    if (!error_.empty()) {
+        return false;
+    }
+    if (state_ == stNumber && stack_.empty()) {
+        if (!endNumber(0)) {
+            return false;
+        }
+    }
+    if (state_ != stDone) {
+        return fail("Unexpected end of data");
+    }
+    return true;
+}
+
+bool JsonStreamParser::hasError() const {
+    return !error_.empty();
+}
+
+std::string JsonStreamParser::errorString() const {
+    return error_;
+}
+
+size_t JsonStreamParser::offset() const {
+    return offset_;
+}
+
+bool JsonStreamParser::processChar(char c, size_t index, bool& consumed) {
+    consumed = true;
+
+    switch (state_) {
+    case stString:
+        if (unicodeDigits_ > 0) {
+            int value = HexValue(c);
+            if (value < 0) {
+                return fail("Invalid unicode escape");
+            }
+            unicodeValue_ = unicodeValue_ * 16 + value;
+            if (--unicodeDigits_ == 0) {
+                if (unicodeValue_ >= 0xD800 && unicodeValue_ <= 0xDBFF) {
+                    if (highSurrogate_) {
+                        return fail("Invalid surrogate pair");
+                    }
+                    highSurrogate_ = unicodeValue_;
+                } else if (unicodeValue_ >= 0xDC00 && unicodeValue_ <= 0xDFFF) {
+                    if (!highSurrogate_) {
+                        return fail("Invalid surrogate pair");
+                    }
+                    appendCodePoint(0x10000 + ((highSurrogate_ - 0xD800) << 10) + (unicodeValue_ - 0xDC00));
+                    highSurrogate_ = 0;
+                } else {
+                    if (highSurrogate_) {
+                        return fail("Invalid surrogate pair");
+                    }
+                    appendCodePoint(unicodeValue_);
+                }
+            }
+            return true;
+        }
+        if (escape_) {
+            escape_ = false;
+            return appendEscape(c);
+        }
+        if (highSurrogate_ && c != '\\') {
+            return fail("Invalid surrogate pair");
+        }
+        if (c == '\\') {
+            escape_ = true;
+            return true;
+        }
+        if (c == '"') {
+            if (stringIsKey_) {
+                return endString();
+            }
+            return endString() && endValue(index + 1);
+        }
+        if (static_cast<unsigned char>(c) < 0x20) {
+            return fail("Control character in string");
+        }
+        token_ += c;
+        return true;
+
+    case stNumber:
+        if (IsDigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+            token_ += c;
+            return true;
+        }
+        // The character terminating a number is processed again in the next state
+        consumed = false;
+        return endNumber(index);
+
+    case stLiteral:
+        token_ += c;
+        if (literal_.compare(0, token_.size(), token_) != 0) {
+            return fail("Invalid literal");
+        }
+        if (token_.size() == literal_.size()) {
+            if (literal_ == "null") {
+                JSON_NOTIFY(onNull());
+            } else {
+                JSON_NOTIFY(onBool(literal_ == "true"));
+            }
+            return endValue(index + 1);
+        }
+        return true;
+
+    default:
+        break;
+    }
+
+    if (IsWhitespace(c)) {
+        return true;
+    }
+
+    switch (state_) {
+    case stValueOrEnd:
+        if (c == ']') {
+            stack_.pop_back();
+            JSON_NOTIFY(onEndArray());
+            return endValue(index + 1);
+        }
+        return beginValue(c, index);
+    case stValue:
+        return beginValue(c, index);
+    case stKeyOrEnd:
+        if (c == '}') {
+            stack_.pop_back();
+            JSON_NOTIFY(onEndObject());
+            return endValue(index + 1);
+        }
+        // fallthrough
+    case stKey:
+        if (c != '"') {
+            return fail("Expected object key");
+        }
+        token_.clear();
+        stringIsKey_ = true;
+        state_ = stString;
+        return true;
+    case stColon:
+        if (c != ':') {
+            return fail("Expected ':'");
+        }
+        state_ = stValue;
+        return true;
+    case stCommaOrEnd:
+        if (c == ',') {
+            state_ = stack_.back() == '{' ? stKey : stValue;
+            return true;
+        }
+        if ((c == ']' && stack_.back() == '[') || (c == '}' && stack_.back() == '{')) {
+            stack_.pop_back();
+            if (c == ']') {
+                JSON_NOTIFY(onEndArray());
+            } else {
+                JSON_NOTIFY(onEndObject());
+            }
+            return endValue(index + 1);
+        }
+        return fail("Expected ',' or end of container");
+    case stDone:
+        return fail("Unexpected data after the end of document");
+    default:
+        return fail("Invalid parser state");
+    }
+}
+
+bool JsonStreamParser::beginValue(char c, size_t index) {
+    if (elementCallback_ && stack_.size() == 1 && stack_[0] == '[') {
+        capturing_ = true;
+        captureStart_ = index;
+    }
+
+    switch (c) {
+    case '{':
+    case '[':
+        if (stack_.size() >= MaxDepth) {
+            return fail("Maximum nesting depth exceeded");
+        }
+        stack_.push_back(c);
+        if (c == '{') {
+            JSON_NOTIFY(onStartObject());
+            state_ = stKeyOrEnd;
+        } else {
+            JSON_NOTIFY(onStartArray());
+            state_ = stValueOrEnd;
+        }
+        return true;
+    case '"':
+        token_.clear();
+        stringIsKey_ = false;
+        state_ = stString;
+        return true;
+    case 't':
+    case 'f':
+    case 'n':
+        literal_ = c == 't' ? "true" : c == 'f' ? "false" : "null";
+        token_.assign(1, c);
+        state_ = stLiteral;
+        return true;
+    default:
+        if (c == '-' || IsDigit(c)) {
+            token_.assign(1, c);
+            state_ = stNumber;
+            return true;
+        }
+        return fail(std::string("Unexpected character '") + c + "'");
+    }
+}
+
+bool JsonStreamParser::endValue(size_t endIndex) {
+    if (capturing_ && stack_.size() == 1) {
+        capturing_ = false;
+        element_.append(chunk_ + captureStart_, endIndex - captureStart_);
+        bool proceed = elementCallback_(element_);
+        element_.clear();
+        if (!proceed) {
+            return fail("Stopped by element callback");
+        }
+    }
+    state_ = stack_.empty() ? stDone : stCommaOrEnd;
+    return true;
+}
+
+bool JsonStreamParser::endString() {
+    if (highSurrogate_) {
+        return fail("Invalid surrogate pair");
+    }
+    if (stringIsKey_) {
+        JSON_NOTIFY(onKey(token_));
+        state_ = stColon;
+    } else {
+        JSON_NOTIFY(onString(token_));
+    }
+    return true;
+}
+
+bool JsonStreamParser::endNumber(size_t endIndex) {
+    if (!IsValidNumber(token_)) {
+        return fail("Invalid number '" + token_ + "'");
+    }
+    JSON_NOTIFY(onNumber(token_));
+    return endValue(endIndex);
+}
+
+bool JsonStreamParser::appendEscape(char c) {
+    if (c == 'u') {
+        unicodeDigits_ = 4;
+        unicodeValue_ = 0;
+        return true;
+    }
+    if (highSurrogate_) {
+        return fail("Invalid surrogate pair");
+    }
+    switch (c) {
+    case '"': token_ += '"'; break;
+    case '\\': token_ += '\\'; break;
+    case '/': token_ += '/'; break;
+    case 'b': token_ += '\b'; break;
+    case 'f': token_ += '\f'; break;
+    case 'n': token_ += '\n'; break;
+    case 'r': token_ += '\r'; break;
+    case 't': token_ += '\t'; break;
+    default:
+        return fail("Invalid escape sequence");
+    }
+    return true;
+}
+
+void JsonStreamParser::appendCodePoint(unsigned int codePoint) {
+    if (codePoint < 0x80) {
+        token_ += static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+        token_ += static_cast<char>(0xC0 | (codePoint >> 6));
+        token_ += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        token_ += static_cast<char>(0xE0 | (codePoint >> 12));
+        token_ += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        token_ += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+        token_ += static_cast<char>(0xF0 | (codePoint >> 18));
+        token_ += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        token_ += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        token_ += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+}
+
+bool JsonStreamParser::fail(const std::string& message) {
+    error_ = message + " at offset " + std::to_string(offset_);
+    return false;
+}
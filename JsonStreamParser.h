@@ -0,0 +1,128 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef CURL_CPP_WRAPPER_JSON_STREAM_PARSER_H
+#define CURL_CPP_WRAPPER_JSON_STREAM_PARSER_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Incremental (SAX-style) JSON parser. Input may be split into chunks at any byte,
+ * so it can be fed directly from NetworkClient::setBodyCallback().
+ */
+class JsonStreamParser
+{
+public:
+    /**
+     * Receives parsing events. Returning false stops parsing with an error.
+     * Numbers are passed as their source text.
+     */
+    class Handler
+    {
+    public:
+        virtual ~Handler() = default;
+        virtual bool onStartObject() { return true; }
+        virtual bool onEndObject() { return true; }
+        virtual bool onStartArray() { return true; }
+        virtual bool onEndArray() { return true; }
+        virtual bool onKey(const std::string& /*key*/) { return true; }
+        virtual bool onString(const std::string& /*value*/) { return true; }
+        virtual bool onNumber(const std::string& /*value*/) { return true; }
+        virtual bool onBool(bool /*value*/) { return true; }
+        virtual bool onNull() { return true; }
+    };
+
+    /**
+     * Receives the source text of every element of the top-level array, one at a time.
+     */
+    typedef std::function<bool(const std::string& element)> ElementCallback;
+
+    explicit JsonStreamParser(Handler* handler = nullptr);
+
+    void setHandler(Handler* handler);
+    void setElementCallback(ElementCallback callback);
+
+    /**
+     * Parses the next chunk of the document. Returns false on a syntax error
+     * or if a callback has stopped parsing.
+     */
+    bool feed(const char* data, size_t size);
+
+    /**
+     * Must be called after the last chunk. Returns false if the document is incomplete.
+     */
+    bool finish();
+
+    void reset();
+    bool hasError() const;
+    std::string errorString() const;
+
+    /**
+     * Number of bytes consumed so far.
+     */
+    size_t offset() const;
+
+private:
+    enum State
+    {
+        stValue,
+        stValueOrEnd,
+        stKeyOrEnd,
+        stKey,
+        stColon,
+        stCommaOrEnd,
+        stString,
+        stNumber,
+        stLiteral,
+        stDone
+    };
+
+    bool processChar(char c, size_t index, bool& consumed);
+    bool beginValue(char c, size_t index);
+    bool endValue(size_t endIndex);
+    bool endString();
+    bool endNumber(size_t endIndex);
+    bool appendEscape(char c);
+    void appendCodePoint(unsigned int codePoint);
+    bool fail(const std::string& message);
+
+    Handler* handler_;
+    ElementCallback elementCallback_;
+    State state_;
+    std::vector<char> stack_;
+    std::string token_;
+    std::string literal_;
+    bool stringIsKey_;
+    bool escape_;
+    int unicodeDigits_;
+    unsigned int unicodeValue_;
+    unsigned int highSurrogate_;
+    const char* chunk_;
+    bool capturing_;
+    size_t captureStart_;
+    std::string element_;
+    size_t offset_;
+    std::string error_;
+};
+
+#endif
@@ -0,0 +1,108 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "NetworkBatch.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+
+#include "NetworkScheduler.h"
+
+std::vector<NetworkBatch::Result> NetworkBatch::run(const std::vector<Request>& requests, int concurrency) {
+    std::vector<Result> results(requests.size());
+    run(requests, concurrency, [&results](size_t index, Result& result) {
+        results[index] = std::move(result);
+    });
+    return results;
+}
+
+void NetworkBatch::run(const std::vector<Request>& requests, int concurrency, const ResultCallback& callback) {
+    NetworkScheduler scheduler(std::max(1, std::min<int>(concurrency, static_cast<int>(requests.size()))));
+    run(scheduler, requests, callback);
+}
+
+void NetworkBatch::run(NetworkScheduler& scheduler, const std::vector<Request>& requests, const ResultCallback& callback) {
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t remaining = requests.size();
+
+    for (size_t i = 0; i < requests.size(); i++) {
+        scheduler.schedule(requests[i].url, [&, i](NetworkClient& client) {
+            Result result;
+            perform(client, requests[i], result);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (callback) {
+                callback(i, result);
+            }
+            if (--remaining == 0) {
+                finished.notify_all();
+            }
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&remaining] { return remaining == 0; });
+}
+
+void NetworkBatch::perform(NetworkClient& client, const Request& request, Result& result) {
+    if (start(client, request)) {
+        client.finishRequest(curl_easy_perform(client.getCurlHandle()));
+    }
+    collect(client, result);
+}
+
+bool NetworkBatch::start(NetworkClient& client, const Request& request) {
+    client.setDeadline(request.deadline);
+    for (const auto& header : request.headers) {
+        client.addQueryHeader(header.first, header.second);
+    }
+
+    if (request.method.empty() || request.method == "GET" || request.method == "HEAD") {
+        // Passed as the method, so that CURLOPT_NOBODY is set after CURLOPT_HTTPGET which resets it
+        if (!request.method.empty()) {
+            client.setMethod(request.method);
+        }
+        return client.startGet(request.url);
+    } else if (request.method == "PUT") {
+        client.setUrl(request.url).setMethod(request.method);
+        return client.startUpload("", request.body);
+    }
+    client.setUrl(request.url);
+    if (request.method != "POST") {
+        client.setMethod(request.method);
+    }
+    return client.startPost(request.body);
+}
+
+void NetworkBatch::collect(NetworkClient& client, Result& result) {
+    result.curlResult = client.getCurlResult();
+    result.responseCode = client.responseCode();
+    result.body = client.takeResponseBody();
+    result.timings = client.responseTimings();
+    result.errorString = client.errorString();
+    result.headers.clear();
+    size_t count = client.responseHeaderCount();
+    for (size_t i = 0; i < count; i++) {
+        std::string name;
+        std::string value = client.responseHeaderByIndex(static_cast<int>(i), name);
+        result.headers.emplace_back(name, value);
+    }
+}
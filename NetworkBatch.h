@@ -0,0 +1,112 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef CURL_CPP_WRAPPER_NETWORK_BATCH_H
+#define CURL_CPP_WRAPPER_NETWORK_BATCH_H
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "NetworkClient.h"
+
+class NetworkScheduler;
+
+/**
+ * Performs many independent requests concurrently on reused clients.
+ */
+class NetworkBatch
+{
+public:
+    typedef std::vector<std::pair<std::string, std::string>> HeaderList;
+
+    struct Request
+    {
+        /**
+         * GET (default), HEAD, POST, PUT or any custom method.
+         */
+        std::string method;
+        std::string url;
+        HeaderList headers;
+        std::string body;
+        /**
+         * The request fails with CURLE_OPERATION_TIMEDOUT if it hasn't finished by this time.
+         * Requests of a batch may share one deadline.
+         */
+        NetworkClient::Clock::time_point deadline;
+
+        Request(): deadline(NetworkClient::Clock::time_point::max()) {
+        }
+    };
+
+    struct Result
+    {
+        int curlResult;
+        int responseCode;
+        std::string body;
+        HeaderList headers;
+        NetworkClient::Timings timings;
+        std::string errorString;
+
+        Result(): curlResult(-1), responseCode(-1) {
+        }
+    };
+
+    /**
+     * Called for every finished request (calls are serialized, but made from worker threads).
+     * @param index is the index of the request in the input vector.
+     */
+    typedef std::function<void(size_t index, Result& result)> ResultCallback;
+
+    /**
+     * Runs requests with at most `concurrency` of them in flight and returns results in input order.
+     */
+    static std::vector<Result> run(const std::vector<Request>& requests, int concurrency);
+
+    /**
+     * Runs requests and passes results to the callback in the order they finish.
+     */
+    static void run(const std::vector<Request>& requests, int concurrency, const ResultCallback& callback);
+
+    /**
+     * Runs requests on an existing scheduler, so its clients (and their connections)
+     * are reused between batches. Blocks until all requests of this batch have finished.
+     */
+    static void run(NetworkScheduler& scheduler, const std::vector<Request>& requests, const ResultCallback& callback);
+
+    /**
+     * Performs a single request synchronously with the given client.
+     */
+    static void perform(NetworkClient& client, const Request& request, Result& result);
+
+    /**
+     * Sets up the request on the client without performing it (see NetworkClient::startGet()).
+     * The request must stay valid until the client has finished it.
+     */
+    static bool start(NetworkClient& client, const Request& request);
+
+    /**
+     * Fills the result from the client after the request has finished.
+     */
+    static void collect(NetworkClient& client, Result& result);
+};
+
+#endif
@@ -30,6 +30,7 @@
 
 #include <cstring>
 #include <cstdio>
+#include <cstdlib>
 #include <algorithm>
 #include <iostream>
 
@@ -37,6 +38,27 @@
 #include <Windows.h>
 #endif
 
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef CURL_CPP_WRAPPER_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef CURL_CPP_WRAPPER_WITH_ZSTD
+#include <zstd.h>
+#endif
+
 namespace NetworkClientInternal {
 
 void SplitString(const std::string& str, const std::string& delimiters, std::vector<std::string>& tokens,
@@ -84,6 +106,14 @@ std::string StrToLower(const std::string& str) {
     return s1;
 }
 
+uint64_t Fnv1a64(const char* data, size_t size, uint64_t hash) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 #ifdef _WIN32
 std::wstring StrToWide(const std::string& str, UINT codePage) {
     std::wstring ws;
@@ -145,6 +175,14 @@ int Fseek64( FILE* stream, int64_t  offset, int origin) {
 #endif
 }
 
+int Remove(const char* filename) {
+#ifdef _MSC_VER
+    return _wremove(Utf8ToWide(filename).c_str());
+#else
+    return remove(filename);
+#endif
+}
+
 int64_t Ftell64(FILE* a)
 {
 #ifdef __CYGWIN__
@@ -156,11 +194,328 @@ int64_t Ftell64(FILE* a)
 #endif
 }
 
+/**
+ * Creates an empty temporary file in the directory (the system temporary directory if empty)
+ * and opens it for writing.
+ */
+FILE* CreateTempFile(const std::string& directory, std::string& fileName) {
+#ifdef _WIN32
+    std::wstring dir = Utf8ToWide(directory);
+    if (dir.empty()) {
+        wchar_t tempPath[MAX_PATH + 1];
+        if (!GetTempPathW(MAX_PATH + 1, tempPath)) {
+            return nullptr;
+        }
+        dir = tempPath;
+    }
+    wchar_t tempFile[MAX_PATH + 1];
+    if (!GetTempFileNameW(dir.c_str(), L"ncb", 0, tempFile)) {
+        return nullptr;
+    }
+    fileName = WideToUtf8(tempFile);
+    return _wfopen(tempFile, L"wb");
+#else
+    std::string dir = directory;
+    if (dir.empty()) {
+        const char* tmpDir = getenv("TMPDIR");
+        dir = tmpDir && *tmpDir ? tmpDir : "/tmp";
+    }
+    std::string pattern = dir + "/networkclient_XXXXXX";
+    int fd = mkstemp(&pattern[0]);
+    if (fd == -1) {
+        return nullptr;
+    }
+    FILE* f = fdopen(fd, "wb");
+    if (!f) {
+        close(fd);
+        unlink(pattern.c_str());
+        return nullptr;
+    }
+    fileName = pattern;
+    return f;
+#endif
+}
+
+std::string ReadFileContents(const std::string& fileName) {
+    std::string result;
+    FILE* f = Fopen(fileName.c_str(), "rb");
+    if (!f) {
+        return result;
+    }
+    char buffer[65536];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        result.append(buffer, count);
+    }
+    fclose(f);
+    return result;
+}
+
+/**
+ * Read-only memory mapping of a whole file.
+ */
+class MappedFile {
+public:
+    MappedFile(): data_(nullptr), size_(0) {
+#ifdef _WIN32
+        mapping_ = nullptr;
+#endif
+    }
+
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const std::string& fileName) {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileW(Utf8ToWide(fileName).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                  nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        bool ok = GetFileSizeEx(file, &fileSize) != 0;
+        size_ = ok ? static_cast<size_t>(fileSize.QuadPart) : 0;
+        if (ok && size_) {
+            mapping_ = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            data_ = mapping_ ? static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+            ok = data_ != nullptr;
+        }
+        CloseHandle(file);
+#else
+        int fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd == -1) {
+            return false;
+        }
+        struct stat info;
+        bool ok = fstat(fd, &info) == 0;
+        size_ = ok ? static_cast<size_t>(info.st_size) : 0;
+        if (ok && size_) {
+            void* address = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = address != MAP_FAILED;
+            data_ = ok ? static_cast<const char*>(address) : nullptr;
+        }
+        ::close(fd);
+#endif
+        if (!ok) {
+            close();
+        }
+        return ok;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data_) {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_) {
+            CloseHandle(mapping_);
+            mapping_ = nullptr;
+        }
+#else
+        if (data_) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const char* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    const char* data_;
+    size_t size_;
+#ifdef _WIN32
+    HANDLE mapping_;
+#endif
+};
+
+// Allocator hooks for curl_global_init_mem(). Every block has a header with its size class and requested size,
+// so that frees and reallocs can be accounted and small blocks can be returned to the thread cache.
+struct AllocationHeader {
+    uint32_t sizeClass;
+    uint32_t reserved;
+    uint64_t size;
+};
+
+static_assert(sizeof(AllocationHeader) == 16, "Allocation header must keep 16 byte alignment");
+
+const uint32_t LargeBlockClass = 0xffffffff;
+const size_t SizeClassCount = 10; // 32 bytes..16 KB including the header
+const size_t MaxCachedBlocks = 64;
+
+struct ThreadAllocationCounters {
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t bytesAllocated;
+    uint64_t bytesFreed;
+};
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+struct ThreadBlockCache {
+    FreeBlock* lists[SizeClassCount];
+    size_t counts[SizeClassCount];
+
+    ThreadBlockCache();
+    ~ThreadBlockCache();
+};
+
+thread_local ThreadAllocationCounters threadAllocationCounters = { 0, 0, 0, 0 };
+// Set when the cache of the thread is destroyed, libcurl may still free memory afterwards (e.g. at exit)
+thread_local bool threadBlockCacheDestroyed = false;
+thread_local ThreadBlockCache threadBlockCache;
+bool usePoolAllocator = false;
+
+ThreadBlockCache::ThreadBlockCache() {
+    for (size_t i = 0; i < SizeClassCount; i++) {
+        lists[i] = nullptr;
+        counts[i] = 0;
+    }
+}
+
+ThreadBlockCache::~ThreadBlockCache() {
+    threadBlockCacheDestroyed = true;
+    for (size_t i = 0; i < SizeClassCount; i++) {
+        while (lists[i]) {
+            FreeBlock* block = lists[i];
+            lists[i] = block->next;
+            free(block);
+        }
+    }
+}
+
+size_t SizeClassBytes(uint32_t sizeClass) {
+    return static_cast<size_t>(32) << sizeClass;
+}
+
+uint32_t SizeClassFor(size_t blockSize) {
+    for (uint32_t i = 0; i < SizeClassCount; i++) {
+        if (blockSize <= SizeClassBytes(i)) {
+            return i;
+        }
+    }
+    return LargeBlockClass;
+}
+
+AllocationHeader* HeaderOf(void* ptr) {
+    return static_cast<AllocationHeader*>(ptr) - 1;
+}
+
+void* HookMalloc(size_t size) {
+    if (size > SIZE_MAX - sizeof(AllocationHeader)) {
+        return nullptr;
+    }
+    size_t blockSize = size + sizeof(AllocationHeader);
+    uint32_t sizeClass = usePoolAllocator ? SizeClassFor(blockSize) : LargeBlockClass;
+    void* block = nullptr;
+    if (sizeClass != LargeBlockClass) {
+        if (!threadBlockCacheDestroyed && threadBlockCache.lists[sizeClass]) {
+            FreeBlock* cached = threadBlockCache.lists[sizeClass];
+            threadBlockCache.lists[sizeClass] = cached->next;
+            threadBlockCache.counts[sizeClass]--;
+            block = cached;
+        } else {
+            block = malloc(SizeClassBytes(sizeClass));
+        }
+    } else {
+        block = malloc(blockSize);
+    }
+    if (!block) {
+        return nullptr;
+    }
+    auto* header = static_cast<AllocationHeader*>(block);
+    header->sizeClass = sizeClass;
+    header->reserved = 0;
+    header->size = size;
+    threadAllocationCounters.allocations++;
+    threadAllocationCounters.bytesAllocated += size;
+    return header + 1;
+}
+
+void HookFree(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    AllocationHeader* header = HeaderOf(ptr);
+    threadAllocationCounters.frees++;
+    threadAllocationCounters.bytesFreed += header->size;
+    uint32_t sizeClass = header->sizeClass;
+    if (sizeClass != LargeBlockClass && !threadBlockCacheDestroyed
+        && threadBlockCache.counts[sizeClass] < MaxCachedBlocks) {
+        auto* block = reinterpret_cast<FreeBlock*>(header);
+        block->next = threadBlockCache.lists[sizeClass];
+        threadBlockCache.lists[sizeClass] = block;
+        threadBlockCache.counts[sizeClass]++;
+        return;
+    }
+    free(header);
+}
+
+void* HookRealloc(void* ptr, size_t size) {
+    if (!ptr) {
+        return HookMalloc(size);
+    }
+    AllocationHeader* header = HeaderOf(ptr);
+    if (header->sizeClass != LargeBlockClass && size <= SizeClassBytes(header->sizeClass) - sizeof(AllocationHeader)) {
+        // Still fits into the block, accounted as a free of the old size and an allocation of the new one
+        threadAllocationCounters.frees++;
+        threadAllocationCounters.bytesFreed += header->size;
+        threadAllocationCounters.allocations++;
+        threadAllocationCounters.bytesAllocated += size;
+        header->size = size;
+        return ptr;
+    }
+    void* result = HookMalloc(size);
+    if (result) {
+        memcpy(result, ptr, std::min<uint64_t>(header->size, size));
+        HookFree(ptr);
+    }
+    return result;
+}
+
+void* HookCalloc(size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size) {
+        return nullptr;
+    }
+    void* result = HookMalloc(count * size);
+    if (result) {
+        memset(result, 0, count * size);
+    }
+    return result;
+}
+
+char* HookStrdup(const char* str) {
+    size_t length = strlen(str) + 1;
+    auto* result = static_cast<char*>(HookMalloc(length));
+    if (result) {
+        memcpy(result, str, length);
+    }
+    return result;
+}
+
 struct CurlInitializer {
     std::string certFileName;
+    CURLcode result;
 
-    CurlInitializer() {
-        curl_global_init(CURL_GLOBAL_ALL);
+    CurlInitializer(const NetworkClient::GlobalOptions& options, bool& created) {
+        created = true;
+        if (options.allocator == NetworkClient::amDefault) {
+            result = curl_global_init(options.flags);
+        } else {
+            usePoolAllocator = options.allocator == NetworkClient::amPool;
+            result = curl_global_init_mem(options.flags, HookMalloc, HookFree, HookRealloc, HookStrdup, HookCalloc);
+        }
 #ifdef _WIN32
         wchar_t buffer[1024] = {0};
         if (GetModuleFileNameW(nullptr, buffer, 1024) != 0) {
@@ -191,580 +546,2669 @@ struct CurlInitializer {
         curl_global_cleanup();
     }
 };
+
+CurlInitializer& GlobalCurlInitializer(const NetworkClient::GlobalOptions& options, bool& created) {
+    created = false;
+    static CurlInitializer initializer(options, created);
+    return initializer;
 }
 
-NetworkClient::NetworkClient():
-    outFile_(nullptr),
-    uploadingFile_(nullptr),
-    currentActionType_(atNone),
-    uploadDataOffset_(0),
-    progressCallback_(nullptr),
-    progressData_(nullptr),
-    curlResult_(CURLE_OK),
-    currentFileSize_(-1),
-    currentUploadDataSize_(0),
-    chunk_(nullptr),
-    chunkOffset_(-1),
-    chunkSize_(-1),
-    curlWinUnicode_(false)
-{
-    static NetworkClientInternal::CurlInitializer initializer;
+/**
+ * Streaming compressor used for request bodies.
+ */
+class BodyCompressor {
+public:
+    virtual ~BodyCompressor() = default;
+    virtual const char* encodingName() const = 0;
+    virtual bool reset() = 0;
+
+    /**
+     * Compresses as much of the input as fits into the output buffer.
+     * @param flush - no more input will follow, the stream should be finished.
+     * @param finished - is set to true when the end of the compressed stream has been written.
+     * @return false on error.
+     */
+    virtual bool process(const char* in, size_t inSize, bool flush, char* out, size_t outSize,
+                         size_t& consumed, size_t& produced, bool& finished) = 0;
+};
 
-    *errorBuffer_ = 0;
-    curlHandle_ = curl_easy_init();
-    bodyFuncData_.funcType = funcTypeBody;
-    bodyFuncData_.nmanager = this;
-    uploadBufferSize_ = 65536;
-    headerFuncData_.funcType = funcTypeHeader;
-    headerFuncData_.nmanager = this;
+#ifdef CURL_CPP_WRAPPER_WITH_ZLIB
+class GzipCompressor: public BodyCompressor {
+public:
+    explicit GzipCompressor(int level): level_(level), initialized_(false) {
+        memset(&stream_, 0, sizeof(stream_));
+    }
 
-    curl_easy_setopt(curlHandle_, CURLOPT_COOKIELIST, "");
-    setUserAgent("Mozilla/5.0");
+    ~GzipCompressor() override {
+        if (initialized_) {
+            deflateEnd(&stream_);
+        }
+    }
 
-    curl_easy_setopt(curlHandle_, CURLOPT_WRITEFUNCTION, private_static_writer);
-    curl_easy_setopt(curlHandle_, CURLOPT_WRITEDATA, &bodyFuncData_);
-    curl_easy_setopt(curlHandle_, CURLOPT_WRITEHEADER, &headerFuncData_);
-    curl_easy_setopt(curlHandle_, CURLOPT_ERRORBUFFER, errorBuffer_);
+    const char* encodingName() const override {
+        return "gzip";
+    }
 
-    curl_easy_setopt(curlHandle_, CURLOPT_PROGRESSFUNCTION, &private_progress_func);
-    curl_easy_setopt(curlHandle_, CURLOPT_NOPROGRESS, 0L);
-    curl_easy_setopt(curlHandle_, CURLOPT_PROGRESSDATA, this);
-    curl_easy_setopt(curlHandle_, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curlHandle_, CURLOPT_ENCODING, "");
-    curl_easy_setopt(curlHandle_, CURLOPT_SOCKOPTFUNCTION, &set_sockopts);
-    curl_easy_setopt(curlHandle_, CURLOPT_SOCKOPTDATA, this);
+    bool reset() override {
+        if (initialized_) {
+            return deflateReset(&stream_) == Z_OK;
+        }
+        // windowBits + 16 makes zlib write a gzip header instead of a zlib one
+        initialized_ = deflateInit2(&stream_, level_ < 0 ? Z_DEFAULT_COMPRESSION : level_, Z_DEFLATED,
+            15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        return initialized_;
+    }
 
-#if defined(_WIN32)
-    curl_version_info_data* versionInfo = curl_version_info(CURLVERSION_NOW);
+    bool process(const char* in, size_t inSize, bool flush, char* out, size_t outSize,
+                 size_t& consumed, size_t& produced, bool& finished) override {
+        stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+        stream_.avail_in = static_cast<uInt>(inSize);
+        stream_.next_out = reinterpret_cast<Bytef*>(out);
+        stream_.avail_out = static_cast<uInt>(outSize);
+        int ret = deflate(&stream_, flush ? Z_FINISH : Z_NO_FLUSH);
+        consumed = inSize - stream_.avail_in;
+        produced = outSize - stream_.avail_out;
+        finished = ret == Z_STREAM_END;
+        return ret == Z_OK || ret == Z_STREAM_END || ret == Z_BUF_ERROR;
+    }
 
-    if (versionInfo->features & CURL_VERSION_SSL && strstr(versionInfo->ssl_version, "Schannel") == nullptr
-        && strstr(versionInfo->ssl_version, "WinSSL") == nullptr
-        ) {
-        curl_easy_setopt(curlHandle_, CURLOPT_CAINFO, initializer.certFileName.c_str());
+private:
+    z_stream stream_;
+    int level_;
+    bool initialized_;
+};
+#endif
+
+#ifdef CURL_CPP_WRAPPER_WITH_ZSTD
+class ZstdCompressor: public BodyCompressor {
+public:
+    explicit ZstdCompressor(int level): level_(level), ctx_(ZSTD_createCCtx()) {
     }
-    #ifdef CURL_VERSION_UNICODE
-    curlWinUnicode_ = versionInfo->features & CURL_VERSION_UNICODE;
 
-    if (!curlWinUnicode_) {
-        std::cerr << "CURL should be compiled with Unicode support on Windows" << std::endl;
+    ~ZstdCompressor() override {
+        ZSTD_freeCCtx(ctx_);
     }
-    #endif
-#endif
-    curl_easy_setopt(curlHandle_, CURLOPT_SSL_VERIFYPEER, 1L);
-    curl_easy_setopt(curlHandle_, CURLOPT_SSL_VERIFYHOST, 2L);
 
-    //We want the referrer field set automatically when following locations
-    curl_easy_setopt(curlHandle_, CURLOPT_AUTOREFERER, 1L);
-    curl_easy_setopt(curlHandle_, CURLOPT_BUFFERSIZE, 32768L);
-    curl_easy_setopt(curlHandle_, CURLOPT_VERBOSE, 0L);
-}
+    const char* encodingName() const override {
+        return "zstd";
+    }
 
-NetworkClient::~NetworkClient() {
-    curl_easy_setopt(curlHandle_, CURLOPT_PROGRESSFUNCTION, nullptr);
-    curl_easy_cleanup(curlHandle_);
-}
+    bool reset() override {
+        if (!ctx_) {
+            return false;
+        }
+        ZSTD_CCtx_reset(ctx_, ZSTD_reset_session_only);
+        return !ZSTD_isError(ZSTD_CCtx_setParameter(ctx_, ZSTD_c_compressionLevel,
+            level_ < 0 ? ZSTD_CLEVEL_DEFAULT : level_));
+    }
 
-int NetworkClient::set_sockopts(void* clientp, curl_socket_t sockfd, curlsocktype purpose) {
-#ifdef _WIN32
-    // See http://support.microsoft.com/kb/823764
-    auto* nm = static_cast<NetworkClient*>(clientp);
-    int val = nm->uploadBufferSize_ + 32;
-    setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&val), sizeof(val));
+    bool process(const char* in, size_t inSize, bool flush, char* out, size_t outSize,
+                 size_t& consumed, size_t& produced, bool& finished) override {
+        ZSTD_inBuffer input = { in, inSize, 0 };
+        ZSTD_outBuffer output = { out, outSize, 0 };
+        size_t remaining = ZSTD_compressStream2(ctx_, &output, &input, flush ? ZSTD_e_end : ZSTD_e_continue);
+        if (ZSTD_isError(remaining)) {
+            return false;
+        }
+        consumed = input.pos;
+        produced = output.pos;
+        finished = flush && remaining == 0;
+        return true;
+    }
+
+private:
+    int level_;
+    ZSTD_CCtx* ctx_;
+};
 #endif
-    return 0;
-}
 
-size_t NetworkClient::private_static_writer(char* data, size_t size, size_t nmemb, void* buffer_in) {
-    auto cbd = static_cast<CallBackData*>(buffer_in);
-    NetworkClient* nm = cbd->nmanager;
-    if (nm) {
-        if (cbd->funcType == funcTypeBody) {
-            return nm->private_writer(data, size, nmemb);
-        }
-        else
-            return nm->private_header_writer(data, size, nmemb);
+BodyCompressor* CreateBodyCompressor(NetworkClient::CompressionType type, int level) {
+    switch (type) {
+#ifdef CURL_CPP_WRAPPER_WITH_ZLIB
+    case NetworkClient::ctGzip:
+        return new GzipCompressor(level);
+#endif
+#ifdef CURL_CPP_WRAPPER_WITH_ZSTD
+    case NetworkClient::ctZstd:
+        return new ZstdCompressor(level);
+#endif
+    default:
+        (void)level;
+        return nullptr;
     }
-    return 0;
 }
 
-NetworkClient& NetworkClient::setProxy(const std::string& host, int port, int type) {
-    curl_easy_setopt(curlHandle_, CURLOPT_PROXY, host.c_str());
-    curl_easy_setopt(curlHandle_, CURLOPT_PROXYPORT, static_cast<long>(port));
-    curl_easy_setopt(curlHandle_, CURLOPT_PROXYTYPE, static_cast<long>(type));
-    curl_easy_setopt(curlHandle_, CURLOPT_NOPROXY, "");
-    return *this;
-}
+/**
+ * Incremental hash function used to compute digests of transferred data.
+ */
+class ContentHasher {
+public:
+    virtual ~ContentHasher() = default;
+    virtual void reset() = 0;
+    virtual void update(const unsigned char* data, size_t size) = 0;
+
+    /**
+     * Returns raw digest bytes.
+     */
+    virtual std::string digest() = 0;
+};
 
-NetworkClient& NetworkClient::setProxyUserPassword(const std::string& username, const std::string& password) {
-    if (username.empty() && password.empty()) {
-        curl_easy_setopt(curlHandle_, CURLOPT_PROXYUSERPWD, nullptr);
-        curl_easy_setopt(curlHandle_, CURLOPT_PROXYAUTH, nullptr);
-    }
-    else {
-        std::string authStr = urlEncode(username) + ":" + urlEncode(password);
-        curl_easy_setopt(curlHandle_, CURLOPT_PROXYUSERPWD, authStr.c_str());
-        curl_easy_setopt(curlHandle_, CURLOPT_PROXYAUTH, CURLAUTH_ANY);
-    }
-    return *this;
+inline uint32_t RotateLeft32(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
 }
 
-size_t NetworkClient::private_writer(char* data, size_t size, size_t nmemb) {
-    if (!outFileName_.empty()) {
-        if (!outFile_)
-            if (!(outFile_ = NetworkClientInternal::Fopen(outFileName_.c_str(), "wb")))
-                return 0;
-        fwrite(data, size, nmemb, outFile_);
-    }
-    else
-        internalBuffer_.append(data, size * nmemb);
-    return size * nmemb;
+inline uint32_t RotateRight32(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
 }
 
-size_t NetworkClient::private_header_writer(char* data, size_t size, size_t nmemb) {
-    headerBuffer_.append(data, size * nmemb);
-    return size * nmemb;
+inline uint64_t RotateLeft64(uint64_t x, int n) {
+    return (x << n) | (x >> (64 - n));
 }
 
-size_t NetworkClient::private_progress_func(void* clientp, double dltotal, double dlnow, double ultotal, double ulnow) {
-    auto nm = static_cast<NetworkClient*>(clientp);
-    if (nm && nm->progressCallback_) {
-        if (nm->chunkOffset_ >= 0 && nm->chunkSize_ > 0 && nm->currentActionType_ == atUpload) {
-            ultotal = static_cast<double>(nm->currentFileSize_);
-            ulnow = static_cast<double>(nm->chunkOffset_) + ulnow;
+/**
+ * Base class for Merkle-Damgard hashes with 64-byte blocks (MD5, SHA-256).
+ */
+class BlockHasher: public ContentHasher {
+public:
+    void update(const unsigned char* data, size_t size) override {
+        totalSize_ += size;
+        while (size > 0) {
+            size_t n = std::min(size, sizeof(block_) - blockSize_);
+            memcpy(block_ + blockSize_, data, n);
+            blockSize_ += n;
+            data += n;
+            size -= n;
+            if (blockSize_ == sizeof(block_)) {
+                processBlock(block_);
+                blockSize_ = 0;
+            }
         }
-        else if (((ultotal <= 0 && nm->currentFileSize_ > 0)) && nm->currentActionType_ == atUpload)
-            ultotal = static_cast<double>(nm->currentFileSize_);
-        return nm->progressCallback_(nm->progressData_, dltotal, dlnow, ultotal, ulnow);
     }
-    return 0;
+
+protected:
+    BlockHasher(): blockSize_(0), totalSize_(0) {
+    }
+
+    void pad(bool bigEndian) {
+        uint64_t bitLength = totalSize_ * 8;
+        unsigned char padding[72] = { 0x80 };
+        size_t padSize = (blockSize_ < 56 ? 56 : 120) - blockSize_;
+        for (int i = 0; i < 8; i++) {
+            padding[padSize + i] = static_cast<unsigned char>(bitLength >> (bigEndian ? 56 - 8 * i : 8 * i));
+        }
+        update(padding, padSize + 8);
+    }
+
+    void resetBlocks() {
+        blockSize_ = 0;
+        totalSize_ = 0;
+    }
+
+    virtual void processBlock(const unsigned char* block) = 0;
+
+    unsigned char block_[64];
+    size_t blockSize_;
+    uint64_t totalSize_;
+};
+
+class Md5Hasher: public BlockHasher {
+public:
+    Md5Hasher() {
+        reset();
+    }
+
+    void reset() override {
+        resetBlocks();
+        state_[0] = 0x67452301;
+        state_[1] = 0xefcdab89;
+        state_[2] = 0x98badcfe;
+        state_[3] = 0x10325476;
+    }
+
+    std::string digest() override {
+        pad(false);
+        std::string result(16, '\0');
+        for (int i = 0; i < 16; i++) {
+            result[i] = static_cast<char>(state_[i / 4] >> (8 * (i % 4)));
+        }
+        return result;
+    }
+
+protected:
+    void processBlock(const unsigned char* block) override {
+        static const uint32_t k[64] = {
+            0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+            0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+            0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+            0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+            0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+            0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+            0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+            0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+        };
+        static const int shifts[16] = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+        uint32_t m[16];
+        for (int i = 0; i < 16; i++) {
+            m[i] = block[i * 4] | (block[i * 4 + 1] << 8) | (block[i * 4 + 2] << 16)
+                | (static_cast<uint32_t>(block[i * 4 + 3]) << 24);
+        }
+        uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+        for (int i = 0; i < 64; i++) {
+            uint32_t f;
+            int g;
+            if (i < 16) {
+                f = (b & c) | (~b & d);
+                g = i;
+            } else if (i < 32) {
+                f = (d & b) | (~d & c);
+                g = (5 * i + 1) % 16;
+            } else if (i < 48) {
+                f = b ^ c ^ d;
+                g = (3 * i + 5) % 16;
+            } else {
+                f = c ^ (b | ~d);
+                g = (7 * i) % 16;
+            }
+            uint32_t temp = d;
+            d = c;
+            c = b;
+            b = b + RotateLeft32(a + f + k[i] + m[g], shifts[(i / 16) * 4 + i % 4]);
+            a = temp;
+        }
+        state_[0] += a;
+        state_[1] += b;
+        state_[2] += c;
+        state_[3] += d;
+    }
+
+private:
+    uint32_t state_[4];
+};
+
+class Sha256Hasher: public BlockHasher {
+public:
+    Sha256Hasher() {
+        reset();
+    }
+
+    void reset() override {
+        static const uint32_t initial[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+        };
+        resetBlocks();
+        memcpy(state_, initial, sizeof(state_));
+    }
+
+    std::string digest() override {
+        pad(true);
+        std::string result(32, '\0');
+        for (int i = 0; i < 32; i++) {
+            result[i] = static_cast<char>(state_[i / 4] >> (24 - 8 * (i % 4)));
+        }
+        return result;
+    }
+
+protected:
+    void processBlock(const unsigned char* block) override {
+        static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (static_cast<uint32_t>(block[i * 4]) << 24) | (block[i * 4 + 1] << 16)
+                | (block[i * 4 + 2] << 8) | block[i * 4 + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = RotateRight32(w[i - 15], 7) ^ RotateRight32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = RotateRight32(w[i - 2], 17) ^ RotateRight32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t v[8];
+        memcpy(v, state_, sizeof(v));
+        for (int i = 0; i < 64; i++) {
+            uint32_t s1 = RotateRight32(v[4], 6) ^ RotateRight32(v[4], 11) ^ RotateRight32(v[4], 25);
+            uint32_t ch = (v[4] & v[5]) ^ (~v[4] & v[6]);
+            uint32_t temp1 = v[7] + s1 + ch + k[i] + w[i];
+            uint32_t s0 = RotateRight32(v[0], 2) ^ RotateRight32(v[0], 13) ^ RotateRight32(v[0], 22);
+            uint32_t maj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+            uint32_t temp2 = s0 + maj;
+            memmove(v + 1, v, 7 * sizeof(uint32_t));
+            v[4] += temp1;
+            v[0] = temp1 + temp2;
+        }
+        for (int i = 0; i < 8; i++) {
+            state_[i] += v[i];
+        }
+    }
+
+private:
+    uint32_t state_[8];
+};
+
+class Crc32cHasher: public ContentHasher {
+public:
+    Crc32cHasher(): crc_(0xFFFFFFFF) {
+        static const uint32_t* table = createTable();
+        table_ = table;
+    }
+
+    void reset() override {
+        crc_ = 0xFFFFFFFF;
+    }
+
+    void update(const unsigned char* data, size_t size) override {
+        uint32_t crc = crc_;
+        for (size_t i = 0; i < size; i++) {
+            crc = table_[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        crc_ = crc;
+    }
+
+    std::string digest() override {
+        uint32_t value = crc_ ^ 0xFFFFFFFF;
+        std::string result(4, '\0');
+        for (int i = 0; i < 4; i++) {
+            result[i] = static_cast<char>(value >> (24 - 8 * i));
+        }
+        return result;
+    }
+
+private:
+    static const uint32_t* createTable() {
+        static uint32_t table[256];
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int j = 0; j < 8; j++) {
+                crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+            }
+            table[i] = crc;
+        }
+        return table;
+    }
+
+    uint32_t crc_;
+    const uint32_t* table_;
+};
+
+class XxHash64Hasher: public ContentHasher {
+public:
+    XxHash64Hasher() {
+        reset();
+    }
+
+    void reset() override {
+        acc_[0] = Prime1 + Prime2;
+        acc_[1] = Prime2;
+        acc_[2] = 0;
+        acc_[3] = 0 - Prime1;
+        bufferSize_ = 0;
+        totalSize_ = 0;
+    }
+
+    void update(const unsigned char* data, size_t size) override {
+        totalSize_ += size;
+        while (size > 0) {
+            size_t n = std::min(size, sizeof(buffer_) - bufferSize_);
+            memcpy(buffer_ + bufferSize_, data, n);
+            bufferSize_ += n;
+            data += n;
+            size -= n;
+            if (bufferSize_ == sizeof(buffer_)) {
+                for (int i = 0; i < 4; i++) {
+                    acc_[i] = round(acc_[i], read64(buffer_ + i * 8));
+                }
+                bufferSize_ = 0;
+            }
+        }
+    }
+
+    std::string digest() override {
+        uint64_t h;
+        if (totalSize_ >= 32) {
+            h = RotateLeft64(acc_[0], 1) + RotateLeft64(acc_[1], 7) + RotateLeft64(acc_[2], 12) + RotateLeft64(acc_[3], 18);
+            for (int i = 0; i < 4; i++) {
+                h = (h ^ round(0, acc_[i])) * Prime1 + Prime4;
+            }
+        } else {
+            h = Prime5;
+        }
+        h += totalSize_;
+
+        size_t pos = 0;
+        for (; pos + 8 <= bufferSize_; pos += 8) {
+            h ^= round(0, read64(buffer_ + pos));
+            h = RotateLeft64(h, 27) * Prime1 + Prime4;
+        }
+        if (pos + 4 <= bufferSize_) {
+            uint64_t value = buffer_[pos] | (buffer_[pos + 1] << 8) | (buffer_[pos + 2] << 16)
+                | (static_cast<uint64_t>(buffer_[pos + 3]) << 24);
+            h ^= value * Prime1;
+            h = RotateLeft64(h, 23) * Prime2 + Prime3;
+            pos += 4;
+        }
+        for (; pos < bufferSize_; pos++) {
+            h ^= buffer_[pos] * Prime5;
+            h = RotateLeft64(h, 11) * Prime1;
+        }
+        h ^= h >> 33;
+        h *= Prime2;
+        h ^= h >> 29;
+        h *= Prime3;
+        h ^= h >> 32;
+
+        std::string result(8, '\0');
+        for (int i = 0; i < 8; i++) {
+            result[i] = static_cast<char>(h >> (56 - 8 * i));
+        }
+        return result;
+    }
+
+private:
+    static const uint64_t Prime1 = 0x9E3779B185EBCA87ULL;
+    static const uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL;
+    static const uint64_t Prime3 = 0x165667B19E3779F9ULL;
+    static const uint64_t Prime4 = 0x85EBCA77C2B2AE63ULL;
+    static const uint64_t Prime5 = 0x27D4EB2F165667C5ULL;
+
+    static uint64_t read64(const unsigned char* p) {
+        uint64_t value = 0;
+        for (int i = 7; i >= 0; i--) {
+            value = (value << 8) | p[i];
+        }
+        return value;
+    }
+
+    static uint64_t round(uint64_t acc, uint64_t input) {
+        acc += input * Prime2;
+        acc = RotateLeft64(acc, 31);
+        return acc * Prime1;
+    }
+
+    uint64_t acc_[4];
+    unsigned char buffer_[32];
+    size_t bufferSize_;
+    uint64_t totalSize_;
+};
+
+ContentHasher* CreateContentHasher(NetworkClient::HashType type) {
+    switch (type) {
+    case NetworkClient::htMd5:
+        return new Md5Hasher();
+    case NetworkClient::htSha256:
+        return new Sha256Hasher();
+    case NetworkClient::htCrc32c:
+        return new Crc32cHasher();
+    case NetworkClient::htXxHash64:
+        return new XxHash64Hasher();
+    default:
+        return nullptr;
+    }
+}
+
+std::string BytesToHex(const std::string& bytes) {
+    static const char digits[] = "0123456789abcdef";
+    std::string result;
+    result.reserve(bytes.size() * 2);
+    for (unsigned char c : bytes) {
+        result += digits[c >> 4];
+        result += digits[c & 0x0F];
+    }
+    return result;
+}
+
+std::string Base64Encode(const std::string& bytes) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string result;
+    for (size_t i = 0; i < bytes.size(); i += 3) {
+        uint32_t chunk = static_cast<unsigned char>(bytes[i]) << 16;
+        if (i + 1 < bytes.size()) chunk |= static_cast<unsigned char>(bytes[i + 1]) << 8;
+        if (i + 2 < bytes.size()) chunk |= static_cast<unsigned char>(bytes[i + 2]);
+        result += alphabet[(chunk >> 18) & 0x3F];
+        result += alphabet[(chunk >> 12) & 0x3F];
+        result += i + 1 < bytes.size() ? alphabet[(chunk >> 6) & 0x3F] : '=';
+        result += i + 2 < bytes.size() ? alphabet[chunk & 0x3F] : '=';
+    }
+    return result;
+}
+
+std::string UrlAuthority(const std::string& url) {
+    size_t start = url.find("://");
+    start = start == std::string::npos ? 0 : start + 3;
+    size_t end = url.find_first_of("/?#", start);
+    std::string authority = url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    size_t at = authority.rfind('@');
+    if (at != std::string::npos) {
+        authority.erase(0, at + 1);
+    }
+    return StrToLower(authority);
+}
+
+std::string StripPort(const std::string& authority) {
+    size_t colon = authority.rfind(':');
+    if (colon == std::string::npos || authority.find(']', colon) != std::string::npos) {
+        return authority;
+    }
+    return authority.substr(0, colon);
+}
+
+int GetSocketOption(curl_socket_t sockfd, int level, int name) {
+    int value = 0;
+    curl_socklen_t length = sizeof(value);
+    if (getsockopt(sockfd, level, name, reinterpret_cast<char*>(&value), &length) != 0) {
+        return -1;
+    }
+    return value;
+}
+
+// Returns the value read back after setting the option or -1 on failure
+int ApplySocketOption(curl_socket_t sockfd, int level, int name, int value) {
+    if (setsockopt(sockfd, level, name, reinterpret_cast<const char*>(&value), sizeof(value)) != 0) {
+        return -1;
+    }
+    return GetSocketOption(sockfd, level, name);
+}
+
+const int MinDownloadBufferSize = 1024;
+#ifdef CURL_MAX_READ_SIZE
+const int MaxDownloadBufferSize = CURL_MAX_READ_SIZE;
+#else
+const int MaxDownloadBufferSize = 512 * 1024;
+#endif
+const int MinUploadBufferSize = 16 * 1024;
+const int MaxUploadBufferSize = 2 * 1024 * 1024;
+
+// Picks a power of two buffer size which fits the bandwidth-delay product (rtt in microseconds)
+// and a 1/64 part of the expected transfer size, but doesn't exceed the transfer size.
+int ChooseBufferSize(int64_t expectedSize, double throughput, int64_t rtt, int minSize, int maxSize) {
+    double target = std::max(throughput * rtt / 1000000.0, expectedSize / 64.0);
+    if (expectedSize > 0) {
+        target = std::min(target, static_cast<double>(expectedSize));
+    }
+    int64_t size = 1;
+    while (size < target && size < maxSize) {
+        size *= 2;
+    }
+    return static_cast<int>(std::max<int64_t>(std::min<int64_t>(size, maxSize), minSize));
+}
+
+bool IsDefaultSocketProfile(const NetworkClient::SocketProfile& profile) {
+    return profile.noDelay < 0 && profile.sendBuffer < 0 && profile.recvBuffer < 0 && profile.keepAliveIdle < 0
+        && profile.keepAliveInterval < 0 && profile.fastOpen < 0 && profile.notSentLowat < 0 && profile.busyPoll < 0
+        && profile.tos < 0 && profile.congestionControl.empty();
+}
+
+NetworkClient::SocketProfile ApplySocketProfile(curl_socket_t sockfd, const NetworkClient::SocketProfile& profile) {
+    NetworkClient::SocketProfile applied;
+    if (profile.noDelay >= 0) {
+        applied.noDelay = ApplySocketOption(sockfd, IPPROTO_TCP, TCP_NODELAY, profile.noDelay);
+    }
+    if (profile.sendBuffer >= 0) {
+        applied.sendBuffer = ApplySocketOption(sockfd, SOL_SOCKET, SO_SNDBUF, profile.sendBuffer);
+    }
+    if (profile.recvBuffer >= 0) {
+        applied.recvBuffer = ApplySocketOption(sockfd, SOL_SOCKET, SO_RCVBUF, profile.recvBuffer);
+    }
+    if (profile.keepAliveIdle >= 0 || profile.keepAliveInterval >= 0) {
+        ApplySocketOption(sockfd, SOL_SOCKET, SO_KEEPALIVE, 1);
+    }
+#ifdef TCP_KEEPIDLE
+    if (profile.keepAliveIdle >= 0) {
+        applied.keepAliveIdle = ApplySocketOption(sockfd, IPPROTO_TCP, TCP_KEEPIDLE, profile.keepAliveIdle);
+    }
+#endif
+#ifdef TCP_KEEPINTVL
+    if (profile.keepAliveInterval >= 0) {
+        applied.keepAliveInterval = ApplySocketOption(sockfd, IPPROTO_TCP, TCP_KEEPINTVL, profile.keepAliveInterval);
+    }
+#endif
+#ifdef TCP_FASTOPEN_CONNECT
+    if (profile.fastOpen >= 0) {
+        applied.fastOpen = ApplySocketOption(sockfd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, profile.fastOpen);
+    }
+#endif
+#ifdef TCP_NOTSENT_LOWAT
+    if (profile.notSentLowat >= 0) {
+        applied.notSentLowat = ApplySocketOption(sockfd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, profile.notSentLowat);
+    }
+#endif
+#ifdef SO_BUSY_POLL
+    if (profile.busyPoll >= 0) {
+        applied.busyPoll = ApplySocketOption(sockfd, SOL_SOCKET, SO_BUSY_POLL, profile.busyPoll);
+    }
+#endif
+    if (profile.tos >= 0) {
+        struct sockaddr_storage address;
+        curl_socklen_t length = sizeof(address);
+        memset(&address, 0, sizeof(address));
+        getsockname(sockfd, reinterpret_cast<struct sockaddr*>(&address), &length);
+#ifdef IPV6_TCLASS
+        if (address.ss_family == AF_INET6) {
+            applied.tos = ApplySocketOption(sockfd, IPPROTO_IPV6, IPV6_TCLASS, profile.tos);
+        } else
+#endif
+        {
+            applied.tos = ApplySocketOption(sockfd, IPPROTO_IP, IP_TOS, profile.tos);
+        }
+    }
+#ifdef TCP_CONGESTION
+    if (!profile.congestionControl.empty()
+        && setsockopt(sockfd, IPPROTO_TCP, TCP_CONGESTION, profile.congestionControl.c_str(),
+                      static_cast<curl_socklen_t>(profile.congestionControl.size())) == 0) {
+        char name[64] = {};
+        curl_socklen_t length = sizeof(name) - 1;
+        if (getsockopt(sockfd, IPPROTO_TCP, TCP_CONGESTION, name, &length) == 0) {
+            applied.congestionControl = name;
+        }
+    }
+#endif
+    return applied;
+}
+}
+
+NetworkBufferPool::NetworkBufferPool(size_t maxRetainedBytes):
+    maxRetainedBytes_(maxRetainedBytes),
+    retainedBytes_(0)
+{
+}
+
+std::string NetworkBufferPool::acquire(size_t capacity) {
+    int sizeClass = 0;
+    while (sizeClass < ClassCount - 1 && (static_cast<size_t>(1) << (sizeClass + MinClassShift)) < capacity) {
+        sizeClass++;
+    }
+    std::string result;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Buffers of the next class are also good enough
+        for (int i = sizeClass; i < std::min<int>(sizeClass + 2, ClassCount); i++) {
+            if (!freeLists_[i].empty() && freeLists_[i].back().capacity() >= capacity) {
+                result.swap(freeLists_[i].back());
+                freeLists_[i].pop_back();
+                retainedBytes_ -= result.capacity();
+                return result;
+            }
+        }
+    }
+    result.reserve(std::max(capacity, static_cast<size_t>(1) << (sizeClass + MinClassShift)));
+    return result;
+}
+
+void NetworkBufferPool::release(std::string&& buffer) {
+    std::string item;
+    item.swap(buffer);
+    item.clear();
+    size_t capacity = item.capacity();
+    if (capacity < (static_cast<size_t>(1) << MinClassShift)) {
+        return;
+    }
+    int sizeClass = 0;
+    while (sizeClass < ClassCount - 1 && (static_cast<size_t>(1) << (sizeClass + MinClassShift + 1)) <= capacity) {
+        sizeClass++;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (retainedBytes_ + capacity > maxRetainedBytes_) {
+        return;
+    }
+    retainedBytes_ += capacity;
+    freeLists_[sizeClass].push_back(std::move(item));
+}
+
+void NetworkBufferPool::trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& list : freeLists_) {
+        std::vector<std::string>().swap(list);
+    }
+    retainedBytes_ = 0;
+}
+
+size_t NetworkBufferPool::retainedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return retainedBytes_;
+}
+
+NetworkClient::NetworkClient():
+    outFile_(nullptr),
+    uploadingFile_(nullptr),
+    currentActionType_(atNone),
+    uploadDataOffset_(0),
+    uploadStream_(nullptr),
+    uploadMulti_(nullptr),
+    progressCallback_(nullptr),
+    progressData_(nullptr),
+    curlResult_(CURLE_OK),
+    currentFileSize_(-1),
+    currentUploadDataSize_(0),
+    chunk_(nullptr),
+    chunkOffset_(-1),
+    chunkSize_(-1),
+    curlWinUnicode_(false),
+    compressionType_(ctNone),
+    compressionLevel_(-1),
+    compressInputOffset_(0),
+    compressInputEof_(false),
+    compressFinished_(false),
+    resumeDownload_(false),
+    resumeOffset_(0),
+    writeToBuffer_(false),
+    downloadHashType_(htNone),
+    uploadHashType_(htNone),
+    verifyDigestHeaders_(false),
+    bufferPool_(nullptr),
+    downloadBufferSize_(32768),
+    adaptiveBufferSize_(false),
+    appliedDownloadBufferSize_(0),
+    appliedUploadBufferSize_(0),
+    throughputEstimate_(0),
+    rttEstimate_(0),
+    lastDownloadSize_(0),
+    formPost_(nullptr),
+    spillThreshold_(0),
+    spillFile_(nullptr),
+    maxResponseSize_(-1),
+    bodySize_(0),
+    bodyTooLarge_(false),
+    responseBuffer_(nullptr),
+    responseBufferCapacity_(0),
+    responseBufferSize_(0),
+    responseBufferOverflow_(omError),
+    responseBufferOverflowed_(false),
+    responseTruncated_(false),
+    responseSource_(nullptr),
+    replayed_(false),
+    replayedCode_(0),
+    deadline_(Clock::time_point::max()),
+    timeout_(0),
+    deadlineChecks_(false),
+    userTimeoutMs_(0),
+    userConnectTimeoutMs_(0),
+    deadlineTimeoutsApplied_(false),
+    lastUploadBytes_(0),
+    stallWindowBytes_(0),
+    timeoutPhase_(tpNone),
+    cancelled_(false),
+    rejected_(false)
+{
+    // Initializes libcurl with default options unless globalInit() has been called
+    bool created;
+    const NetworkClientInternal::CurlInitializer& initializer = NetworkClientInternal::GlobalCurlInitializer(GlobalOptions(), created);
+    (void)initializer;
+
+    *errorBuffer_ = 0;
+    curlHandle_ = curl_easy_init();
+    bodyFuncData_.funcType = funcTypeBody;
+    bodyFuncData_.nmanager = this;
+    uploadBufferSize_ = 65536;
+    headerFuncData_.funcType = funcTypeHeader;
+    headerFuncData_.nmanager = this;
+
+    curl_easy_setopt(curlHandle_, CURLOPT_COOKIELIST, "");
+    setUserAgent("Mozilla/5.0");
+
+    curl_easy_setopt(curlHandle_, CURLOPT_WRITEFUNCTION, private_static_writer);
+    curl_easy_setopt(curlHandle_, CURLOPT_WRITEDATA, &bodyFuncData_);
+    curl_easy_setopt(curlHandle_, CURLOPT_WRITEHEADER, &headerFuncData_);
+    curl_easy_setopt(curlHandle_, CURLOPT_ERRORBUFFER, errorBuffer_);
+
+    curl_easy_setopt(curlHandle_, CURLOPT_PROGRESSFUNCTION, &private_progress_func);
+    curl_easy_setopt(curlHandle_, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curlHandle_, CURLOPT_PROGRESSDATA, this);
+    curl_easy_setopt(curlHandle_, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curlHandle_, CURLOPT_ENCODING, "");
+    curl_easy_setopt(curlHandle_, CURLOPT_SOCKOPTFUNCTION, &set_sockopts);
+    curl_easy_setopt(curlHandle_, CURLOPT_SOCKOPTDATA, this);
+
+#if defined(_WIN32)
+    curl_version_info_data* versionInfo = curl_version_info(CURLVERSION_NOW);
+
+    if (versionInfo->features & CURL_VERSION_SSL && strstr(versionInfo->ssl_version, "Schannel") == nullptr
+        && strstr(versionInfo->ssl_version, "WinSSL") == nullptr
+        ) {
+        curl_easy_setopt(curlHandle_, CURLOPT_CAINFO, initializer.certFileName.c_str());
+    }
+    #ifdef CURL_VERSION_UNICODE
+    curlWinUnicode_ = versionInfo->features & CURL_VERSION_UNICODE;
+
+    if (!curlWinUnicode_) {
+        std::cerr << "CURL should be compiled with Unicode support on Windows" << std::endl;
+    }
+    #endif
+#endif
+    curl_easy_setopt(curlHandle_, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(curlHandle_, CURLOPT_SSL_VERIFYHOST, 2L);
+
+    //We want the referrer field set automatically when following locations
+    curl_easy_setopt(curlHandle_, CURLOPT_AUTOREFERER, 1L);
+    curl_easy_setopt(curlHandle_, CURLOPT_BUFFERSIZE, static_cast<long>(downloadBufferSize_));
+    curl_easy_setopt(curlHandle_, CURLOPT_VERBOSE, 0L);
+}
+
+NetworkClient::~NetworkClient() {
+    if (uploadMulti_) {
+        curl_multi_cleanup(uploadMulti_);
+    }
+    curl_easy_setopt(curlHandle_, CURLOPT_PROGRESSFUNCTION, nullptr);
+    curl_easy_cleanup(curlHandle_);
+    private_remove_spill_file();
+}
+
+int NetworkClient::set_sockopts(void* clientp, curl_socket_t sockfd, curlsocktype purpose) {
+    auto* nm = static_cast<NetworkClient*>(clientp);
+    const SocketProfile* profile = nm->private_socket_profile();
+#ifdef _WIN32
+    if (!profile || profile->sendBuffer < 0) {
+        // See http://support.microsoft.com/kb/823764
+        int val = nm->uploadBufferSize_ + 32;
+        setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&val), sizeof(val));
+    }
+#endif
+    nm->appliedSocketProfile_ = profile ? NetworkClientInternal::ApplySocketProfile(sockfd, *profile) : SocketProfile();
+    return CURL_SOCKOPT_OK;
+}
+
+const NetworkClient::SocketProfile* NetworkClient::private_socket_profile() {
+    if (!hostSocketProfiles_.empty()) {
+        char* effectiveUrl = nullptr;
+        curl_easy_getinfo(curlHandle_, CURLINFO_EFFECTIVE_URL, &effectiveUrl);
+        std::string authority = NetworkClientInternal::UrlAuthority(effectiveUrl ? effectiveUrl : url_);
+        auto it = hostSocketProfiles_.find(authority);
+        if (it == hostSocketProfiles_.end()) {
+            it = hostSocketProfiles_.find(NetworkClientInternal::StripPort(authority));
+        }
+        if (it != hostSocketProfiles_.end()) {
+            return &it->second;
+        }
+    }
+    return socketProfile_.get();
+}
+
+NetworkClient& NetworkClient::setSocketProfile(const SocketProfile& profile) {
+    socketProfile_.reset(NetworkClientInternal::IsDefaultSocketProfile(profile) ? nullptr : new SocketProfile(profile));
+    return *this;
+}
+
+NetworkClient& NetworkClient::setHostSocketProfile(const std::string& host, const SocketProfile& profile) {
+    if (NetworkClientInternal::IsDefaultSocketProfile(profile)) {
+        hostSocketProfiles_.erase(NetworkClientInternal::StrToLower(host));
+    } else {
+        hostSocketProfiles_[NetworkClientInternal::StrToLower(host)] = profile;
+    }
+    return *this;
+}
+
+NetworkClient::SocketProfile NetworkClient::appliedSocketProfile() const {
+    return appliedSocketProfile_;
+}
+
+NetworkClient& NetworkClient::setUnixSocket(const std::string& path, bool abstract) {
+    unixSocket_.path = path;
+    unixSocket_.abstract = abstract;
+    return *this;
+}
+
+NetworkClient& NetworkClient::setHostUnixSocket(const std::string& host, const std::string& path, bool abstract) {
+    std::string key = NetworkClientInternal::StrToLower(host);
+    if (path.empty()) {
+        hostUnixSockets_.erase(key);
+    } else {
+        UnixSocketRoute& route = hostUnixSockets_[key];
+        route.path = path;
+        route.abstract = abstract;
+    }
+    return *this;
+}
+
+void NetworkClient::private_apply_unix_socket() {
+    const UnixSocketRoute* route = &unixSocket_;
+    if (!hostUnixSockets_.empty()) {
+        std::string authority = NetworkClientInternal::UrlAuthority(url_);
+        auto it = hostUnixSockets_.find(authority);
+        if (it == hostUnixSockets_.end()) {
+            it = hostUnixSockets_.find(NetworkClientInternal::StripPort(authority));
+        }
+        if (it != hostUnixSockets_.end()) {
+            route = &it->second;
+        }
+    }
+    const char* path = route->path.empty() ? nullptr : route->path.c_str();
+    // Both options share the same setting in curl, the last one wins
+#if LIBCURL_VERSION_NUM >= 0x073500
+    if (route->abstract) {
+        curl_easy_setopt(curlHandle_, CURLOPT_ABSTRACT_UNIX_SOCKET, path);
+    } else {
+        curl_easy_setopt(curlHandle_, CURLOPT_UNIX_SOCKET_PATH, path);
+    }
+#else
+    curl_easy_setopt(curlHandle_, CURLOPT_UNIX_SOCKET_PATH, path);
+#endif
+}
+
+size_t NetworkClient::private_static_writer(char* data, size_t size, size_t nmemb, void* buffer_in) {
+    auto cbd = static_cast<CallBackData*>(buffer_in);
+    NetworkClient* nm = cbd->nmanager;
+    if (nm) {
+        if (cbd->funcType == funcTypeBody) {
+            return nm->private_writer(data, size, nmemb);
+        }
+        else
+            return nm->private_header_writer(data, size, nmemb);
+    }
+    return 0;
+}
+
+NetworkClient& NetworkClient::setProxy(const std::string& host, int port, int type) {
+    curl_easy_setopt(curlHandle_, CURLOPT_PROXY, host.c_str());
+    curl_easy_setopt(curlHandle_, CURLOPT_PROXYPORT, static_cast<long>(port));
+    curl_easy_setopt(curlHandle_, CURLOPT_PROXYTYPE, static_cast<long>(type));
+    curl_easy_setopt(curlHandle_, CURLOPT_NOPROXY, "");
+    return *this;
+}
+
+NetworkClient& NetworkClient::setProxyUserPassword(const std::string& username, const std::string& password) {
+    if (username.empty() && password.empty()) {
+        curl_easy_setopt(curlHandle_, CURLOPT_PROXYUSERPWD, nullptr);
+        curl_easy_setopt(curlHandle_, CURLOPT_PROXYAUTH, nullptr);
+    }
+    else {
+        std::string authStr = urlEncode(username) + ":" + urlEncode(password);
+        curl_easy_setopt(curlHandle_, CURLOPT_PROXYUSERPWD, authStr.c_str());
+        curl_easy_setopt(curlHandle_, CURLOPT_PROXYAUTH, CURLAUTH_ANY);
+    }
+    return *this;
+}
+
+size_t NetworkClient::private_writer(char* data, size_t size, size_t nmemb) {
+    if (maxResponseSize_ >= 0) {
+        bodySize_ += size * nmemb;
+        if (bodySize_ > maxResponseSize_) {
+            bodyTooLarge_ = true;
+            return 0;
+        }
+    }
+    if (bodyCallback_ && !writeToBuffer_) {
+        long code = responseCode();
+        if (code >= 200 && code < 300) {
+            if (downloadHasher_) {
+                downloadHasher_->update(reinterpret_cast<const unsigned char*>(data), size * nmemb);
+            }
+            return bodyCallback_(data, size * nmemb) ? size * nmemb : 0;
+        }
+        writeToBuffer_ = true;
+    }
+    if (writeToBuffer_) {
+        private_reserve_buffer(internalBuffer_, size * nmemb, 16384, true);
+        internalBuffer_.append(data, size * nmemb);
+        return size * nmemb;
+    }
+    if (!outFileName_.empty()) {
+        if (!outFile_) {
+            const char* mode = "wb";
+            if (resumeDownload_) {
+                int check = private_resume_check();
+                if (check < 0) {
+                    return 0;
+                } else if (check == 0) {
+                    writeToBuffer_ = true;
+                    return private_writer(data, size, nmemb);
+                } else if (check == 2) {
+                    mode = "ab";
+                }
+            }
+            if (!(outFile_ = NetworkClientInternal::Fopen(outFileName_.c_str(), mode)))
+                return 0;
+            if (downloadHasher_ && resumeOffset_ > 0 && *mode == 'a' && !private_hash_file_part(resumeOffset_)) {
+                return 0;
+            }
+        }
+        fwrite(data, size, nmemb, outFile_);
+    }
+    else if (!private_write_body(data, size * nmemb)) {
+        return 0;
+    }
+    if (downloadHasher_) {
+        downloadHasher_->update(reinterpret_cast<const unsigned char*>(data), size * nmemb);
+    }
+    return size * nmemb;
+}
+
+bool NetworkClient::private_write_body(const char* data, size_t size) {
+    if (responseBuffer_ && !responseBufferOverflowed_) {
+        return private_write_response_buffer(data, size);
+    }
+    if (!spillFile_ && spillThreshold_ > 0) {
+        curl_off_t contentLength = -1;
+        curl_easy_getinfo(curlHandle_, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &contentLength);
+        if ((internalBuffer_.size() + size > spillThreshold_ || contentLength > static_cast<curl_off_t>(spillThreshold_))
+            && !private_spill_body()) {
+            return false;
+        }
+    }
+    if (spillFile_) {
+        return fwrite(data, 1, size, spillFile_) == size;
+    }
+    private_reserve_buffer(internalBuffer_, size, 16384, true);
+    internalBuffer_.append(data, size);
+    return true;
+}
+
+bool NetworkClient::private_write_response_buffer(const char* data, size_t size) {
+    size_t room = responseBufferCapacity_ - responseBufferSize_;
+    if (size <= room) {
+        memcpy(responseBuffer_ + responseBufferSize_, data, size);
+        responseBufferSize_ += size;
+        return true;
+    }
+    if (responseBufferOverflow_ == omTruncate) {
+        memcpy(responseBuffer_ + responseBufferSize_, data, room);
+        responseBufferSize_ += room;
+        responseTruncated_ = true;
+        // The rest is dropped, but the transfer continues so the connection can be reused
+        return true;
+    }
+    if (responseBufferOverflow_ == omHeap) {
+        responseBufferOverflowed_ = true;
+        private_reserve_buffer(internalBuffer_, responseBufferSize_ + size, 16384, true);
+        internalBuffer_.append(responseBuffer_, responseBufferSize_);
+        return private_write_body(data, size);
+    }
+    snprintf(errorBuffer_, sizeof(errorBuffer_), "Response buffer overflow");
+    return false;
+}
+
+NetworkClient& NetworkClient::setResponseBuffer(char* buffer, size_t capacity, OverflowMode overflow) {
+    responseBuffer_ = buffer;
+    responseBufferCapacity_ = buffer ? capacity : 0;
+    responseBufferOverflow_ = overflow;
+    responseBufferSize_ = 0;
+    responseBufferOverflowed_ = false;
+    responseTruncated_ = false;
+    return *this;
+}
+
+bool NetworkClient::responseTruncated() const {
+    return responseTruncated_;
+}
+
+bool NetworkClient::private_spill_body() {
+    spillFile_ = NetworkClientInternal::CreateTempFile(spillDirectory_, spillFileName_);
+    if (!spillFile_) {
+        return false;
+    }
+    if (!internalBuffer_.empty() && fwrite(internalBuffer_.data(), 1, internalBuffer_.size(), spillFile_) != internalBuffer_.size()) {
+        return false;
+    }
+    private_release_buffer(internalBuffer_);
+    return true;
+}
+
+void NetworkClient::private_remove_spill_file() {
+    mappedBody_.reset();
+    if (spillFile_) {
+        fclose(spillFile_);
+        spillFile_ = nullptr;
+    }
+    if (!spillFileName_.empty()) {
+        NetworkClientInternal::Remove(spillFileName_.c_str());
+        spillFileName_.clear();
+    }
+}
+
+NetworkClient::BodyView NetworkClient::responseBodyView() {
+    BodyView view;
+    if (responseBuffer_ && !responseBufferOverflowed_ && internalBuffer_.empty()) {
+        view.data = responseBuffer_;
+        view.size = responseBufferSize_;
+        return view;
+    }
+    if (spillFileName_.empty()) {
+        view.data = internalBuffer_.data();
+        view.size = internalBuffer_.size();
+        return view;
+    }
+    if (!mappedBody_) {
+        std::unique_ptr<NetworkClientInternal::MappedFile> mapped(new NetworkClientInternal::MappedFile());
+        if (!mapped->open(spillFileName_)) {
+            return view;
+        }
+        mappedBody_ = std::move(mapped);
+    }
+    view.data = mappedBody_->data();
+    view.size = mappedBody_->size();
+    return view;
+}
+
+std::string NetworkClient::responseBodyFile() const {
+    return spillFileName_;
+}
+
+std::string NetworkClient::takeResponseBodyFile() {
+    mappedBody_.reset();
+    std::string fileName;
+    fileName.swap(spillFileName_);
+    return fileName;
+}
+
+NetworkClient& NetworkClient::setSpillThreshold(size_t threshold, const std::string& directory) {
+    spillThreshold_ = threshold;
+    spillDirectory_ = directory;
+    return *this;
+}
+
+NetworkClient& NetworkClient::setMaxResponseSize(int64_t maxSize) {
+    maxResponseSize_ = maxSize;
+    curl_easy_setopt(curlHandle_, CURLOPT_MAXFILESIZE_LARGE, static_cast<curl_off_t>(std::max<int64_t>(maxSize, 0)));
+    return *this;
+}
+
+size_t NetworkClient::private_header_writer(char* data, size_t size, size_t nmemb) {
+    if (bufferPool_) {
+        private_reserve_buffer(headerBuffer_, size * nmemb, 1024, false);
+    }
+    headerBuffer_.append(data, size * nmemb);
+    return size * nmemb;
+}
+
+size_t NetworkClient::private_progress_func(void* clientp, double dltotal, double dlnow, double ultotal, double ulnow) {
+    auto nm = static_cast<NetworkClient*>(clientp);
+    if (nm && nm->private_check_deadline(static_cast<curl_off_t>(dlnow), static_cast<curl_off_t>(ultotal),
+                                         static_cast<curl_off_t>(ulnow))) {
+        return 1;
+    }
+    if (nm && nm->progressCallback_) {
+        if (nm->chunkOffset_ >= 0 && nm->chunkSize_ > 0 && nm->currentActionType_ == atUpload) {
+            ultotal = static_cast<double>(nm->currentFileSize_);
+            ulnow = static_cast<double>(nm->chunkOffset_) + ulnow;
+        }
+        else if (((ultotal <= 0 && nm->currentFileSize_ > 0)) && nm->currentActionType_ == atUpload)
+            ultotal = static_cast<double>(nm->currentFileSize_);
+        return nm->progressCallback_(nm->progressData_, dltotal, dlnow, ultotal, ulnow);
+    }
+    return 0;
+}
+
+NetworkClient& NetworkClient::setMethod(const std::string& str) {
+    method_ = str;
+    return *this;
+}
+
+NetworkClient& NetworkClient::addQueryParam(const std::string& name, const std::string& value) {
+    QueryParam newParam;
+    newParam.name = name;
+    newParam.value = value;
+    newParam.isFile = false;
+    queryParams_.push_back(newParam);
+    return *this;
+}
+
+NetworkClient& NetworkClient::addQueryParamFile(const std::string& name, const std::string& fileName, const std::string& displayName,
+                                      const std::string& contentType) {
+    QueryParam newParam;
+    newParam.name = name;
+    newParam.value = fileName;
+    newParam.isFile = true;
+    newParam.contentType = contentType;
+    newParam.displayName = displayName;
+    queryParams_.push_back(newParam);
+    return *this;
+}
+
+NetworkClient& NetworkClient::setUrl(const std::string& url) {
+    url_ = url;
+    curl_easy_setopt(curlHandle_, CURLOPT_URL, url.c_str());
+    return *this;
+}
+
+bool NetworkClient::doUploadMultipartData() {
+    if (!startUploadMultipartData()) {
+        return false;
+    }
+    return finishRequest(private_perform());
+}
+
+bool NetworkClient::startUploadMultipartData() {
+    if (method_.empty()) {
+        setMethod("POST");
+    }
+    
+    private_init_transfer();
+    private_apply_method();
+
+    struct curl_httppost* lastptr = nullptr;
+
+    for (const auto& it : queryParams_) {
+        if (it.isFile) {
+            std::string fileName = it.value;
+#ifdef _WIN32
+            if (!curlWinUnicode_) {
+                fileName = NetworkClientInternal::Utf8ToSystemLocale(it.value);
+            }
+#endif
+
+            if (it.contentType.empty())
+                curl_formadd(&formPost_,
+                             &lastptr,
+                             CURLFORM_COPYNAME, it.name.c_str(),
+                             CURLFORM_FILENAME, it.displayName.c_str(),
+                             CURLFORM_FILE, fileName.c_str(),
+                             CURLFORM_END);
+            else
+                curl_formadd(&formPost_,
+                             &lastptr,
+                             CURLFORM_COPYNAME, it.name.c_str(),
+                             CURLFORM_FILENAME, it.displayName.c_str(),
+                             CURLFORM_FILE, fileName.c_str(),
+                             CURLFORM_CONTENTTYPE, it.contentType.c_str(),
+                             CURLFORM_END);
+
+        } else {
+            curl_formadd(&formPost_,
+                         &lastptr,
+                         CURLFORM_COPYNAME, it.name.c_str(),
+                         CURLFORM_COPYCONTENTS, it.value.c_str(),
+                         CURLFORM_END);
+        }
+    }
+    
+    curl_easy_setopt(curlHandle_, CURLOPT_HTTPPOST, formPost_);
+    currentActionType_ = atUpload;
+    return private_before_perform();
+}
+
+bool NetworkClient::finishRequest(CURLcode result) {
+    curlResult_ = result;
+    AllocationStats allocations = threadAllocationStats();
+    requestAllocations_.allocations = allocations.allocations - allocationsAtStart_.allocations;
+    requestAllocations_.frees = allocations.frees - allocationsAtStart_.frees;
+    requestAllocations_.bytesAllocated = allocations.bytesAllocated - allocationsAtStart_.bytesAllocated;
+    requestAllocations_.bytesFreed = allocations.bytesFreed - allocationsAtStart_.bytesFreed;
+    if (bodyTooLarge_) {
+        curlResult_ = CURLE_FILESIZE_EXCEEDED;
+        snprintf(errorBuffer_, sizeof(errorBuffer_), "Maximum response size exceeded");
+    }
+    if (curlResult_ == CURLE_ABORTED_BY_CALLBACK && cancelled_) {
+        snprintf(errorBuffer_, sizeof(errorBuffer_), "Request cancelled");
+    } else if (timeoutPhase_ != tpNone) {
+        curlResult_ = CURLE_OPERATION_TIMEDOUT;
+        if (timeoutPhase_ == tpStall) {
+            snprintf(errorBuffer_, sizeof(errorBuffer_), "Transfer stalled: less than %lld bytes/s over %lld ms",
+                     static_cast<long long>(deadlinePolicy_.minSpeed), static_cast<long long>(deadlinePolicy_.stallWindow));
+        } else {
+            snprintf(errorBuffer_, sizeof(errorBuffer_), "No response within %lld ms",
+                     static_cast<long long>(deadlinePolicy_.firstByteTimeout));
+        }
+    } else if (curlResult_ == CURLE_OPERATION_TIMEDOUT) {
+        timeoutPhase_ = private_timeout_phase_from_timings();
+    }
+    if (spillFile_) {
+        fclose(spillFile_);
+        spillFile_ = nullptr;
+    }
+    if (curlResult_ == CURLE_OK && !replayed_) {
+        private_update_transfer_estimates();
+    }
+    if (formPost_) {
+        curl_formfree(formPost_);
+        formPost_ = nullptr;
+    }
+    if (uploadingFile_) {
+        fclose(uploadingFile_);
+        uploadingFile_ = nullptr;
+    }
+    if (uploadStream_) {
+        // Unblocks the producer if the request ended before the stream
+        uploadStream_->close();
+        uploadStream_ = nullptr;
+    }
+    return private_on_finish_request();
+}
+
+bool NetworkClient::private_before_perform() {
+    using namespace NetworkClientInternal;
+    for (auto* observer : observers_) {
+        std::string reason;
+        if (!observer->admitRequest(*this, reason)) {
+            snprintf(errorBuffer_, sizeof(errorBuffer_), "%s", reason.empty() ? "Request rejected" : reason.c_str());
+            rejected_ = true;
+            finishRequest(CURLE_ABORTED_BY_CALLBACK);
+            return false;
+        }
+    }
+    private_apply_deadline();
+    int downloadSize = downloadBufferSize_;
+    int uploadSize = uploadBufferSize_;
+    if (adaptiveBufferSize_) {
+        if (lastDownloadSize_ > 0 || throughputEstimate_ > 0) {
+            downloadSize = ChooseBufferSize(lastDownloadSize_, throughputEstimate_, rttEstimate_,
+                                            MinDownloadBufferSize, MaxDownloadBufferSize);
+        }
+        if (currentUploadDataSize_ > 0 || throughputEstimate_ > 0) {
+            uploadSize = ChooseBufferSize(currentUploadDataSize_, throughputEstimate_, rttEstimate_,
+                                          MinUploadBufferSize, MaxUploadBufferSize);
+        }
+    }
+    if (downloadSize != appliedDownloadBufferSize_) {
+        curl_easy_setopt(curlHandle_, CURLOPT_BUFFERSIZE, static_cast<long>(downloadSize));
+        appliedDownloadBufferSize_ = downloadSize;
+    }
+    if (uploadSize != appliedUploadBufferSize_) {
+#if LIBCURL_VERSION_NUM >= 0x073E00
+        curl_easy_setopt(curlHandle_, CURLOPT_UPLOAD_BUFFERSIZE, static_cast<long>(uploadSize));
+#endif
+        appliedUploadBufferSize_ = uploadSize;
+    }
+    return true;
+}
+
+void NetworkClient::private_update_transfer_estimates() {
+    const double weight = 0.3;
+    curl_off_t downloaded = 0, uploaded = 0, downloadSpeed = 0, uploadSpeed = 0, preTransfer = 0, startTransfer = 0;
+    curl_easy_getinfo(curlHandle_, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+    curl_easy_getinfo(curlHandle_, CURLINFO_SIZE_UPLOAD_T, &uploaded);
+    curl_easy_getinfo(curlHandle_, CURLINFO_SPEED_DOWNLOAD_T, &downloadSpeed);
+    curl_easy_getinfo(curlHandle_, CURLINFO_SPEED_UPLOAD_T, &uploadSpeed);
+    curl_easy_getinfo(curlHandle_, CURLINFO_PRETRANSFER_TIME_T, &preTransfer);
+    curl_easy_getinfo(curlHandle_, CURLINFO_STARTTRANSFER_TIME_T, &startTransfer);
+
+    lastDownloadSize_ = downloaded;
+    // Speeds of short transfers say little about the link
+    const curl_off_t minSampleSize = 64 * 1024;
+    double speed = std::max(downloaded >= minSampleSize ? static_cast<double>(downloadSpeed) : 0.0,
+                            uploaded >= minSampleSize ? static_cast<double>(uploadSpeed) : 0.0);
+    if (speed > 0) {
+        throughputEstimate_ = throughputEstimate_ > 0 ? throughputEstimate_ * (1 - weight) + speed * weight : speed;
+    }
+    // The time to the first response byte includes one round trip
+    int64_t rtt = startTransfer - preTransfer;
+    if (rtt > 0) {
+        rttEstimate_ = rttEstimate_ > 0 ? static_cast<int64_t>(rttEstimate_ * (1 - weight) + rtt * weight) : rtt;
+    }
+}
+
+bool NetworkClient::private_on_finish_request() {
+    if (!private_finish_hashes()) {
+        curlResult_ = CURLE_WRITE_ERROR;
+        snprintf(errorBuffer_, sizeof(errorBuffer_), "Content hash mismatch");
+    }
+    for (auto* observer : observers_) {
+        observer->onRequestFinish(*this);
+    }
+    if (resumeDownload_ && !outFileName_.empty()) {
+        private_finish_resume();
+    }
+    private_cleanup_after();
+    private_parse_headers();
+    if (curlResult_ != CURLE_OK) {
+        return false; //fail
+    }
+
+    return true;
+}
+
+std::string NetworkClient::responseBody() const {
+    if (responseBuffer_ && !responseBufferOverflowed_ && internalBuffer_.empty()) {
+        return std::string(responseBuffer_, responseBufferSize_);
+    }
+    if (!spillFileName_.empty()) {
+        return NetworkClientInternal::ReadFileContents(spillFileName_);
+    }
+    return internalBuffer_;
+}
+
+std::string NetworkClient::takeResponseBody() {
+    std::string body;
+    if (responseBuffer_ && !responseBufferOverflowed_ && internalBuffer_.empty()) {
+        body.assign(responseBuffer_, responseBufferSize_);
+        responseBufferSize_ = 0;
+        return body;
+    }
+    if (!spillFileName_.empty()) {
+        body = NetworkClientInternal::ReadFileContents(spillFileName_);
+        private_remove_spill_file();
+        return body;
+    }
+    body.swap(internalBuffer_);
+    return body;
+}
+
+int NetworkClient::responseCode() const {
+    if (rejected_) {
+        return -1;
+    }
+    if (replayed_) {
+        return replayedCode_;
+    }
+    long result = -1;
+    curl_easy_getinfo(curlHandle_, CURLINFO_RESPONSE_CODE, &result);
+    return result;
+}
+
+NetworkClient& NetworkClient::addQueryHeader(const std::string& name, const std::string& value) {
+    queryHeaders_.emplace_back(name, value);
+    return *this;
+}
+
+bool NetworkClient::doGet(const std::string& url) {
+    if (!startGet(url)) {
+        return false;
+    }
+    return finishRequest(private_perform());
+}
+
+bool NetworkClient::startGet(const std::string& url) {
+    if (!url.empty())
+        setUrl(url);
+
+    private_init_transfer();
+    if (resumeDownload_ && !outFileName_.empty()) {
+        private_init_resume();
+    }
+    if (!private_apply_method())
+        curl_easy_setopt(curlHandle_, CURLOPT_HTTPGET, 1);
+    currentActionType_ = atGet;
+    return private_before_perform();
+}
+
+bool NetworkClient::doPost(const std::string& data) {
+    if (!startPost(data)) {
+        return false;
+    }
+    return finishRequest(private_perform());
+}
+
+bool NetworkClient::startPost(const std::string& data) {
+    private_init_transfer();
+    if (!private_apply_method())
+        curl_easy_setopt(curlHandle_, CURLOPT_POST, 1L);
+    postFields_.clear();
+
+    for (const auto& it: queryParams_) {
+        if (!it.isFile) {
+            postFields_ += urlEncode(it.name) + "=" + urlEncode(it.value) + "&";
+        }
+    }
+
+    if (compressionType_ != ctNone) {
+        // The compressed size is not known in advance, so the body goes through the read callback
+        uploadData_ = data.empty() ? postFields_ : data;
+        uploadDataOffset_ = 0;
+        uploadingFile_ = nullptr;
+        currentFileSize_ = uploadData_.length();
+        currentUploadDataSize_ = currentFileSize_;
+        if (!private_init_compression()) {
+            finishRequest(curlResult_);
+            return false;
+        }
+    } else if(data.empty()) {
+        if (uploadHasher_) {
+            uploadHasher_->update(reinterpret_cast<const unsigned char*>(postFields_.data()), postFields_.size());
+        }
+        curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDS, postFields_.c_str());
+        curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDSIZE, static_cast<long>(postFields_.length()));
+    }
+    else {
+        if (uploadHasher_) {
+            uploadHasher_->update(reinterpret_cast<const unsigned char*>(data.data()), data.size());
+        }
+        curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDS, (const char*)data.data());
+        curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDSIZE, (long)data.length());
+    }
+    const std::string& body = data.empty() ? postFields_ : data;
+    requestBody_.data = body.data();
+    requestBody_.size = body.size();
+
+    currentActionType_ = atPost;
+    return private_before_perform();
+}
+
+std::string NetworkClient::urlEncode(const std::string& str) {
+    char* encoded = curl_easy_escape(curlHandle_, str.c_str(), str.length());
+    std::string res = encoded;
+    curl_free(encoded);
+    return res;
+}
+
+std::string NetworkClient::errorString() const {
+    return errorBuffer_;
+}
+
+NetworkClient& NetworkClient::setUserAgent(const std::string& userAgentStr) {
+    userAgent_ = userAgentStr;
+    return *this;
+}
+
+void NetworkClient::private_init_transfer() {
+    private_cleanup_before();
+    allocationsAtStart_ = threadAllocationStats();
+    for (auto* observer : observers_) {
+        observer->onRequestStart(*this);
+    }
+    curl_easy_setopt(curlHandle_, CURLOPT_USERAGENT, userAgent_.c_str());
+
+    chunk_ = nullptr;
+
+    for (const auto& it: queryHeaders_) {
+        if (it.value == "\n") {
+            chunk_ = curl_slist_append(chunk_, (it.name + ";" + it.value).c_str());
+        } else {
+            chunk_ = curl_slist_append(chunk_, (it.name + ": " + it.value).c_str());
+        }
+    }
+
+    curl_easy_setopt(curlHandle_, CURLOPT_HTTPHEADER, chunk_);
+    private_apply_unix_socket();
+    private_init_hashes();
+}
+
+std::string NetworkClient::responseHeaderText() const {
+    return headerBuffer_;
+}
+
+NetworkClient& NetworkClient::setProgressCallback(curl_progress_callback func, void* data) {
+    progressCallback_ = func;
+    progressData_ = data;
+    return *this;
+}
+
+void NetworkClient::private_parse_headers() {
+    std::vector<std::string> headers;
+    NetworkClientInternal::SplitString(headerBuffer_, "\n", headers);
+
+    for (const auto& it: headers) {
+        std::vector<std::string> thisHeader;
+        NetworkClientInternal::SplitString(it, ":", thisHeader, 2);
+
+        if (thisHeader.size() == 2) {
+            CustomHeaderItem chi;
+            chi.name = NetworkClientInternal::TrimString(thisHeader[0]);
+            chi.value = NetworkClientInternal::TrimString(thisHeader[1]);
+            responseHeaders_.push_back(chi);
+        }
+    }
+}
+
+std::string NetworkClient::responseHeaderByName(const std::string& name) const {
+    std::string lowerName = NetworkClientInternal::StrToLower(name);
+
+    for (const auto& it: responseHeaders_) {
+        if (NetworkClientInternal::StrToLower(it.name) == lowerName) {
+            return it.value;
+        }
+    }
+    return std::string();
+}
+
+size_t NetworkClient::responseHeaderCount() const {
+    return responseHeaders_.size();
+}
+
+std::string NetworkClient::responseHeaderByIndex(int index, std::string& name) const {
+    name = responseHeaders_[index].name;
+    return responseHeaders_[index].value;
+}
+
+void NetworkClient::private_cleanup_before() {
+    private_remove_spill_file();
+    bodySize_ = 0;
+    bodyTooLarge_ = false;
+    responseBufferSize_ = 0;
+    responseBufferOverflowed_ = false;
+    responseTruncated_ = false;
+    replayed_ = false;
+    timeoutPhase_ = tpNone;
+    cancelled_ = false;
+    rejected_ = false;
+    addQueryHeader("Expect", "");
+    responseHeaders_.clear();
+    private_release_buffer(internalBuffer_);
+    private_release_buffer(headerBuffer_);
+    curl_easy_setopt(curlHandle_, CURLOPT_READFUNCTION, nullptr);
+    curl_easy_setopt(curlHandle_, CURLOPT_SEEKFUNCTION, nullptr);
+    curl_easy_setopt(curlHandle_, CURLOPT_READDATA, stdin);
+}
+
+void NetworkClient::private_cleanup_after() {
+    currentActionType_ = atNone;
+    requestBody_ = BodyView();
+    currentUploadDataSize_ = 0;
+    queryHeaders_.clear();
+    queryParams_.clear();
+    if (outFile_) {
+        fclose(outFile_);
+        outFile_ = nullptr;
+    }
+    outFileName_.clear();
+    method_.clear();
+    if (resumeDownload_) {
+        curl_easy_setopt(curlHandle_, CURLOPT_RANGE, nullptr);
+        curl_easy_setopt(curlHandle_, CURLOPT_ENCODING, "");
+    }
+    resumeDownload_ = false;
+    resumeOffset_ = 0;
+    writeToBuffer_ = false;
+    bodyCallback_ = nullptr;
+    if (verifyDigestHeaders_) {
+        curl_easy_setopt(curlHandle_, CURLOPT_ENCODING, "");
+    }
+    downloadHashType_ = htNone;
+    uploadHashType_ = htNone;
+    expectedDownloadDigest_.clear();
+    verifyDigestHeaders_ = false;
+
+    curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDS, nullptr);
+    curl_easy_setopt(curlHandle_, CURLOPT_MIMEPOST, nullptr);
+    curl_easy_setopt(curlHandle_, CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(-1));
+    curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(-1));
+    curl_easy_setopt(curlHandle_, CURLOPT_HTTPHEADER, nullptr);
+    curl_easy_setopt(curlHandle_, CURLOPT_CUSTOMREQUEST, nullptr);
+    curl_easy_setopt(curlHandle_, CURLOPT_UPLOAD, 0L);
+    curl_easy_setopt(curlHandle_, CURLOPT_NOBODY, 0L);
+    curl_easy_setopt(curlHandle_, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(curlHandle_, CURLOPT_READFUNCTION, nullptr);
+    curl_easy_setopt(curlHandle_, CURLOPT_SEEKFUNCTION, nullptr);
+    curl_easy_setopt(curlHandle_, CURLOPT_SEEKDATA, nullptr);
+    curl_easy_setopt(curlHandle_, CURLOPT_READDATA, stdin);
+
+    uploadData_.clear();
+    uploadingFile_ = nullptr;
+    compressInput_.clear();
+    chunkOffset_ = -1;
+    chunkSize_ = -1;
+    uploadDataOffset_ = 0;
+    /*curl_easy_setopt(curl_handle, CURLOPT_READFUNCTION, 0L);
+    curl_easy_setopt(curl_handle, CURLOPT_READDATA, 0L);*/
+    if (chunk_) {
+        curl_slist_free_all(chunk_);
+        chunk_ = nullptr;
+    }
+}
+
+size_t NetworkClient::read_callback(void* ptr, size_t size, size_t nmemb, void* stream) {
+    auto nm = static_cast<NetworkClient*>(stream);
+    if (!nm) return 0;
+    return nm->private_read_callback(ptr, size, nmemb, stream);
+}
+
+size_t NetworkClient::private_read_callback(void* ptr, size_t size, size_t nmemb, void*) {
+    if (compressor_) {
+        return private_read_compressed(static_cast<char*>(ptr), size * nmemb);
+    }
+    return private_read_raw(static_cast<char*>(ptr), size, nmemb);
+}
+
+size_t NetworkClient::private_read_raw(char* ptr, size_t size, size_t nmemb) {
+    size_t retcode;
+    size_t wantsToRead = size * nmemb;
+    if (uploadingFile_) {
+        int64_t pos = NetworkClientInternal::Ftell64(uploadingFile_);
+        if (chunkOffset_ >= 0 && pos >= chunkOffset_ + currentUploadDataSize_) {
+            return 0;
+        }
+        retcode = fread(ptr, size, nmemb, uploadingFile_);
+        if (chunkOffset_ != -1) {
+            retcode = std::min<int64_t>((int64_t)retcode, chunkOffset_ + currentUploadDataSize_ - pos);
+        }
+    } else if (uploadStream_) {
+        retcode = uploadStream_->read(ptr, wantsToRead);
+        if (retcode == CURL_READFUNC_PAUSE || retcode == CURL_READFUNC_ABORT) {
+            return retcode;
+        }
+    } else {
+        size_t canRead = std::min<size_t>(uploadData_.size() - uploadDataOffset_, wantsToRead);
+        memcpy(ptr, uploadData_.data() + uploadDataOffset_, canRead);
+        uploadDataOffset_ += canRead;
+        retcode = canRead;
+    }
+    if (uploadHasher_) {
+        uploadHasher_->update(reinterpret_cast<const unsigned char*>(ptr), retcode * size);
+    }
+    return retcode;
+}
+
+size_t NetworkClient::private_read_compressed(char* ptr, size_t size) {
+    size_t produced = 0;
+    while (produced == 0 && !compressFinished_) {
+        if (compressInputOffset_ == compressInput_.size() && !compressInputEof_) {
+            compressInput_.resize(uploadBufferSize_);
+            size_t read = private_read_raw(&compressInput_[0], 1, compressInput_.size());
+            if (read == CURL_READFUNC_PAUSE || read == CURL_READFUNC_ABORT) {
+                compressInput_.clear();
+                compressInputOffset_ = 0;
+                return read;
+            }
+            compressInput_.resize(read);
+            compressInputOffset_ = 0;
+            compressInputEof_ = read == 0;
+        }
+        size_t consumed = 0;
+        if (!compressor_->process(compressInput_.data() + compressInputOffset_, compressInput_.size() - compressInputOffset_,
+                                  compressInputEof_, ptr, size, consumed, produced, compressFinished_)) {
+            return CURL_READFUNC_ABORT;
+        }
+        compressInputOffset_ += consumed;
+    }
+    return produced;
+}
+
+bool NetworkClient::private_rewind_upload() {
+    compressInput_.clear();
+    compressInputOffset_ = 0;
+    compressInputEof_ = false;
+    compressFinished_ = false;
+    if (uploadingFile_) {
+        if (NetworkClientInternal::Fseek64(uploadingFile_, chunkOffset_ >= 0 ? chunkOffset_ : 0, SEEK_SET)) {
+            return false;
+        }
+    } else {
+        uploadDataOffset_ = 0;
+    }
+    if (uploadHasher_) {
+        uploadHasher_->reset();
+    }
+    return compressor_->reset();
+}
+
+bool NetworkClient::private_init_compression() {
+    if (!compressor_) {
+        compressor_.reset(NetworkClientInternal::CreateBodyCompressor(compressionType_, compressionLevel_));
+    }
+    if (!compressor_ || !private_rewind_upload()) {
+        compressor_.reset();
+        curlResult_ = CURLE_NOT_BUILT_IN;
+        return false;
+    }
+    chunk_ = curl_slist_append(chunk_, (std::string("Content-Encoding: ") + compressor_->encodingName()).c_str());
+    chunk_ = curl_slist_append(chunk_, "Transfer-Encoding: chunked");
+    curl_easy_setopt(curlHandle_, CURLOPT_HTTPHEADER, chunk_);
+    curl_easy_setopt(curlHandle_, CURLOPT_READFUNCTION, read_callback);
+    curl_easy_setopt(curlHandle_, CURLOPT_READDATA, this);
+    curl_easy_setopt(curlHandle_, CURLOPT_SEEKFUNCTION, private_seek_callback);
+    curl_easy_setopt(curlHandle_, CURLOPT_SEEKDATA, this);
+    curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(-1));
+    curl_easy_setopt(curlHandle_, CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(-1));
+    return true;
+}
+
+int NetworkClient::private_seek_callback(void *userp, curl_off_t offset, int origin) {
+    auto* nc = static_cast<NetworkClient*>(userp);
+
+    if (nc->uploadStream_) {
+        // Data taken from a stream is gone
+        return CURL_SEEKFUNC_CANTSEEK;
+    }
+
+    if (nc->compressor_) {
+        // Compressed stream can only be restarted from the beginning
+        if (origin != SEEK_SET || offset != 0) {
+            return CURL_SEEKFUNC_CANTSEEK;
+        }
+        return nc->private_rewind_upload() ? CURL_SEEKFUNC_OK : CURL_SEEKFUNC_FAIL;
+    }
+
+    if (nc->uploadHasher_) {
+        // Data will be read again, the hash can be kept only if reading restarts from the beginning
+        if (origin == SEEK_SET && offset == 0) {
+            nc->uploadHasher_->reset();
+        } else {
+            nc->uploadHasher_.reset();
+        }
+    }
+
+    if (nc->uploadingFile_) {
+        int64_t newOffset = offset;
+        int newOrigin = origin;
+        if (origin == SEEK_SET && nc->chunkOffset_ != -1) {
+            newOffset = nc->chunkOffset_ + offset;
+        } else if (origin == SEEK_END) {
+            // not implemented
+            return CURL_SEEKFUNC_CANTSEEK;
+        }
+        return NetworkClientInternal::Fseek64(nc->uploadingFile_, newOffset, newOrigin);
+    } else {
+        if (origin == SEEK_SET) {
+            if (offset < 0 || offset>= nc->uploadData_.size()) {
+                return CURL_SEEKFUNC_CANTSEEK;
+            }
+            nc->uploadDataOffset_ = offset;
+        } else if (origin == SEEK_CUR) {
+            nc->uploadDataOffset_ += offset;
+        } else {
+            // not implemented
+            return CURL_SEEKFUNC_CANTSEEK;
+        }
+        return CURL_SEEKFUNC_OK;
+    }
+}
+
+bool NetworkClient::doUpload(const std::string& fileName, const std::string& data) {
+    if (!startUpload(fileName, data)) {
+        return false;
+    }
+    return finishRequest(private_perform());
+}
+
+bool NetworkClient::startUpload(const std::string& fileName, const std::string& data) {
+    if (!fileName.empty()) {
+        uploadingFile_ = NetworkClientInternal::Fopen(fileName.c_str(), "rb"); 
+        if (!uploadingFile_) {
+            return false; /* can't continue */
+        }
+        if (fseek(uploadingFile_, 0, SEEK_END) == 0) {
+            currentFileSize_ = NetworkClientInternal::Ftell64(uploadingFile_);
+            NetworkClientInternal::Fseek64(uploadingFile_, 0, SEEK_SET);
+        } else {
+            fclose(uploadingFile_);
+            uploadingFile_ = nullptr;
+            //currentFileSize_ = NetworkClientInternal::GetBigFileSize(fileName);
+            return false;
+        }
+        
+        currentUploadDataSize_ = currentFileSize_;
+        if (currentFileSize_ < 0) {
+            fclose(uploadingFile_);
+            uploadingFile_ = nullptr;
+            return false;
+        }
+        if (chunkSize_ > 0 && chunkOffset_ >= 0) {
+            currentUploadDataSize_ = chunkSize_;
+            if (NetworkClientInternal::Fseek64(uploadingFile_, chunkOffset_, SEEK_SET)) {
+            }
+        }
+        currentActionType_ = atUpload;
+    } else {
+        uploadDataOffset_ = 0;
+        uploadData_ = data;
+        currentFileSize_ = data.length();
+        currentUploadDataSize_ = currentFileSize_;
+        currentActionType_ = atPost;
+    }
+    private_init_transfer();
+    if (!uploadingFile_) {
+        requestBody_.data = uploadData_.data();
+        requestBody_.size = uploadData_.size();
+    }
+    curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDS, nullptr);
+    if (!private_apply_method()) {
+        curl_easy_setopt(curlHandle_, CURLOPT_POST, 1L);
+    }
+    curl_easy_setopt(curlHandle_, CURLOPT_READFUNCTION, read_callback);
+    curl_easy_setopt(curlHandle_, CURLOPT_READDATA, this);
+    curl_easy_setopt(curlHandle_, CURLOPT_SEEKFUNCTION, private_seek_callback);
+    curl_easy_setopt(curlHandle_, CURLOPT_SEEKDATA, this);
+
+    curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(currentUploadDataSize_));
+
+    curl_easy_setopt(curlHandle_, CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(currentUploadDataSize_));
+
+    if (compressionType_ != ctNone && !private_init_compression()) {
+        finishRequest(curlResult_);
+        return false;
+    }
+    return private_before_perform();
 }
 
-NetworkClient& NetworkClient::setMethod(const std::string& str) {
-    method_ = str;
-    return *this;
+bool NetworkClient::doUploadStream(UploadStream& stream) {
+    if (!startUploadStream(stream)) {
+        return false;
+    }
+    // The transfer is driven by a private multi handle, so that the producer can wake it up when it's paused.
+    // The handle is kept between requests, connections stay alive in its cache.
+    if (!uploadMulti_) {
+        uploadMulti_ = curl_multi_init();
+        if (!uploadMulti_) {
+            return finishRequest(CURLE_OUT_OF_MEMORY);
+        }
+    }
+    CURLM* multi = uploadMulti_;
+    std::function<void()> wakeupCallback;
+    {
+        std::lock_guard<std::mutex> lock(stream.mutex_);
+        wakeupCallback.swap(stream.wakeupCallback_);
+#if LIBCURL_VERSION_NUM >= 0x074400
+        stream.wakeupCallback_ = [multi] {
+            curl_multi_wakeup(multi);
+        };
+#endif
+    }
+    curl_multi_add_handle(multi, curlHandle_);
+    CURLcode result = CURLE_OK;
+    int running = 1;
+    while (running) {
+        resumeUpload();
+        if (curl_multi_perform(multi, &running) != CURLM_OK) {
+            result = CURLE_FAILED_INIT;
+            break;
+        }
+        if (!running) {
+            break;
+        }
+#if LIBCURL_VERSION_NUM >= 0x074400
+        curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+#else
+        curl_multi_wait(multi, nullptr, 0, 10, nullptr);
+#endif
+    }
+    int messages = 0;
+    while (CURLMsg* message = curl_multi_info_read(multi, &messages)) {
+        if (message->msg == CURLMSG_DONE && message->easy_handle == curlHandle_) {
+            result = message->data.result;
+        }
+    }
+    curl_multi_remove_handle(multi, curlHandle_);
+    {
+        std::lock_guard<std::mutex> lock(stream.mutex_);
+        stream.wakeupCallback_.swap(wakeupCallback);
+    }
+    return finishRequest(result);
 }
 
-NetworkClient& NetworkClient::addQueryParam(const std::string& name, const std::string& value) {
-    QueryParam newParam;
-    newParam.name = name;
-    newParam.value = value;
-    newParam.isFile = false;
-    queryParams_.push_back(newParam);
-    return *this;
+bool NetworkClient::startUploadStream(UploadStream& stream) {
+    currentFileSize_ = -1;
+    currentActionType_ = atUpload;
+    private_init_transfer();
+    uploadStream_ = &stream;
+    curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDS, nullptr);
+    if (!private_apply_method()) {
+        curl_easy_setopt(curlHandle_, CURLOPT_POST, 1L);
+    }
+    if (compressionType_ != ctNone) {
+        if (!private_init_compression()) {
+            finishRequest(curlResult_);
+            return false;
+        }
+    } else {
+        chunk_ = curl_slist_append(chunk_, "Transfer-Encoding: chunked");
+        curl_easy_setopt(curlHandle_, CURLOPT_HTTPHEADER, chunk_);
+        curl_easy_setopt(curlHandle_, CURLOPT_READFUNCTION, read_callback);
+        curl_easy_setopt(curlHandle_, CURLOPT_READDATA, this);
+        curl_easy_setopt(curlHandle_, CURLOPT_SEEKFUNCTION, private_seek_callback);
+        curl_easy_setopt(curlHandle_, CURLOPT_SEEKDATA, this);
+        curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(-1));
+        curl_easy_setopt(curlHandle_, CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(-1));
+    }
+    return private_before_perform();
 }
 
-NetworkClient& NetworkClient::addQueryParamFile(const std::string& name, const std::string& fileName, const std::string& displayName,
-                                      const std::string& contentType) {
-    QueryParam newParam;
-    newParam.name = name;
-    newParam.value = fileName;
-    newParam.isFile = true;
-    newParam.contentType = contentType;
-    newParam.displayName = displayName;
-    queryParams_.push_back(newParam);
-    return *this;
+void NetworkClient::resumeUpload() {
+    if (uploadStream_ && uploadStream_->resume()) {
+        curl_easy_pause(curlHandle_, CURLPAUSE_CONT);
+    }
 }
 
-NetworkClient& NetworkClient::setUrl(const std::string& url) {
-    url_ = url;
-    curl_easy_setopt(curlHandle_, CURLOPT_URL, url.c_str());
-    return *this;
+NetworkClient::UploadStream::UploadStream(size_t maxQueuedBytes):
+    frontOffset_(0),
+    queuedBytes_(0),
+    maxQueuedBytes_(maxQueuedBytes),
+    finished_(false),
+    aborted_(false),
+    closed_(false),
+    paused_(false),
+    bytesRead_(0),
+    pauseCount_(0)
+{
 }
 
-bool NetworkClient::doUploadMultipartData() {
-    if (method_.empty()) {
-        setMethod("POST");
+bool NetworkClient::UploadStream::write(const char* data, size_t size) {
+    return write(std::string(data, size));
+}
+
+bool NetworkClient::UploadStream::write(std::string&& buffer) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    spaceAvailable_.wait(lock, [this, &buffer] {
+        return aborted_ || closed_ || !queuedBytes_ || queuedBytes_ + buffer.size() <= maxQueuedBytes_;
+    });
+    if (aborted_ || closed_ || finished_) {
+        return false;
     }
-    
-    private_init_transfer();
-    private_apply_method();
+    if (buffer.empty()) {
+        return true;
+    }
+    queuedBytes_ += buffer.size();
+    queue_.push_back(std::move(buffer));
+    wakeup();
+    return true;
+}
 
-    struct curl_httppost* formpost = nullptr;
-    struct curl_httppost* lastptr = nullptr;
+void NetworkClient::UploadStream::finish() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_ = true;
+    wakeup();
+}
 
-    for (const auto& it : queryParams_) {
-        if (it.isFile) {
-            std::string fileName = it.value;
-#ifdef _WIN32
-            if (!curlWinUnicode_) {
-                fileName = NetworkClientInternal::Utf8ToSystemLocale(it.value);
-            }
-#endif
+void NetworkClient::UploadStream::abort() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    aborted_ = true;
+    spaceAvailable_.notify_all();
+    wakeup();
+}
 
-            if (it.contentType.empty())
-                curl_formadd(&formpost,
-                             &lastptr,
-                             CURLFORM_COPYNAME, it.name.c_str(),
-                             CURLFORM_FILENAME, it.displayName.c_str(),
-                             CURLFORM_FILE, fileName.c_str(),
-                             CURLFORM_END);
-            else
-                curl_formadd(&formpost,
-                             &lastptr,
-                             CURLFORM_COPYNAME, it.name.c_str(),
-                             CURLFORM_FILENAME, it.displayName.c_str(),
-                             CURLFORM_FILE, fileName.c_str(),
-                             CURLFORM_CONTENTTYPE, it.contentType.c_str(),
-                             CURLFORM_END);
+void NetworkClient::UploadStream::setWakeupCallback(std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    wakeupCallback_ = std::move(callback);
+}
 
-        } else {
-            curl_formadd(&formpost,
-                         &lastptr,
-                         CURLFORM_COPYNAME, it.name.c_str(),
-                         CURLFORM_COPYCONTENTS, it.value.c_str(),
-                         CURLFORM_END);
+int64_t NetworkClient::UploadStream::bytesRead() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytesRead_;
+}
+
+uint64_t NetworkClient::UploadStream::pauseCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pauseCount_;
+}
+
+size_t NetworkClient::UploadStream::read(char* buffer, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (aborted_) {
+        return CURL_READFUNC_ABORT;
+    }
+    size_t copied = 0;
+    while (copied < size && !queue_.empty()) {
+        const std::string& front = queue_.front();
+        size_t count = std::min(size - copied, front.size() - frontOffset_);
+        memcpy(buffer + copied, front.data() + frontOffset_, count);
+        copied += count;
+        frontOffset_ += count;
+        if (frontOffset_ == front.size()) {
+            queue_.pop_front();
+            frontOffset_ = 0;
         }
     }
-    
-    curl_easy_setopt(curlHandle_, CURLOPT_HTTPPOST, formpost);
-    currentActionType_ = atUpload;
-    curlResult_ = curl_easy_perform(curlHandle_);
-    curl_formfree(formpost);
-    return private_on_finish_request();
+    if (copied) {
+        queuedBytes_ -= copied;
+        bytesRead_ += copied;
+        spaceAvailable_.notify_all();
+        return copied;
+    }
+    if (finished_) {
+        return 0;
+    }
+    paused_ = true;
+    ++pauseCount_;
+    return CURL_READFUNC_PAUSE;
 }
 
-bool NetworkClient::private_on_finish_request() {
-    private_cleanup_after();
-    private_parse_headers();
-    if (curlResult_ != CURLE_OK) {
-        return false; //fail
+bool NetworkClient::UploadStream::resume() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!paused_ || (queue_.empty() && !finished_ && !aborted_)) {
+        return false;
+    }
+    paused_ = false;
+    return true;
+}
+
+void NetworkClient::UploadStream::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    paused_ = false;
+    spaceAvailable_.notify_all();
+}
+
+void NetworkClient::UploadStream::wakeup() {
+    // Called under the lock, so the callback can't be replaced while it runs
+    if (paused_ && wakeupCallback_) {
+        wakeupCallback_();
     }
+}
 
+bool NetworkClient::private_apply_method() {
+    curl_easy_setopt(curlHandle_, CURLOPT_CUSTOMREQUEST,nullptr);
+    curl_easy_setopt(curlHandle_, CURLOPT_UPLOAD, 0L);
+    if (method_ == "POST")
+        curl_easy_setopt(curlHandle_, CURLOPT_POST, 1L);
+    else if (method_ == "GET")
+        curl_easy_setopt(curlHandle_, CURLOPT_HTTPGET, 1L);
+    else if (method_ == "HEAD")
+        curl_easy_setopt(curlHandle_, CURLOPT_NOBODY, 1L); // reset by private_cleanup_after()
+    else if (method_ == "PUT")
+        curl_easy_setopt(curlHandle_, CURLOPT_UPLOAD, 1L);
+    else if (!method_.empty()) {
+        curl_easy_setopt(curlHandle_, CURLOPT_CUSTOMREQUEST, method_.c_str());
+    } else {
+        curl_easy_setopt(curlHandle_, CURLOPT_CUSTOMREQUEST, nullptr);
+        return false;
+    }
     return true;
 }
 
-std::string NetworkClient::responseBody() const {
-    return internalBuffer_;
+NetworkClient& NetworkClient::setReferer(const std::string& str) {
+    curl_easy_setopt(curlHandle_, CURLOPT_REFERER, str.c_str());
+    return *this;
 }
 
-int NetworkClient::responseCode() const {
-    long result = -1;
-    curl_easy_getinfo(curlHandle_, CURLINFO_RESPONSE_CODE, &result);
-    return result;
+int NetworkClient::getCurlResult() const {
+    // RequestRejected is not a valid CURLcode, so it is not stored in curlResult_
+    return rejected_ ? static_cast<int>(RequestRejected) : static_cast<int>(curlResult_);
 }
 
-NetworkClient& NetworkClient::addQueryHeader(const std::string& name, const std::string& value) {
-    queryHeaders_.emplace_back(name, value);
+NetworkClient::Timings NetworkClient::responseTimings() const {
+    if (rejected_) {
+        return Timings();
+    }
+    if (replayed_) {
+        return replayedTimings_;
+    }
+    Timings timings;
+    curl_off_t value = 0;
+    if (curl_easy_getinfo(curlHandle_, CURLINFO_NAMELOOKUP_TIME_T, &value) == CURLE_OK) {
+        timings.nameLookup = value;
+    }
+    if (curl_easy_getinfo(curlHandle_, CURLINFO_CONNECT_TIME_T, &value) == CURLE_OK) {
+        timings.connect = value;
+    }
+    if (curl_easy_getinfo(curlHandle_, CURLINFO_APPCONNECT_TIME_T, &value) == CURLE_OK) {
+        timings.appConnect = value;
+    }
+    if (curl_easy_getinfo(curlHandle_, CURLINFO_PRETRANSFER_TIME_T, &value) == CURLE_OK) {
+        timings.preTransfer = value;
+    }
+    if (curl_easy_getinfo(curlHandle_, CURLINFO_STARTTRANSFER_TIME_T, &value) == CURLE_OK) {
+        timings.startTransfer = value;
+    }
+    if (curl_easy_getinfo(curlHandle_, CURLINFO_TOTAL_TIME_T, &value) == CURLE_OK) {
+        timings.total = value;
+    }
+    if (curl_easy_getinfo(curlHandle_, CURLINFO_REDIRECT_TIME_T, &value) == CURLE_OK) {
+        timings.redirect = value;
+    }
+    timings.downloadBufferSize = appliedDownloadBufferSize_;
+    timings.uploadBufferSize = appliedUploadBufferSize_;
+    return timings;
+}
+
+CURL* NetworkClient::getCurlHandle() {
+    return curlHandle_;
+}
+
+NetworkClient& NetworkClient::setOutputFile(const std::string& str) {
+    outFileName_ = str;
     return *this;
 }
 
-bool NetworkClient::doGet(const std::string& url) {
-    if (!url.empty())
-        setUrl(url);
+NetworkClient& NetworkClient::setBodyCallback(BodyCallback callback) {
+    bodyCallback_ = std::move(callback);
+    return *this;
+}
 
-    private_init_transfer();
-    if (!private_apply_method())
-        curl_easy_setopt(curlHandle_, CURLOPT_HTTPGET, 1);
-    currentActionType_ = atGet;
-    curlResult_ = curl_easy_perform(curlHandle_);
-    return private_on_finish_request();
+NetworkClient& NetworkClient::addRequestObserver(RequestObserver* observer) {
+    if (observer && std::find(observers_.begin(), observers_.end(), observer) == observers_.end()) {
+        observers_.push_back(observer);
+    }
+    return *this;
+}
 
+NetworkClient& NetworkClient::removeRequestObserver(RequestObserver* observer) {
+    observers_.erase(std::remove(observers_.begin(), observers_.end(), observer), observers_.end());
+    return *this;
 }
 
-bool NetworkClient::doPost(const std::string& data) {
-    private_init_transfer();
-    if (!private_apply_method())
-        curl_easy_setopt(curlHandle_, CURLOPT_POST, 1L);
-    std::string postData;
+std::string NetworkClient::url() const {
+    return url_;
+}
 
-    for (const auto& it: queryParams_) {
-        if (!it.isFile) {
-            postData += urlEncode(it.name) + "=" + urlEncode(it.value) + "&";
+NetworkClient& NetworkClient::setDeadline(Clock::time_point deadline) {
+    deadline_ = deadline;
+    return *this;
+}
+
+NetworkClient& NetworkClient::setTimeout(int64_t milliseconds) {
+    timeout_ = std::max<int64_t>(milliseconds, 0);
+    return *this;
+}
+
+NetworkClient& NetworkClient::setDeadlinePolicy(const DeadlinePolicy& policy) {
+    deadlinePolicy_ = policy;
+    return *this;
+}
+
+int64_t NetworkClient::remainingBudget() const {
+    if (deadline_ == Clock::time_point::max()) {
+        return -1;
+    }
+    return std::max<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline_ - Clock::now()).count(), 0);
+}
+
+NetworkClient::TimeoutPhase NetworkClient::timeoutPhase() const {
+    return timeoutPhase_;
+}
+
+void NetworkClient::cancel() {
+    cancelled_ = true;
+}
+
+void NetworkClient::private_apply_deadline() {
+    requestStartTime_ = Clock::now();
+    lastUploadActivity_ = requestStartTime_;
+    lastUploadBytes_ = 0;
+    stallWindowStart_ = requestStartTime_;
+    stallWindowBytes_ = 0;
+
+    Clock::time_point deadline = deadline_;
+    if (timeout_ > 0) {
+        deadline = std::min(deadline, requestStartTime_ + std::chrono::milliseconds(timeout_));
+    }
+    long total = 0;
+    long connect = static_cast<long>(deadlinePolicy_.connectTimeout);
+    if (deadline != Clock::time_point::max()) {
+        int64_t remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - requestStartTime_).count();
+        // 0 would mean no timeout, an exhausted budget fails the request right away
+        total = static_cast<long>(std::max<int64_t>(remaining, 1));
+        long share = static_cast<long>(std::max(total * deadlinePolicy_.connectShare, 1.0));
+        connect = connect > 0 ? std::min(connect, share) : share;
+    }
+    if (total > 0 || connect > 0) {
+        if (userTimeoutMs_ > 0) {
+            total = total > 0 ? std::min(total, userTimeoutMs_) : userTimeoutMs_;
+        }
+        if (userConnectTimeoutMs_ > 0) {
+            connect = connect > 0 ? std::min(connect, userConnectTimeoutMs_) : userConnectTimeoutMs_;
         }
+        curl_easy_setopt(curlHandle_, CURLOPT_TIMEOUT_MS, total);
+        curl_easy_setopt(curlHandle_, CURLOPT_CONNECTTIMEOUT_MS, connect);
+        deadlineTimeoutsApplied_ = true;
+    } else if (deadlineTimeoutsApplied_) {
+        // Don't touch timeouts set by the caller unless they were overridden by a previous request
+        curl_easy_setopt(curlHandle_, CURLOPT_TIMEOUT_MS, userTimeoutMs_);
+        curl_easy_setopt(curlHandle_, CURLOPT_CONNECTTIMEOUT_MS, userConnectTimeoutMs_);
+        deadlineTimeoutsApplied_ = false;
     }
+    deadlineChecks_ = deadlinePolicy_.firstByteTimeout > 0 || deadlinePolicy_.minSpeed > 0;
+}
 
-    if(data.empty()) {
-        curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDS, postData.c_str());
-        curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDSIZE, static_cast<long>(postData.length()));
+bool NetworkClient::private_check_deadline(curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+    if (cancelled_.load(std::memory_order_relaxed)) {
+        return true;
     }
-    else {
-        curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDS, (const char*)data.data());
-        curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDSIZE, (long)data.length());
+    if (!deadlineChecks_) {
+        return false;
+    }
+    Clock::time_point now = Clock::now();
+    if (ulnow != lastUploadBytes_) {
+        lastUploadBytes_ = ulnow;
+        lastUploadActivity_ = now;
+    }
+    curl_off_t preTransfer = 0, startTransfer = 0;
+    curl_easy_getinfo(curlHandle_, CURLINFO_PRETRANSFER_TIME_T, &preTransfer);
+    if (preTransfer == 0) {
+        // Still connecting, this phase is limited by CURLOPT_CONNECTTIMEOUT_MS
+        stallWindowStart_ = now;
+        return false;
     }
+    curl_easy_getinfo(curlHandle_, CURLINFO_STARTTRANSFER_TIME_T, &startTransfer);
+    bool waitingForResponse = startTransfer == 0 && (ultotal <= 0 || ulnow >= ultotal);
+    if (waitingForResponse && deadlinePolicy_.firstByteTimeout > 0) {
+        Clock::time_point sent = std::max(requestStartTime_ + std::chrono::microseconds(preTransfer), lastUploadActivity_);
+        if (now - sent > std::chrono::milliseconds(deadlinePolicy_.firstByteTimeout)) {
+            timeoutPhase_ = tpFirstByte;
+            return true;
+        }
+    }
+    if (deadlinePolicy_.minSpeed > 0) {
+        curl_off_t bytes = dlnow + ulnow;
+        if (waitingForResponse) {
+            stallWindowStart_ = now;
+            stallWindowBytes_ = bytes;
+            return false;
+        }
+        int64_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - stallWindowStart_).count();
+        if (elapsed >= std::max<int64_t>(deadlinePolicy_.stallWindow, 1)) {
+            if ((bytes - stallWindowBytes_) * 1000 < deadlinePolicy_.minSpeed * elapsed) {
+                timeoutPhase_ = tpStall;
+                return true;
+            }
+            stallWindowStart_ = now;
+            stallWindowBytes_ = bytes;
+        }
+    }
+    return false;
+}
 
-    currentActionType_ = atPost;
-    curlResult_ = curl_easy_perform(curlHandle_);
-    return private_on_finish_request();
+NetworkClient::TimeoutPhase NetworkClient::private_timeout_phase_from_timings() {
+    curl_off_t preTransfer = 0, startTransfer = 0;
+    curl_easy_getinfo(curlHandle_, CURLINFO_PRETRANSFER_TIME_T, &preTransfer);
+    curl_easy_getinfo(curlHandle_, CURLINFO_STARTTRANSFER_TIME_T, &startTransfer);
+    if (preTransfer == 0) {
+        return tpConnect;
+    }
+    return startTransfer == 0 ? tpFirstByte : tpTransfer;
 }
 
-std::string NetworkClient::urlEncode(const std::string& str) {
-    char* encoded = curl_easy_escape(curlHandle_, str.c_str(), str.length());
-    std::string res = encoded;
-    curl_free(encoded);
-    return res;
+NetworkClient::RequestInfo NetworkClient::requestInfo() const {
+    RequestInfo info;
+    if (!method_.empty()) {
+        info.method = method_;
+    } else {
+        info.method = currentActionType_ == atPost || currentActionType_ == atUpload ? "POST" : "GET";
+    }
+    info.url = url_;
+    for (const auto& it : queryHeaders_) {
+        info.headers.emplace_back(it.name, it.value);
+    }
+    if (requestBody_.data) {
+        info.bodyHash = NetworkClientInternal::Fnv1a64(requestBody_.data, requestBody_.size);
+        info.bodySize = static_cast<int64_t>(requestBody_.size);
+    }
+    return info;
 }
 
-std::string NetworkClient::errorString() const {
-    return errorBuffer_;
+NetworkClient& NetworkClient::setResponseSource(ResponseSource* source) {
+    responseSource_ = source;
+    return *this;
+}
+
+CURLcode NetworkClient::private_perform() {
+    if (!responseSource_) {
+        return curl_easy_perform(curlHandle_);
+    }
+    ReplayedResponse response;
+    if (!responseSource_->findResponse(requestInfo(), response)) {
+        snprintf(errorBuffer_, sizeof(errorBuffer_), "No recorded response for %s %s",
+                 requestInfo().method.c_str(), url_.c_str());
+        return CURLE_COULDNT_CONNECT;
+    }
+    replayed_ = true;
+    replayedCode_ = response.code;
+    replayedTimings_ = response.timings;
+
+    // Feed the response through the same callbacks as received data, line by line and in buffer-sized chunks
+    const char* pos = response.headers.data;
+    const char* end = pos + response.headers.size;
+    while (pos < end) {
+        const char* eol = static_cast<const char*>(memchr(pos, '\n', end - pos));
+        size_t length = eol ? eol - pos + 1 : end - pos;
+        if (private_header_writer(const_cast<char*>(pos), 1, length) != length) {
+            return CURLE_WRITE_ERROR;
+        }
+        pos += length;
+    }
+    size_t chunkSize = appliedDownloadBufferSize_ > 0 ? static_cast<size_t>(appliedDownloadBufferSize_) : CURL_MAX_WRITE_SIZE;
+    for (size_t offset = 0; offset < response.body.size; offset += chunkSize) {
+        size_t length = std::min(chunkSize, response.body.size - offset);
+        if (private_writer(const_cast<char*>(response.body.data + offset), 1, length) != length) {
+            return CURLE_WRITE_ERROR;
+        }
+    }
+    return CURLE_OK;
 }
 
-NetworkClient& NetworkClient::setUserAgent(const std::string& userAgentStr) {
-    userAgent_ = userAgentStr;
+NetworkClient& NetworkClient::setResumeDownload(bool resume) {
+    resumeDownload_ = resume;
     return *this;
 }
 
-void NetworkClient::private_init_transfer() {
-    private_cleanup_before();
-    curl_easy_setopt(curlHandle_, CURLOPT_USERAGENT, userAgent_.c_str());
-
-    chunk_ = nullptr;
+void NetworkClient::private_init_resume() {
+    // Ranges refer to the encoded representation, so the response must not be compressed
+    curl_easy_setopt(curlHandle_, CURLOPT_ENCODING, nullptr);
+    resumeOffset_ = 0;
 
-    for (const auto& it: queryHeaders_) {
-        if (it.value == "\n") {
-            chunk_ = curl_slist_append(chunk_, (it.name + ";" + it.value).c_str());
-        } else {
-            chunk_ = curl_slist_append(chunk_, (it.name + ": " + it.value).c_str());
-        }
+    FILE* file = NetworkClientInternal::Fopen(outFileName_.c_str(), "rb");
+    if (!file) {
+        return;
+    }
+    int64_t fileSize = 0;
+    if (NetworkClientInternal::Fseek64(file, 0, SEEK_END) == 0) {
+        fileSize = NetworkClientInternal::Ftell64(file);
+    }
+    fclose(file);
+
+    std::string validator;
+    FILE* validatorFile = NetworkClientInternal::Fopen((outFileName_ + ".resume").c_str(), "rb");
+    if (validatorFile) {
+        char buffer[1024];
+        size_t read = fread(buffer, 1, sizeof(buffer), validatorFile);
+        validator = NetworkClientInternal::TrimString(std::string(buffer, read));
+        fclose(validatorFile);
     }
 
+    if (fileSize <= 0 || validator.empty()) {
+        // Without a validator the partial file can't be trusted
+        return;
+    }
+    resumeOffset_ = fileSize;
+    // CURLOPT_RESUME_FROM_LARGE would fail the transfer if the server responded with the whole body
+    std::string range = std::to_string(resumeOffset_) + "-";
+    curl_easy_setopt(curlHandle_, CURLOPT_RANGE, range.c_str());
+    chunk_ = curl_slist_append(chunk_, ("If-Range: " + validator).c_str());
     curl_easy_setopt(curlHandle_, CURLOPT_HTTPHEADER, chunk_);
 }
 
-std::string NetworkClient::responseHeaderText() const {
-    return headerBuffer_;
-}
+int NetworkClient::private_resume_check() {
+    // Returns -1 to abort the transfer, 0 to keep the file intact, 1 to rewrite it and 2 to append to it
+    long code = responseCode();
+    if (code < 200 || code >= 300) {
+        return 0;
+    }
 
-NetworkClient& NetworkClient::setProgressCallback(curl_progress_callback func, void* data) {
-    progressCallback_ = func;
-    progressData_ = data;
-    return *this;
-}
+    std::string validator = private_last_header_value("ETag");
+    if (validator.empty() || validator.compare(0, 2, "W/") == 0) {
+        // Weak ETags can't be used with If-Range
+        validator = private_last_header_value("Last-Modified");
+    }
+    FILE* validatorFile = NetworkClientInternal::Fopen((outFileName_ + ".resume").c_str(), "wb");
+    if (validatorFile) {
+        fwrite(validator.data(), 1, validator.size(), validatorFile);
+        fclose(validatorFile);
+    }
 
-void NetworkClient::private_parse_headers() {
-    std::vector<std::string> headers;
-    NetworkClientInternal::SplitString(headerBuffer_, "\n", headers);
+    if (code != 206 || resumeOffset_ <= 0) {
+        return 1;
+    }
+    // Content-Range: bytes 1000-6811/6812
+    std::string range = private_last_header_value("Content-Range");
+    size_t pos = range.find_first_of("0123456789");
+    if (pos == std::string::npos || strtoll(range.c_str() + pos, nullptr, 10) != resumeOffset_) {
+        return -1;
+    }
+    return 2;
+}
 
-    for (const auto& it: headers) {
-        std::vector<std::string> thisHeader;
-        NetworkClientInternal::SplitString(it, ":", thisHeader, 2);
+void NetworkClient::private_finish_resume() {
+    long code = responseCode();
+    if (curlResult_ == CURLE_OK && ((code >= 200 && code < 300) || private_resume_complete())) {
+        NetworkClientInternal::Remove((outFileName_ + ".resume").c_str());
+    }
+}
 
-        if (thisHeader.size() == 2) {
-            CustomHeaderItem chi;
-            chi.name = NetworkClientInternal::TrimString(thisHeader[0]);
-            chi.value = NetworkClientInternal::TrimString(thisHeader[1]);
-            responseHeaders_.push_back(chi);
-        }
+bool NetworkClient::private_resume_complete() {
+    // The file was fully downloaded last time: 416 with "Content-Range: bytes */<file size>"
+    if (!resumeDownload_ || outFileName_.empty() || resumeOffset_ <= 0 || responseCode() != 416) {
+        return false;
     }
+    std::string range = private_last_header_value("Content-Range");
+    size_t pos = range.find("*/");
+    return pos != std::string::npos && strtoll(range.c_str() + pos + 2, nullptr, 10) == resumeOffset_;
 }
 
-std::string NetworkClient::responseHeaderByName(const std::string& name) const {
+std::string NetworkClient::private_last_header_value(const std::string& name) const {
+    // Header buffer contains headers of all responses when redirects are followed
+    size_t start = headerBuffer_.rfind("\nHTTP/");
+    start = start == std::string::npos ? 0 : start + 1;
+    std::vector<std::string> lines;
+    NetworkClientInternal::SplitString(headerBuffer_.substr(start), "\n", lines);
     std::string lowerName = NetworkClientInternal::StrToLower(name);
 
-    for (const auto& it: responseHeaders_) {
-        if (NetworkClientInternal::StrToLower(it.name) == lowerName) {
-            return it.value;
+    for (const auto& line : lines) {
+        size_t colon = line.find(':');
+        if (colon != std::string::npos
+            && NetworkClientInternal::StrToLower(NetworkClientInternal::TrimString(line.substr(0, colon))) == lowerName) {
+            return NetworkClientInternal::TrimString(line.substr(colon + 1));
         }
     }
     return std::string();
 }
 
-size_t NetworkClient::responseHeaderCount() const {
-    return responseHeaders_.size();
+NetworkClient& NetworkClient::setDownloadHash(HashType type, const std::string& expectedDigest, bool verifyHeaders) {
+    downloadHashType_ = type;
+    expectedDownloadDigest_ = NetworkClientInternal::StrToLower(expectedDigest);
+    verifyDigestHeaders_ = verifyHeaders && type != htNone;
+    return *this;
 }
 
-std::string NetworkClient::responseHeaderByIndex(int index, std::string& name) const {
-    name = responseHeaders_[index].name;
-    return responseHeaders_[index].value;
+NetworkClient& NetworkClient::setUploadHash(HashType type) {
+    uploadHashType_ = type;
+    return *this;
 }
 
-void NetworkClient::private_cleanup_before() {
-    addQueryHeader("Expect", "");
-    responseHeaders_.clear();
-    internalBuffer_.clear();
-    headerBuffer_.clear();
-    curl_easy_setopt(curlHandle_, CURLOPT_READFUNCTION, nullptr);
-    curl_easy_setopt(curlHandle_, CURLOPT_SEEKFUNCTION, nullptr);
-    curl_easy_setopt(curlHandle_, CURLOPT_READDATA, stdin);
+std::string NetworkClient::downloadHash() const {
+    return downloadHash_;
 }
 
-void NetworkClient::private_cleanup_after() {
-    currentActionType_ = atNone;
-    queryHeaders_.clear();
-    queryParams_.clear();
-    if (outFile_) {
-        fclose(outFile_);
-        outFile_ = nullptr;
-    }
-    outFileName_.clear();
-    method_.clear();
-
-    curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDS, nullptr);
-    curl_easy_setopt(curlHandle_, CURLOPT_MIMEPOST, nullptr);
-    curl_easy_setopt(curlHandle_, CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(-1));
-    curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(-1));
-    curl_easy_setopt(curlHandle_, CURLOPT_HTTPHEADER, nullptr);
-    curl_easy_setopt(curlHandle_, CURLOPT_CUSTOMREQUEST, nullptr);
-    curl_easy_setopt(curlHandle_, CURLOPT_UPLOAD, 0L);
-    curl_easy_setopt(curlHandle_, CURLOPT_NOBODY, 0L);
-    curl_easy_setopt(curlHandle_, CURLOPT_HTTPGET, 1L);
-    curl_easy_setopt(curlHandle_, CURLOPT_READFUNCTION, nullptr);
-    curl_easy_setopt(curlHandle_, CURLOPT_SEEKFUNCTION, nullptr);
-    curl_easy_setopt(curlHandle_, CURLOPT_SEEKDATA, nullptr);
-    curl_easy_setopt(curlHandle_, CURLOPT_READDATA, stdin);
-
-    uploadData_.clear();
-    uploadingFile_ = nullptr;
-    chunkOffset_ = -1;
-    chunkSize_ = -1;
-    uploadDataOffset_ = 0;
-    /*curl_easy_setopt(curl_handle, CURLOPT_READFUNCTION, 0L);
-    curl_easy_setopt(curl_handle, CURLOPT_READDATA, 0L);*/
-    if (chunk_) {
-        curl_slist_free_all(chunk_);
-        chunk_ = nullptr;
-    }
+std::string NetworkClient::uploadHash() const {
+    return uploadHash_;
 }
 
-size_t NetworkClient::read_callback(void* ptr, size_t size, size_t nmemb, void* stream) {
-    auto nm = static_cast<NetworkClient*>(stream);
-    if (!nm) return 0;
-    return nm->private_read_callback(ptr, size, nmemb, stream);
+void NetworkClient::private_init_hashes() {
+    downloadHash_.clear();
+    uploadHash_.clear();
+    downloadHasher_.reset(NetworkClientInternal::CreateContentHasher(downloadHashType_));
+    uploadHasher_.reset(NetworkClientInternal::CreateContentHasher(uploadHashType_));
+    if (verifyDigestHeaders_) {
+        curl_easy_setopt(curlHandle_, CURLOPT_ENCODING, nullptr);
+    }
 }
 
-size_t NetworkClient::private_read_callback(void* ptr, size_t size, size_t nmemb, void*) {
-    size_t retcode;
-    size_t wantsToRead = size * nmemb;
-    if (uploadingFile_) {
-        int64_t pos = NetworkClientInternal::Ftell64(uploadingFile_);
-        if (chunkOffset_ >= 0 && pos >= chunkOffset_ + currentUploadDataSize_) {
-            return 0;
-        }
-        retcode = fread(ptr, size, nmemb, uploadingFile_);
-        if (chunkOffset_ != -1) {
-            retcode = std::min<int64_t>((int64_t)retcode, chunkOffset_ + currentUploadDataSize_ - pos);
+bool NetworkClient::private_hash_file_part(int64_t size) {
+    // Appending to a partially downloaded file, the existing part has to be hashed too
+    FILE* existing = NetworkClientInternal::Fopen(outFileName_.c_str(), "rb");
+    if (!existing) {
+        return false;
+    }
+    std::vector<unsigned char> buffer(65536);
+    while (size > 0) {
+        size_t read = fread(&buffer[0], 1, static_cast<size_t>(std::min<int64_t>(size, buffer.size())), existing);
+        if (read == 0) {
+            break;
         }
-    } else {
-        size_t canRead = std::min<size_t>(uploadData_.size() - uploadDataOffset_, wantsToRead);
-        memcpy(ptr, uploadData_.c_str(), canRead);
-        uploadDataOffset_ += canRead;
-        retcode = canRead;
+        downloadHasher_->update(&buffer[0], read);
+        size -= read;
     }
-    return retcode;
+    fclose(existing);
+    return size == 0;
 }
 
-int NetworkClient::private_seek_callback(void *userp, curl_off_t offset, int origin) {
-    auto* nc = static_cast<NetworkClient*>(userp);
+bool NetworkClient::private_finish_hashes() {
+    if (uploadHasher_) {
+        uploadHash_ = NetworkClientInternal::BytesToHex(uploadHasher_->digest());
+        uploadHasher_.reset();
+    }
+    if (!downloadHasher_) {
+        return true;
+    }
+    // Nothing was received for an already complete file, the hash is computed from the file
+    bool complete = curlResult_ == CURLE_OK && private_resume_complete();
+    if (complete && !private_hash_file_part(resumeOffset_)) {
+        downloadHasher_.reset();
+        return false;
+    }
+    std::string digest = downloadHasher_->digest();
+    downloadHasher_.reset();
+    downloadHash_ = NetworkClientInternal::BytesToHex(digest);
 
-    if (nc->uploadingFile_) {
-        int64_t newOffset = offset;
-        int newOrigin = origin;
-        if (origin == SEEK_SET && nc->chunkOffset_ != -1) {
-            newOffset = nc->chunkOffset_ + offset;
-        } else if (origin == SEEK_END) {
-            // not implemented
-            return CURL_SEEKFUNC_CANTSEEK;
-        }
-        return NetworkClientInternal::Fseek64(nc->uploadingFile_, newOffset, newOrigin);
-    } else {
-        if (origin == SEEK_SET) {
-            if (offset < 0 || offset>= nc->uploadData_.size()) {
-                return CURL_SEEKFUNC_CANTSEEK;
-            }
-            nc->uploadDataOffset_ = offset;
-        } else if (origin == SEEK_CUR) {
-            nc->uploadDataOffset_ += offset;
-        } else {
-            // not implemented
-            return CURL_SEEKFUNC_CANTSEEK;
-        }
-        return CURL_SEEKFUNC_OK;
+    long code = responseCode();
+    if (!complete && (curlResult_ != CURLE_OK || writeToBuffer_ || code < 200 || code >= 300)) {
+        return true;
     }
-}
+    if (!expectedDownloadDigest_.empty() && expectedDownloadDigest_ != downloadHash_) {
+        return false;
+    }
+    if (verifyDigestHeaders_) {
+        std::string base64Digest = NetworkClientInternal::Base64Encode(digest);
+        std::string algorithm = downloadHashType_ == htMd5 ? "md5" : downloadHashType_ == htSha256 ? "sha-256" : "";
 
-bool NetworkClient::doUpload(const std::string& fileName, const std::string& data) {
-    if (!fileName.empty()) {
-        uploadingFile_ = NetworkClientInternal::Fopen(fileName.c_str(), "rb"); 
-        if (!uploadingFile_) {
-            return false; /* can't continue */
-        }
-        if (fseek(uploadingFile_, 0, SEEK_END) == 0) {
-            currentFileSize_ = NetworkClientInternal::Ftell64(uploadingFile_);
-            NetworkClientInternal::Fseek64(uploadingFile_, 0, SEEK_SET);
-        } else {
-            fclose(uploadingFile_);
-            uploadingFile_ = nullptr;
-            //currentFileSize_ = NetworkClientInternal::GetBigFileSize(fileName);
-            return false;
-        }
-        
-        currentUploadDataSize_ = currentFileSize_;
-        if (currentFileSize_ < 0) {
-            fclose(uploadingFile_);
-            uploadingFile_ = nullptr;
+        std::string contentMd5 = private_last_header_value("Content-MD5");
+        if (downloadHashType_ == htMd5 && !contentMd5.empty() && contentMd5 != base64Digest) {
             return false;
         }
-        if (chunkSize_ > 0 && chunkOffset_ >= 0) {
-            currentUploadDataSize_ = chunkSize_;
-            if (NetworkClientInternal::Fseek64(uploadingFile_, chunkOffset_, SEEK_SET)) {
+        // Digest: md5=..., sha-256=...  (RFC 3230) and Content-Digest: sha-256=:...: (RFC 9530)
+        const char* digestHeaders[] = { "Digest", "Content-Digest" };
+        for (const char* headerName : digestHeaders) {
+            std::vector<std::string> items;
+            NetworkClientInternal::SplitString(private_last_header_value(headerName), ",", items);
+            for (const auto& item : items) {
+                size_t eq = item.find('=');
+                if (algorithm.empty() || eq == std::string::npos
+                    || NetworkClientInternal::StrToLower(NetworkClientInternal::TrimString(item.substr(0, eq))) != algorithm) {
+                    continue;
+                }
+                std::string value = NetworkClientInternal::TrimString(item.substr(eq + 1));
+                if (value.size() >= 2 && value.front() == ':' && value.back() == ':') {
+                    value = value.substr(1, value.size() - 2);
+                }
+                if (value != base64Digest) {
+                    return false;
+                }
             }
         }
-        currentActionType_ = atUpload;
-    } else {
-        uploadDataOffset_ = 0;
-        uploadData_ = data;
-        currentFileSize_ = data.length();
-        currentUploadDataSize_ = currentFileSize_;
-        currentActionType_ = atPost;
-    }
-    private_init_transfer();
-    curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDS, nullptr);
-    if (!private_apply_method()) {
-        curl_easy_setopt(curlHandle_, CURLOPT_POST, 1L);
     }
-    curl_easy_setopt(curlHandle_, CURLOPT_READFUNCTION, read_callback);
-    curl_easy_setopt(curlHandle_, CURLOPT_READDATA, this);
-    curl_easy_setopt(curlHandle_, CURLOPT_SEEKFUNCTION, private_seek_callback);
-    curl_easy_setopt(curlHandle_, CURLOPT_SEEKDATA, this);
+    return true;
+}
 
-    curl_easy_setopt(curlHandle_, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(currentUploadDataSize_));
+NetworkClient& NetworkClient::setBufferPool(NetworkBufferPool* pool) {
+    if (bufferPool_ != pool) {
+        private_release_buffer(internalBuffer_);
+        private_release_buffer(headerBuffer_);
+    }
+    bufferPool_ = pool;
+    return *this;
+}
 
-    curl_easy_setopt(curlHandle_, CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(currentUploadDataSize_));
+void NetworkClient::private_reserve_buffer(std::string& buffer, size_t required, size_t initialSize, bool useContentLength) {
+    // Content-Length may be as large as the server wants, do not trust it beyond this limit
+    const curl_off_t maxReservation = 64 * 1024 * 1024;
 
-    curlResult_ = curl_easy_perform(curlHandle_);
-    if (uploadingFile_)
-        fclose(uploadingFile_);
-    bool res = private_on_finish_request();
-    return res;
+    size_t needed = buffer.size() + required;
+    if (needed <= buffer.capacity()) {
+        return;
+    }
+    size_t capacity = std::max(needed, std::max(buffer.capacity() * 2, initialSize));
+    if (buffer.empty() && useContentLength) {
+        curl_off_t contentLength = -1;
+        if (curl_easy_getinfo(curlHandle_, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &contentLength) == CURLE_OK
+            && contentLength > 0) {
+            capacity = std::max(needed, static_cast<size_t>(std::min(contentLength, maxReservation)));
+        }
+    }
+    if (!bufferPool_) {
+        buffer.reserve(capacity);
+        return;
+    }
+    std::string newBuffer = bufferPool_->acquire(capacity);
+    newBuffer.append(buffer);
+    bufferPool_->release(std::move(buffer));
+    buffer.swap(newBuffer);
 }
 
-bool NetworkClient::private_apply_method() {
-    curl_easy_setopt(curlHandle_, CURLOPT_CUSTOMREQUEST,nullptr);
-    curl_easy_setopt(curlHandle_, CURLOPT_UPLOAD, 0L);
-    if (method_ == "POST")
-        curl_easy_setopt(curlHandle_, CURLOPT_POST, 1L);
-    else if (method_ == "GET")
-        curl_easy_setopt(curlHandle_, CURLOPT_HTTPGET, 1L);
-    else if (method_ == "PUT")
-        curl_easy_setopt(curlHandle_, CURLOPT_UPLOAD, 1L);
-    else if (!method_.empty()) {
-        curl_easy_setopt(curlHandle_, CURLOPT_CUSTOMREQUEST, method_.c_str());
+void NetworkClient::private_release_buffer(std::string& buffer) {
+    // Buffers owned by the client keep their capacity only up to this size
+    const size_t maxKeptCapacity = 256 * 1024;
+
+    if (bufferPool_) {
+        bufferPool_->release(std::move(buffer));
+        buffer = std::string();
+    } else if (buffer.capacity() > maxKeptCapacity) {
+        std::string().swap(buffer);
     } else {
-        curl_easy_setopt(curlHandle_, CURLOPT_CUSTOMREQUEST, nullptr);
-        return false;
+        buffer.clear();
     }
-    return true;
 }
 
-NetworkClient& NetworkClient::setReferer(const std::string& str) {
-    curl_easy_setopt(curlHandle_, CURLOPT_REFERER, str.c_str());
+NetworkClient& NetworkClient::setDownloadBufferSize(int size) {
+    downloadBufferSize_ = std::max(std::min(size, NetworkClientInternal::MaxDownloadBufferSize), NetworkClientInternal::MinDownloadBufferSize);
     return *this;
 }
 
-int NetworkClient::getCurlResult() const {
-    return curlResult_;
-}
-
-CURL* NetworkClient::getCurlHandle() {
-    return curlHandle_;
-}
-
-NetworkClient& NetworkClient::setOutputFile(const std::string& str) {
-    outFileName_ = str;
+NetworkClient& NetworkClient::setAdaptiveBufferSize(bool adaptive) {
+    adaptiveBufferSize_ = adaptive;
     return *this;
 }
 
 NetworkClient& NetworkClient::setUploadBufferSize(int size) {
-    uploadBufferSize_ = size;
+    uploadBufferSize_ = std::max(std::min(size, NetworkClientInternal::MaxUploadBufferSize), NetworkClientInternal::MinUploadBufferSize);
     return *this;
 }
 
@@ -778,7 +3222,44 @@ NetworkClient& NetworkClient::setChunkSize(int64_t size) {
     return *this;
 }
 
+NetworkClient& NetworkClient::setRequestCompression(CompressionType type, int level) {
+    if (type != compressionType_ || level != compressionLevel_) {
+        compressor_.reset();
+    }
+    compressionType_ = type;
+    compressionLevel_ = level;
+    return *this;
+}
+
+bool NetworkClient::isCompressionSupported(CompressionType type) {
+    std::unique_ptr<NetworkClientInternal::BodyCompressor> compressor(NetworkClientInternal::CreateBodyCompressor(type, -1));
+    return compressor != nullptr;
+}
+
+bool NetworkClient::globalInit(const GlobalOptions& options) {
+    bool created;
+    NetworkClientInternal::CurlInitializer& initializer = NetworkClientInternal::GlobalCurlInitializer(options, created);
+    return created && initializer.result == CURLE_OK;
+}
+
+NetworkClient::AllocationStats NetworkClient::threadAllocationStats() {
+    const NetworkClientInternal::ThreadAllocationCounters& counters = NetworkClientInternal::threadAllocationCounters;
+    AllocationStats stats;
+    stats.allocations = counters.allocations;
+    stats.frees = counters.frees;
+    stats.bytesAllocated = counters.bytesAllocated;
+    stats.bytesFreed = counters.bytesFreed;
+    return stats;
+}
+
+NetworkClient::AllocationStats NetworkClient::requestAllocationStats() const {
+    return requestAllocations_;
+}
+
 std::string NetworkClient::getCurlResultString() const {
+    if (rejected_) {
+        return "Request rejected";
+    }
     return curl_easy_strerror(curlResult_);
 }
 
@@ -789,5 +3270,19 @@ NetworkClient& NetworkClient::setCurlOption(int option, const std::string& value
 
 NetworkClient& NetworkClient::setCurlOptionInt(int option, long value) {
     curl_easy_setopt(curlHandle_, static_cast<CURLoption>(option), value);
+    switch (option) {
+    case CURLOPT_TIMEOUT:
+        userTimeoutMs_ = value * 1000;
+        break;
+    case CURLOPT_TIMEOUT_MS:
+        userTimeoutMs_ = value;
+        break;
+    case CURLOPT_CONNECTTIMEOUT:
+        userConnectTimeoutMs_ = value * 1000;
+        break;
+    case CURLOPT_CONNECTTIMEOUT_MS:
+        userConnectTimeoutMs_ = value;
+        break;
+    }
     return *this;
 }
@@ -21,12 +21,81 @@
 #ifndef CURL_CPP_WRAPPER_NETWORK_CLIENT_H
 #define CURL_CPP_WRAPPER_NETWORK_CLIENT_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include <curl/curl.h>
 
+namespace NetworkClientInternal {
+class BodyCompressor;
+class ContentHasher;
+class MappedFile;
+
+/**
+ * Returns lowercase "host:port" of the url without user info (port is omitted when it is not in the url).
+ */
+std::string UrlAuthority(const std::string& url);
+
+uint64_t Fnv1a64(const char* data, size_t size, uint64_t hash = 14695981039346656037ULL);
+
+/**
+ * Opens a file with UTF-8 encoded name.
+ */
+FILE* Fopen(const char* filename, const char* mode);
+
+#ifdef _WIN32
+std::wstring Utf8ToWide(const std::string& str);
+#endif
+}
+
+/**
+ * Thread-safe pool of response buffers shared between clients.
+ * Released buffers are kept in free lists by capacity class (powers of two from 1 KB to 64 MB),
+ * up to maxRetainedBytes of capacity in total.
+ */
+class NetworkBufferPool
+{
+public:
+    explicit NetworkBufferPool(size_t maxRetainedBytes = 64 * 1024 * 1024);
+    NetworkBufferPool(NetworkBufferPool const&) = delete;
+    void operator=(NetworkBufferPool const& x) = delete;
+
+    /**
+     * Returns an empty buffer with at least the given capacity.
+     */
+    std::string acquire(size_t capacity);
+
+    /**
+     * Gives the buffer back to the pool (for example, a body taken with NetworkClient::takeResponseBody()).
+     */
+    void release(std::string&& buffer);
+
+    /**
+     * Frees all retained buffers.
+     */
+    void trim();
+    size_t retainedBytes() const;
+
+private:
+    enum { MinClassShift = 10, ClassCount = 17 };
+
+    mutable std::mutex mutex_;
+    std::vector<std::string> freeLists_[ClassCount];
+    size_t maxRetainedBytes_;
+    size_t retainedBytes_;
+};
+
 class NetworkClient
 {
 public:
@@ -38,6 +107,325 @@ public:
         atGet
     };
 
+    enum CompressionType
+    {
+        ctNone = 0,
+        ctGzip,
+        ctZstd
+    };
+
+    enum HashType
+    {
+        htNone = 0,
+        htMd5,
+        htSha256,
+        htCrc32c,
+        htXxHash64
+    };
+
+    enum AllocatorMode
+    {
+        /**
+         * libcurl uses malloc() and friends, allocations are not counted.
+         */
+        amDefault = 0,
+        /**
+         * malloc() with per-thread allocation counters.
+         */
+        amCounting,
+        /**
+         * Size-class allocator with a cache of free blocks per thread, counted like amCounting.
+         * Small blocks freed by libcurl are reused by the same thread without locking.
+         */
+        amPool
+    };
+
+    /**
+     * Settings of the libcurl global initialization (see globalInit()).
+     */
+    struct GlobalOptions
+    {
+        /**
+         * Flags of curl_global_init(), CURL_GLOBAL_ALL by default.
+         */
+        long flags;
+        AllocatorMode allocator;
+
+        GlobalOptions(): flags(CURL_GLOBAL_ALL), allocator(amDefault) {
+        }
+    };
+
+    /**
+     * Allocations made by libcurl through the allocator installed by globalInit().
+     */
+    struct AllocationStats
+    {
+        uint64_t allocations;
+        uint64_t frees;
+        uint64_t bytesAllocated;
+        uint64_t bytesFreed;
+
+        AllocationStats(): allocations(0), frees(0), bytesAllocated(0), bytesFreed(0) {
+        }
+    };
+
+    /**
+     * Durations of the request phases in microseconds, measured from the start of the request
+     * (see CURLINFO_NAMELOOKUP_TIME_T and others), and buffer sizes used by the transfer.
+     */
+    struct Timings
+    {
+        int64_t nameLookup;
+        int64_t connect;
+        int64_t appConnect;
+        int64_t preTransfer;
+        int64_t startTransfer;
+        int64_t total;
+        int64_t redirect;
+        int downloadBufferSize; // bytes, CURLOPT_BUFFERSIZE
+        int uploadBufferSize;   // bytes, CURLOPT_UPLOAD_BUFFERSIZE
+
+        Timings(): nameLookup(0), connect(0), appConnect(0), preTransfer(0), startTransfer(0), total(0), redirect(0),
+            downloadBufferSize(0), uploadBufferSize(0) {
+        }
+    };
+
+    /**
+     * Socket options applied to new connections. Fields set to -1 (or an empty string)
+     * leave the system default. Options the platform doesn't support are skipped.
+     */
+    struct SocketProfile
+    {
+        int noDelay;            // TCP_NODELAY, 0 or 1
+        int sendBuffer;         // SO_SNDBUF, bytes
+        int recvBuffer;         // SO_RCVBUF, bytes
+        int keepAliveIdle;      // TCP_KEEPIDLE, seconds (enables SO_KEEPALIVE)
+        int keepAliveInterval;  // TCP_KEEPINTVL, seconds (enables SO_KEEPALIVE)
+        int fastOpen;           // TCP_FASTOPEN_CONNECT, 0 or 1
+        int notSentLowat;       // TCP_NOTSENT_LOWAT, bytes
+        int busyPoll;           // SO_BUSY_POLL, microseconds
+        int tos;                // IP_TOS (IPV6_TCLASS for IPv6 sockets)
+        std::string congestionControl; // TCP_CONGESTION, for example "cubic" or "bbr"
+
+        SocketProfile(): noDelay(-1), sendBuffer(-1), recvBuffer(-1), keepAliveIdle(-1), keepAliveInterval(-1),
+            fastOpen(-1), notSentLowat(-1), busyPoll(-1), tos(-1) {
+        }
+    };
+
+    /**
+     * What to do when the response body doesn't fit into the buffer set by setResponseBuffer().
+     */
+    enum OverflowMode
+    {
+        omError = 0, // abort the transfer with CURLE_WRITE_ERROR
+        omTruncate,  // keep the beginning of the body, see responseTruncated()
+        omHeap       // continue in the heap buffer of the client
+    };
+
+    /**
+     * getCurlResult() of requests rejected by RequestObserver::admitRequest() (e.g. by an open circuit).
+     * The value is outside of the CURLcode range.
+     */
+    enum { RequestRejected = 1000 };
+
+    /**
+     * Phase in which a request ran out of time (see timeoutPhase()).
+     */
+    enum TimeoutPhase
+    {
+        tpNone = 0,
+        tpConnect,   // name lookup, TCP and TLS handshakes
+        tpFirstByte, // waiting for the response after the request has been sent
+        tpTransfer,  // receiving the response
+        tpStall      // the transfer was slower than DeadlinePolicy::minSpeed
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * Splits the time budget of a request between its phases. Durations are in milliseconds, 0 means no limit.
+     */
+    struct DeadlinePolicy
+    {
+        int64_t connectTimeout;
+        /**
+         * Share of the remaining budget the connect phase may use.
+         */
+        double connectShare;
+        /**
+         * Maximum time between sending the request (including its body) and the first byte of the response.
+         */
+        int64_t firstByteTimeout;
+        /**
+         * The transfer is aborted if less than minSpeed bytes per second (sent and received)
+         * have been transferred over the last stallWindow milliseconds.
+         */
+        int64_t minSpeed;
+        int64_t stallWindow;
+
+        DeadlinePolicy(): connectTimeout(0), connectShare(0.5), firstByteTimeout(0), minSpeed(0), stallWindow(2000) {
+        }
+    };
+
+    /**
+     * Non-owning view of the response body.
+     */
+    struct BodyView
+    {
+        const char* data;
+        size_t size;
+
+        BodyView(): data(nullptr), size(0) {
+        }
+    };
+
+    /**
+     * Receives the response body in chunks as it arrives. Returning false aborts the transfer.
+     */
+    typedef std::function<bool(const char* data, size_t size)> BodyCallback;
+
+    /**
+     * Receives notifications about requests performed by the client.
+     */
+    class RequestObserver
+    {
+    public:
+        virtual ~RequestObserver() = default;
+
+        /**
+         * Called before request headers are applied, so addQueryHeader() still has an effect.
+         */
+        virtual void onRequestStart(NetworkClient& /*client*/) {}
+
+        /**
+         * Called right before the transfer starts. Returning false fails the request with
+         * RequestRejected without sending it, reason becomes the error string.
+         */
+        virtual bool admitRequest(NetworkClient& /*client*/, std::string& /*reason*/) { return true; }
+
+        /**
+         * Called when the request has finished, before the request settings are reset.
+         */
+        virtual void onRequestFinish(NetworkClient& /*client*/) {}
+    };
+
+    /**
+     * Describes the request being performed (see requestInfo()).
+     */
+    struct RequestInfo
+    {
+        std::string method;
+        std::string url;
+        std::vector<std::pair<std::string, std::string>> headers;
+        /**
+         * FNV-1a hash and size of the request body if it is held in memory (doPost(), doUpload() with data).
+         * For file uploads and multipart forms bodyHash is 0 and bodySize is -1.
+         */
+        uint64_t bodyHash;
+        int64_t bodySize;
+
+        RequestInfo(): bodyHash(0), bodySize(-1) {
+        }
+    };
+
+    /**
+     * A response served by a ResponseSource instead of the network.
+     */
+    struct ReplayedResponse
+    {
+        int code;
+        /**
+         * Raw header block, the same as responseHeaderText() returns.
+         */
+        BodyView headers;
+        BodyView body;
+        Timings timings;
+
+        ReplayedResponse(): code(0) {
+        }
+    };
+
+    /**
+     * Serves responses for requests made with the do* methods (see setResponseSource()).
+     */
+    class ResponseSource
+    {
+    public:
+        virtual ~ResponseSource() = default;
+
+        /**
+         * Returns false if there is no response for the request.
+         * The data of the response must stay valid until the request has finished.
+         */
+        virtual bool findResponse(const RequestInfo& request, ReplayedResponse& response) = 0;
+    };
+
+    /**
+     * Bounded queue of buffers between a producer and an upload of unknown length (see doUploadStream()).
+     * The producer calls write() from any thread and is blocked while the queue is full; the transfer
+     * is paused with CURL_READFUNC_PAUSE while the queue is empty.
+     */
+    class UploadStream
+    {
+    public:
+        explicit UploadStream(size_t maxQueuedBytes = 1024 * 1024);
+        UploadStream(UploadStream const&) = delete;
+        void operator=(UploadStream const& x) = delete;
+
+        /**
+         * Returns false if the stream has been aborted or the transfer is over.
+         * A buffer larger than maxQueuedBytes is accepted when the queue is empty.
+         */
+        bool write(const char* data, size_t size);
+        bool write(std::string&& buffer);
+
+        /**
+         * Marks the end of the body.
+         */
+        void finish();
+
+        /**
+         * Fails the upload with CURLE_ABORTED_BY_CALLBACK.
+         */
+        void abort();
+
+        /**
+         * Called by write(), finish() and abort() when a paused transfer can continue, on the producer
+         * thread and with the stream locked. Needed only for transfers driven by your own multi handle:
+         * wake the loop (e.g. with curl_multi_wakeup()) and call NetworkClient::resumeUpload() there.
+         */
+        void setWakeupCallback(std::function<void()> callback);
+
+        int64_t bytesRead() const;
+
+        /**
+         * Number of times the transfer waited for the producer.
+         */
+        uint64_t pauseCount() const;
+
+    private:
+        friend class NetworkClient;
+
+        size_t read(char* buffer, size_t size);
+        bool resume();
+        void close();
+        void wakeup();
+
+        mutable std::mutex mutex_;
+        std::condition_variable spaceAvailable_;
+        std::deque<std::string> queue_;
+        size_t frontOffset_;
+        size_t queuedBytes_;
+        size_t maxQueuedBytes_;
+        bool finished_;
+        bool aborted_;
+        bool closed_;
+        bool paused_;
+        int64_t bytesRead_;
+        uint64_t pauseCount_;
+        std::function<void()> wakeupCallback_;
+    };
+
     NetworkClient();
     ~NetworkClient();
     NetworkClient(NetworkClient const&) = delete;
@@ -92,8 +480,95 @@ public:
      * Sending a file or data directly in the body of a POST request
      */
     bool doUpload(const std::string& fileName, const std::string& data);
+
+    /**
+     * Sends the data written to stream (usually by another thread) as the request body with chunked
+     * transfer encoding, generation overlaps with sending. Uses the method set by setMethod(), POST by default.
+     * The stream must be finished by the producer for the request to complete.
+     */
+    bool doUploadStream(UploadStream& stream);
     bool doGet(const std::string& url = "");
+
+    /**
+     * Asynchronous interface for driving the client from a curl multi handle (see NetworkExecutor).
+     * These functions set up the request like their do* counterparts without performing it.
+     * On success add getCurlHandle() to a multi handle and call finishRequest() with the transfer
+     * result when it completes. If they return false, the request has already failed and
+     * finishRequest() must not be called.
+     * The data passed to startPost() must stay valid until finishRequest().
+     */
+    bool startGet(const std::string& url = "");
+    bool startPost(const std::string& data = "");
+    bool startUpload(const std::string& fileName, const std::string& data);
+    bool startUploadMultipartData();
+    bool startUploadStream(UploadStream& stream);
+
+    /**
+     * Continues an upload started by startUploadStream() which has been paused because the stream
+     * was empty. Must be called on the thread driving the transfer.
+     */
+    void resumeUpload();
+
+    /**
+     * Completes a request set up by one of the start* functions and returns what the do* function would.
+     */
+    bool finishRequest(CURLcode result);
+
+    /**
+     * Returns the response body. A body spilled to a file (see setSpillThreshold()) is read from the file.
+     */
     std::string responseBody() const;
+
+    /**
+     * Moves the response body out of the client without copying it.
+     * Subsequent calls of responseBody() return an empty string.
+     */
+    std::string takeResponseBody();
+
+    /**
+     * Returns the response body without copying it, wherever it is stored: the in-memory buffer
+     * or the spill file mapped into memory. The view is valid until the next request.
+     */
+    BodyView responseBodyView();
+
+    /**
+     * Returns the name of the temporary file holding the response body,
+     * or an empty string if the body is in memory.
+     */
+    std::string responseBodyFile() const;
+
+    /**
+     * Hands the spill file over to the caller, who becomes responsible for deleting it.
+     * Otherwise the file is deleted when the next request starts or the client is destroyed.
+     */
+    std::string takeResponseBodyFile();
+
+    /**
+     * Makes the client write response bodies directly into the caller's buffer, so small responses
+     * don't allocate memory. The buffer is used by all following requests until
+     * setResponseBuffer(nullptr, 0) is called and must stay valid until then.
+     * Use responseBodyView() to get the body. Bodies of responses written to an output file
+     * or passed to a body callback are not affected.
+     */
+    NetworkClient& setResponseBuffer(char* buffer, size_t capacity, OverflowMode overflow = omError);
+
+    /**
+     * Returns true if the last response body didn't fit into the buffer and was truncated (omTruncate mode).
+     */
+    bool responseTruncated() const;
+
+    /**
+     * Keeps response bodies in memory up to the threshold (in bytes) and moves larger ones to a
+     * temporary file in the directory (the system temporary directory if empty). 0 disables spilling.
+     * Applies to bodies which are not written to an output file or passed to a body callback.
+     */
+    NetworkClient& setSpillThreshold(size_t threshold, const std::string& directory = "");
+
+    /**
+     * Aborts transfers with a body larger than maxSize bytes with CURLE_FILESIZE_EXCEEDED
+     * (as soon as Content-Length is known, if the server sends it). -1 means no limit.
+     */
+    NetworkClient& setMaxResponseSize(int64_t maxSize);
     int responseCode() const;
     std::string errorString() const;
     NetworkClient& setUserAgent(const std::string& userAgentStr);
@@ -111,10 +586,194 @@ public:
     NetworkClient& setProxyUserPassword(const std::string& username, const std::string& password);
     NetworkClient& setReferer(const std::string& str);
     NetworkClient& setOutputFile(const std::string& str);
+
+    /**
+     * Passes the body of a successful (2xx) response of the next request to the callback
+     * instead of storing it in memory or in the output file.
+     * Bodies of other responses are available from responseBody().
+     */
+    NetworkClient& setBodyCallback(BodyCallback callback);
+
+    /**
+     * Observers are not owned by the client and must outlive it or be removed.
+     */
+    NetworkClient& addRequestObserver(RequestObserver* observer);
+    NetworkClient& removeRequestObserver(RequestObserver* observer);
+
+    /**
+     * Returns the URL of the current or last request.
+     */
+    std::string url() const;
+
+    /**
+     * Returns the method, url, headers and body hash of the current request.
+     * Valid between the start of the request and the end of RequestObserver::onRequestFinish().
+     */
+    RequestInfo requestInfo() const;
+
+    /**
+     * Makes the do* methods take responses from the source instead of performing the transfer.
+     * Headers and body still go through the usual processing (output file, callbacks, hashes).
+     * Requests the source has no response for fail with CURLE_COULDNT_CONNECT.
+     * Requests driven by startGet() and others on a multi handle are not affected.
+     * Pass nullptr to go back to the network.
+     */
+    NetworkClient& setResponseSource(ResponseSource* source);
+
+    /**
+     * Makes the next doGet() resume the download into the output file set by setOutputFile().
+     * If the file already exists, only the missing part is requested with a Range header,
+     * validated by If-Range against the ETag or Last-Modified value saved next to the file
+     * (in "<file>.resume") when the download started. If the server ignores the range or the
+     * resource has changed, the file is downloaded from the beginning. If the file is already complete,
+     * the server responds with 416 and a Content-Range whose complete length equals the file size,
+     * which counts as success: the file is kept and "<file>.resume" is removed.
+     * Bodies of non-2xx responses are not written to the file and are available from responseBody().
+     */
+    NetworkClient& setResumeDownload(bool resume);
+    /**
+     * Sets the size of the upload buffer (CURLOPT_UPLOAD_BUFFERSIZE, 16 KB - 2 MB), which is also
+     * the largest chunk the body is read in. The default is 64 KB.
+     */
     NetworkClient& setUploadBufferSize(int size);
+
+    /**
+     * Sets the size of the receive buffer (CURLOPT_BUFFERSIZE, 1 KB - CURL_MAX_READ_SIZE). The default is 32 KB.
+     */
+    NetworkClient& setDownloadBufferSize(int size);
+
+    /**
+     * Chooses buffer sizes for each transfer instead of the fixed ones: large enough for the
+     * bandwidth-delay product measured on previous transfers of the client and for the expected
+     * body size (the upload size, or the size of the previous response for downloads), but not
+     * larger than the body itself. Chosen sizes are reported by responseTimings().
+     */
+    NetworkClient& setAdaptiveBufferSize(bool adaptive);
+
+    /**
+     * Sets the time point by which requests must finish (Clock::time_point::max() removes it).
+     * The deadline is kept for subsequent requests, so retries share the remaining budget.
+     * A request that runs out of time fails with CURLE_OPERATION_TIMEDOUT.
+     */
+    NetworkClient& setDeadline(Clock::time_point deadline);
+
+    /**
+     * Limits the duration of every request in milliseconds (0 means no limit).
+     * Combined with setDeadline(), whichever comes first applies. CURLOPT_TIMEOUT and
+     * CURLOPT_CONNECTTIMEOUT set with setCurlOptionInt() stay in effect as upper limits.
+     */
+    NetworkClient& setTimeout(int64_t milliseconds);
+    NetworkClient& setDeadlinePolicy(const DeadlinePolicy& policy);
+
+    /**
+     * Returns the time left until the deadline in milliseconds (0 if it has passed), or -1 if no deadline is set.
+     */
+    int64_t remainingBudget() const;
+
+    /**
+     * Returns the phase in which the last request ran out of time.
+     */
+    TimeoutPhase timeoutPhase() const;
+
+    /**
+     * Aborts the request in progress with CURLE_ABORTED_BY_CALLBACK. Can be called from any thread.
+     */
+    void cancel();
+
+    /**
+     * Sets socket options for connections opened by the client. A profile set for a host
+     * ("host" or "host:port") replaces the client profile for connections to that host.
+     * Pass a default constructed SocketProfile to remove a profile. Existing connections are not affected.
+     */
+    NetworkClient& setSocketProfile(const SocketProfile& profile);
+    NetworkClient& setHostSocketProfile(const std::string& host, const SocketProfile& profile);
+
+    /**
+     * Returns option values read back from the last socket opened by the client, for options
+     * set by the profile. Failed or unsupported options are -1. Note that Linux reports
+     * doubled SO_SNDBUF/SO_RCVBUF values.
+     */
+    SocketProfile appliedSocketProfile() const;
+
+    /**
+     * Sends requests through a Unix domain socket instead of TCP, the URL still determines the Host header
+     * and the request path. If abstract is true, path is a name in the Linux abstract namespace.
+     * Pass an empty path to connect over TCP again. Connections are reused as usual.
+     */
+    NetworkClient& setUnixSocket(const std::string& path, bool abstract = false);
+
+    /**
+     * Routes requests to the host ("host" or "host:port") through a Unix domain socket.
+     * The route takes precedence over setUnixSocket(). Pass an empty path to remove the route.
+     * Redirects are followed over the socket chosen for the initial URL.
+     */
+    NetworkClient& setHostUnixSocket(const std::string& host, const std::string& path, bool abstract = false);
+
+    /**
+     * Makes the client take response body and header buffers from the pool and return them
+     * to it when the next request starts. Pass nullptr to use buffers owned by the client.
+     * The pool must outlive the client.
+     */
+    NetworkClient& setBufferPool(NetworkBufferPool* pool);
     NetworkClient& setChunkOffset(int64_t offset);
     NetworkClient& setChunkSize(int64_t size);
+
+    /**
+     * Enables compression of request bodies sent by doPost() and doUpload().
+     * The body is compressed on the fly in the read callback, sent with chunked transfer encoding
+     * and a matching Content-Encoding header. The setting persists between requests.
+     *
+     * @param level is the compression level, -1 means the default level of the codec.
+     *
+     * Gzip requires building with CURL_CPP_WRAPPER_WITH_ZLIB, zstd with CURL_CPP_WRAPPER_WITH_ZSTD.
+     * If the codec is not compiled in, requests fail with CURLE_NOT_BUILT_IN.
+     */
+    NetworkClient& setRequestCompression(CompressionType type, int level = -1);
+    static bool isCompressionSupported(CompressionType type);
+
+    /**
+     * Initializes libcurl with curl_global_init_mem(). Must be called before libcurl is used in any way,
+     * otherwise the first NetworkClient initializes it with GlobalOptions() and later calls have no effect.
+     * @return false if libcurl has already been initialized by this library or the initialization failed
+     */
+    static bool globalInit(const GlobalOptions& options = GlobalOptions());
+
+    /**
+     * Counters of the calling thread since it started, zero with amDefault.
+     */
+    static AllocationStats threadAllocationStats();
+
+    /**
+     * Allocations made by libcurl on the thread of the last request between its start and finishRequest().
+     * For requests driven by a multi handle this includes other transfers of the loop thread.
+     */
+    AllocationStats requestAllocationStats() const;
+
+    /**
+     * Computes the hash of the response body of the next request while it is being received.
+     *
+     * @param expectedDigest is the expected digest in hex. If it is not empty and doesn't match,
+     * the request fails with CURLE_WRITE_ERROR.
+     *
+     * @param verifyHeaders - compare the digest with Content-MD5, Digest or Content-Digest response headers
+     * carrying a digest of the same type (MD5 or SHA-256). Responses are not compressed in this mode,
+     * because these headers describe the encoded body.
+     */
+    NetworkClient& setDownloadHash(HashType type, const std::string& expectedDigest = "", bool verifyHeaders = false);
+
+    /**
+     * Computes the hash of the request body sent by the next doPost(), doUpload() or doUploadStream().
+     * The hash covers the uncompressed body. Multipart uploads are not supported.
+     */
+    NetworkClient& setUploadHash(HashType type);
+
+    /**
+     * Returns digests (in hex) computed during the last request.
+     */
+    std::string downloadHash() const;
+    std::string uploadHash() const;
     int getCurlResult() const;
+    Timings responseTimings() const;
     CURL* getCurlHandle();
 private:
     enum CallBackFuncType { funcTypeBody, funcTypeHeader };
@@ -135,6 +794,15 @@ private:
         }
     };
 
+    struct UnixSocketRoute
+    {
+        std::string path;
+        bool abstract;
+
+        UnixSocketRoute(): abstract(false) {
+        }
+    };
+
     struct QueryParam
     {
         bool isFile;
@@ -150,14 +818,40 @@ private:
     size_t private_writer(char* data, size_t size, size_t nmemb);
     size_t private_header_writer(char* data, size_t size, size_t nmemb);
     size_t private_read_callback(void* ptr, size_t size, size_t nmemb, void* stream);
+    size_t private_read_raw(char* ptr, size_t size, size_t nmemb);
+    size_t private_read_compressed(char* ptr, size_t size);
+    bool private_rewind_upload();
+    bool private_init_compression();
+    void private_init_resume();
+    int private_resume_check();
+    void private_finish_resume();
+    bool private_resume_complete();
+    std::string private_last_header_value(const std::string& name) const;
+    void private_init_hashes();
+    bool private_finish_hashes();
+    bool private_hash_file_part(int64_t size);
+    void private_reserve_buffer(std::string& buffer, size_t required, size_t initialSize, bool useContentLength);
+    void private_release_buffer(std::string& buffer);
     static int private_seek_callback(void *userp, curl_off_t offset, int origin);
     static int set_sockopts(void* clientp, curl_socket_t sockfd, curlsocktype purpose);
+    const SocketProfile* private_socket_profile();
+    void private_apply_unix_socket();
     bool private_apply_method();
     void private_parse_headers();
     void private_cleanup_before();
     void private_cleanup_after();
     bool private_on_finish_request();
     void private_init_transfer();
+    bool private_before_perform();
+    CURLcode private_perform();
+    void private_apply_deadline();
+    bool private_check_deadline(curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+    TimeoutPhase private_timeout_phase_from_timings();
+    bool private_write_body(const char* data, size_t size);
+    bool private_write_response_buffer(const char* data, size_t size);
+    bool private_spill_body();
+    void private_remove_spill_file();
+    void private_update_transfer_estimates();
 
     int uploadBufferSize_;
     CURL* curlHandle_;
@@ -167,6 +861,8 @@ private:
     std::string uploadData_;
     ActionType currentActionType_;
     size_t uploadDataOffset_;
+    UploadStream* uploadStream_;
+    CURLM* uploadMulti_;
     CallBackData bodyFuncData_;
     curl_progress_callback progressCallback_;
     CallBackData headerFuncData_;
@@ -187,6 +883,78 @@ private:
     int64_t chunkOffset_;
     int64_t chunkSize_;
     bool curlWinUnicode_;
+    CompressionType compressionType_;
+    int compressionLevel_;
+    std::unique_ptr<NetworkClientInternal::BodyCompressor> compressor_;
+    std::string compressInput_;
+    size_t compressInputOffset_;
+    bool compressInputEof_;
+    bool compressFinished_;
+    bool resumeDownload_;
+    int64_t resumeOffset_;
+    bool writeToBuffer_;
+    HashType downloadHashType_;
+    HashType uploadHashType_;
+    std::string expectedDownloadDigest_;
+    bool verifyDigestHeaders_;
+    std::unique_ptr<NetworkClientInternal::ContentHasher> downloadHasher_;
+    std::unique_ptr<NetworkClientInternal::ContentHasher> uploadHasher_;
+    std::string downloadHash_;
+    std::string uploadHash_;
+    NetworkBufferPool* bufferPool_;
+    BodyCallback bodyCallback_;
+    std::vector<RequestObserver*> observers_;
+    std::unique_ptr<SocketProfile> socketProfile_;
+    std::map<std::string, SocketProfile> hostSocketProfiles_;
+    SocketProfile appliedSocketProfile_;
+    UnixSocketRoute unixSocket_;
+    std::map<std::string, UnixSocketRoute> hostUnixSockets_;
+    int downloadBufferSize_;
+    bool adaptiveBufferSize_;
+    int appliedDownloadBufferSize_;
+    int appliedUploadBufferSize_;
+    double throughputEstimate_;
+    int64_t rttEstimate_;
+    int64_t lastDownloadSize_;
+    struct curl_httppost* formPost_;
+    std::string postFields_;
+    size_t spillThreshold_;
+    std::string spillDirectory_;
+    FILE* spillFile_;
+    std::string spillFileName_;
+    std::unique_ptr<NetworkClientInternal::MappedFile> mappedBody_;
+    int64_t maxResponseSize_;
+    int64_t bodySize_;
+    bool bodyTooLarge_;
+    char* responseBuffer_;
+    size_t responseBufferCapacity_;
+    size_t responseBufferSize_;
+    OverflowMode responseBufferOverflow_;
+    bool responseBufferOverflowed_;
+    bool responseTruncated_;
+    ResponseSource* responseSource_;
+    bool replayed_;
+    int replayedCode_;
+    Timings replayedTimings_;
+    BodyView requestBody_;
+    Clock::time_point deadline_;
+    int64_t timeout_;
+    DeadlinePolicy deadlinePolicy_;
+    bool deadlineChecks_;
+    // Timeouts set through setCurlOptionInt(), restored when no deadline applies
+    long userTimeoutMs_;
+    long userConnectTimeoutMs_;
+    bool deadlineTimeoutsApplied_;
+    Clock::time_point requestStartTime_;
+    Clock::time_point lastUploadActivity_;
+    curl_off_t lastUploadBytes_;
+    Clock::time_point stallWindowStart_;
+    curl_off_t stallWindowBytes_;
+    TimeoutPhase timeoutPhase_;
+    std::atomic<bool> cancelled_;
+    bool rejected_;
+    AllocationStats allocationsAtStart_;
+    AllocationStats requestAllocations_;
 };
 
 #endif
@@ -0,0 +1,465 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "NetworkExecutor.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+/**
+ * Bounded multi-producer multi-consumer queue (D. Vyukov's algorithm).
+ */
+template<typename T> class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity): cells_(RoundUpCapacity(capacity)), mask_(cells_.size() - 1),
+        enqueuePos_(0), dequeuePos_(0)
+    {
+        for (size_t i = 0; i < cells_.size(); i++) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool push(const T& value) {
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & mask_];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(T& value) {
+        size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & mask_];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool empty() const {
+        return dequeuePos_.load(std::memory_order_acquire) >= enqueuePos_.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t RoundUpCapacity(size_t capacity) {
+        size_t result = 2;
+        while (result < capacity) {
+            result *= 2;
+        }
+        return result;
+    }
+
+    std::vector<Cell> cells_;
+    size_t mask_;
+    // Keep producer and consumer positions on different cache lines
+    char padding1_[64];
+    std::atomic<size_t> enqueuePos_;
+    char padding2_[64];
+    std::atomic<size_t> dequeuePos_;
+};
+
+#ifdef __linux__
+std::vector<int> ParseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        std::string range = list.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        int first = 0, last = 0;
+        int count = sscanf(range.c_str(), "%d-%d", &first, &last);
+        if (count >= 1) {
+            if (count == 1) {
+                last = first;
+            }
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+        }
+        if (end == std::string::npos) {
+            break;
+        }
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+/**
+ * Returns CPUs available to the process, interleaved between NUMA nodes,
+ * so consecutive loops are spread over the nodes.
+ */
+std::vector<int> CpuOrder() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return std::vector<int>();
+    }
+    std::vector<std::vector<int>> nodes;
+    for (int node = 0; node < 1024; node++) {
+        std::string fileName = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+        FILE* f = fopen(fileName.c_str(), "r");
+        if (!f) {
+            break;
+        }
+        char buffer[4096] = {};
+        size_t length = fread(buffer, 1, sizeof(buffer) - 1, f);
+        fclose(f);
+        std::vector<int> nodeCpus;
+        for (int cpu : ParseCpuList(std::string(buffer, length))) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+                nodeCpus.push_back(cpu);
+            }
+        }
+        if (!nodeCpus.empty()) {
+            nodes.push_back(nodeCpus);
+        }
+    }
+    if (nodes.empty()) {
+        std::vector<int> cpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                cpus.push_back(cpu);
+            }
+        }
+        nodes.push_back(cpus);
+    }
+    std::vector<int> result;
+    for (size_t i = 0; ; i++) {
+        bool added = false;
+        for (const auto& node : nodes) {
+            if (i < node.size()) {
+                result.push_back(node[i]);
+                added = true;
+            }
+        }
+        if (!added) {
+            break;
+        }
+    }
+    return result;
+}
+#endif
+
+}
+
+struct NetworkExecutor::Job
+{
+    StartFunction start;
+    DoneFunction done;
+};
+
+struct NetworkExecutor::Loop
+{
+    Loop(size_t queueCapacity, int loopIndex): queue(queueCapacity), index(loopIndex), multi(curl_multi_init()),
+        sleeping(false), active(0), completed(0), stolen(0), cpu(-1)
+    {
+    }
+
+    ~Loop() {
+        curl_multi_cleanup(multi);
+    }
+
+    BoundedQueue<Job*> queue;
+    int index;
+    CURLM* multi;
+    std::atomic<bool> sleeping;
+    std::atomic<int> active;
+    std::atomic<uint64_t> completed;
+    std::atomic<uint64_t> stolen;
+    int cpu;
+    std::thread thread;
+};
+
+NetworkExecutor::NetworkExecutor(const Options& options):
+    options_(options),
+    nextLoop_(0),
+    outstanding_(0),
+    stopping_(false)
+{
+    // NetworkClient performs global initialization of curl in its constructor
+    NetworkClient initializer;
+
+    int count = options_.loopCount > 0 ? options_.loopCount : static_cast<int>(std::thread::hardware_concurrency());
+    count = std::max(count, 1);
+    options_.maxTransfersPerLoop = std::max(options_.maxTransfersPerLoop, 1);
+
+    std::vector<int> cpus;
+#ifdef __linux__
+    if (options_.pinThreads) {
+        cpus = CpuOrder();
+    }
+#endif
+    for (int i = 0; i < count; i++) {
+        loops_.emplace_back(new Loop(options_.queueCapacity, i));
+        if (!cpus.empty()) {
+            loops_.back()->cpu = cpus[i % cpus.size()];
+        }
+    }
+    for (auto& loop : loops_) {
+        loop->thread = std::thread(&NetworkExecutor::loopFunc, this, loop.get());
+    }
+}
+
+NetworkExecutor::~NetworkExecutor() {
+    waitForAll();
+    stopping_ = true;
+    for (auto& loop : loops_) {
+#if LIBCURL_VERSION_NUM >= 0x074400
+        curl_multi_wakeup(loop->multi);
+#endif
+    }
+    for (auto& loop : loops_) {
+        loop->thread.join();
+    }
+}
+
+void NetworkExecutor::submit(StartFunction start, DoneFunction done, int loopHint) {
+    Job* job = new Job();
+    job->start = std::move(start);
+    job->done = std::move(done);
+    ++outstanding_;
+
+    size_t count = loops_.size();
+    size_t first = loopHint >= 0 ? static_cast<size_t>(loopHint) % count : static_cast<size_t>(nextLoop_++ % count);
+    for (;;) {
+        for (size_t i = 0; i < count; i++) {
+            Loop* loop = loops_[(first + i) % count].get();
+            if (!loop->queue.push(job)) {
+                continue;
+            }
+            wake(loop);
+            if (loop->active.load() >= options_.maxTransfersPerLoop) {
+                // The loop is busy, let an idle one steal the job
+                for (auto& other : loops_) {
+                    if (other.get() != loop && other->sleeping.load()
+                        && other->active.load() < options_.maxTransfersPerLoop) {
+                        wake(other.get());
+                        break;
+                    }
+                }
+            }
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
+
+void NetworkExecutor::submit(const NetworkBatch::Request& request, std::function<void(NetworkBatch::Result& result)> callback,
+                             int loopHint) {
+    // The request must outlive the transfer, so the job keeps its own copy
+    std::shared_ptr<NetworkBatch::Request> copy = std::make_shared<NetworkBatch::Request>(request);
+    submit([copy](NetworkClient& client) {
+        return NetworkBatch::start(client, *copy);
+    }, [copy, callback](NetworkClient& client, bool) {
+        NetworkBatch::Result result;
+        NetworkBatch::collect(client, result);
+        if (callback) {
+            callback(result);
+        }
+    }, loopHint);
+}
+
+void NetworkExecutor::waitForAll() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    allDone_.wait(lock, [this] { return outstanding_.load() == 0; });
+}
+
+int NetworkExecutor::loopCount() const {
+    return static_cast<int>(loops_.size());
+}
+
+std::vector<NetworkExecutor::LoopStats> NetworkExecutor::stats() const {
+    std::vector<LoopStats> result(loops_.size());
+    for (size_t i = 0; i < loops_.size(); i++) {
+        result[i].completed = loops_[i]->completed.load();
+        result[i].stolen = loops_[i]->stolen.load();
+        result[i].cpu = loops_[i]->cpu;
+    }
+    return result;
+}
+
+NetworkExecutor::Job* NetworkExecutor::takeJob(Loop* loop) {
+    Job* job = nullptr;
+    if (loop->queue.pop(job)) {
+        return job;
+    }
+    size_t count = loops_.size();
+    for (size_t i = 1; i < count; i++) {
+        Loop* victim = loops_[(loop->index + i) % count].get();
+        if (victim->queue.pop(job)) {
+            ++loop->stolen;
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void NetworkExecutor::wake(Loop* loop) {
+#if LIBCURL_VERSION_NUM >= 0x074400
+    if (loop->sleeping.load()) {
+        curl_multi_wakeup(loop->multi);
+    }
+#endif
+}
+
+void NetworkExecutor::jobFinished() {
+    if (--outstanding_ == 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        allDone_.notify_all();
+    }
+}
+
+void NetworkExecutor::loopFunc(Loop* loop) {
+#ifdef __linux__
+    if (loop->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(loop->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            loop->cpu = -1;
+        }
+    }
+#endif
+    // Clients are created on the loop thread, so their memory is local to its NUMA node
+    std::vector<std::unique_ptr<NetworkClient>> clients;
+    std::vector<NetworkClient*> idle;
+    std::unordered_map<CURL*, std::pair<NetworkClient*, Job*>> running;
+
+    auto complete = [&](NetworkClient* client, Job* job, bool success) {
+        if (job->done) {
+            job->done(*client, success);
+        }
+        delete job;
+        idle.push_back(client);
+        ++loop->completed;
+        jobFinished();
+    };
+
+    for (;;) {
+        bool progress = false;
+        while (static_cast<int>(running.size()) < options_.maxTransfersPerLoop) {
+            Job* job = takeJob(loop);
+            if (!job) {
+                break;
+            }
+            progress = true;
+            NetworkClient* client;
+            if (idle.empty()) {
+                clients.emplace_back(new NetworkClient());
+                client = clients.back().get();
+            } else {
+                client = idle.back();
+                idle.pop_back();
+            }
+            if (job->start && job->start(*client)) {
+                running[client->getCurlHandle()] = std::make_pair(client, job);
+                curl_multi_add_handle(loop->multi, client->getCurlHandle());
+            } else {
+                complete(client, job, false);
+            }
+        }
+        loop->active.store(static_cast<int>(running.size()));
+
+        if (running.empty() && stopping_.load()) {
+            break;
+        }
+
+        int stillRunning = 0;
+        curl_multi_perform(loop->multi, &stillRunning);
+        CURLMsg* message;
+        int messagesLeft = 0;
+        while ((message = curl_multi_info_read(loop->multi, &messagesLeft)) != nullptr) {
+            if (message->msg != CURLMSG_DONE) {
+                continue;
+            }
+            CURL* handle = message->easy_handle;
+            CURLcode result = message->data.result;
+            curl_multi_remove_handle(loop->multi, handle);
+            auto it = running.find(handle);
+            if (it == running.end()) {
+                continue;
+            }
+            NetworkClient* client = it->second.first;
+            Job* job = it->second.second;
+            running.erase(it);
+            progress = true;
+            complete(client, job, client->finishRequest(result));
+        }
+        loop->active.store(static_cast<int>(running.size()));
+        if (progress) {
+            continue;
+        }
+
+        loop->sleeping.store(true);
+        // Queued jobs only count as work if the loop has room for them, a full loop waits for its transfers
+        bool canTake = static_cast<int>(running.size()) < options_.maxTransfersPerLoop;
+        bool haveWork = canTake && !loop->queue.empty();
+        for (size_t i = 0; canTake && !haveWork && i < loops_.size(); i++) {
+            haveWork = !loops_[i]->queue.empty();
+        }
+        if (!haveWork) {
+            // Idle loops wake up periodically to look for jobs queued to busy loops
+#if LIBCURL_VERSION_NUM >= 0x074400
+            curl_multi_poll(loop->multi, nullptr, 0, 100, nullptr);
+#else
+            curl_multi_wait(loop->multi, nullptr, 0, 10, nullptr);
+#endif
+        }
+        loop->sleeping.store(false);
+    }
+}
@@ -0,0 +1,136 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef CURL_CPP_WRAPPER_NETWORK_EXECUTOR_H
+#define CURL_CPP_WRAPPER_NETWORK_EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "NetworkBatch.h"
+#include "NetworkClient.h"
+
+/**
+ * Thread-per-core executor. Each event loop thread drives its own curl multi handle with
+ * a pool of reusable clients (and so its own connection cache). Jobs are submitted to
+ * bounded lock-free queues of the loops, loops which have free transfer slots and nothing
+ * queued take jobs from the queues of other loops.
+ */
+class NetworkExecutor
+{
+public:
+    struct Options
+    {
+        /**
+         * Number of event loops, 0 means one per hardware thread.
+         */
+        int loopCount;
+
+        /**
+         * Maximum number of concurrent transfers of a single loop.
+         */
+        int maxTransfersPerLoop;
+
+        /**
+         * Capacity of the job queue of each loop (rounded up to a power of two).
+         */
+        size_t queueCapacity;
+
+        /**
+         * Pins loop threads to CPUs (Linux only). Loops are spread over NUMA nodes evenly.
+         */
+        bool pinThreads;
+
+        Options(): loopCount(0), maxTransfersPerLoop(64), queueCapacity(4096), pinThreads(false) {
+        }
+    };
+
+    struct LoopStats
+    {
+        uint64_t completed;
+        uint64_t stolen;  // jobs taken from queues of other loops
+        int cpu;          // CPU the loop is pinned to or -1
+
+        LoopStats(): completed(0), stolen(0), cpu(-1) {
+        }
+    };
+
+    /**
+     * Sets up the request on the client with one of NetworkClient::start* functions
+     * and returns its result.
+     */
+    typedef std::function<bool(NetworkClient& client)> StartFunction;
+
+    /**
+     * Called on the loop thread when the request has finished, with the result of NetworkClient::finishRequest()
+     * (or false if the request failed to start). Request settings of the client are already reset.
+     */
+    typedef std::function<void(NetworkClient& client, bool success)> DoneFunction;
+
+    explicit NetworkExecutor(const Options& options = Options());
+    ~NetworkExecutor();
+    NetworkExecutor(NetworkExecutor const&) = delete;
+    void operator=(NetworkExecutor const& x) = delete;
+
+    /**
+     * Queues a job. loopHint selects the loop the job is queued to (-1 means round robin).
+     * Blocks while the queues are full.
+     */
+    void submit(StartFunction start, DoneFunction done, int loopHint = -1);
+
+    /**
+     * Queues a request described by NetworkBatch::Request, the callback receives the result on the loop thread.
+     */
+    void submit(const NetworkBatch::Request& request, std::function<void(NetworkBatch::Result& result)> callback,
+                int loopHint = -1);
+
+    /**
+     * Blocks until all submitted jobs have finished.
+     */
+    void waitForAll();
+
+    int loopCount() const;
+    std::vector<LoopStats> stats() const;
+
+private:
+    struct Job;
+    struct Loop;
+
+    void loopFunc(Loop* loop);
+    Job* takeJob(Loop* loop);
+    void wake(Loop* loop);
+    void jobFinished();
+
+    std::vector<std::unique_ptr<Loop>> loops_;
+    Options options_;
+    std::atomic<uint64_t> nextLoop_;
+    std::atomic<int64_t> outstanding_;
+    std::atomic<bool> stopping_;
+    std::mutex mutex_;
+    std::condition_variable allDone_;
+};
+
+#endif
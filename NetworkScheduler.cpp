@@ -0,0 +1,215 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "NetworkScheduler.h"
+
+#include <algorithm>
+
+NetworkScheduler::NetworkScheduler(int workerCount):
+    sequence_(0),
+    globalLimit_(std::max(workerCount, 1)),
+    defaultHostLimit_(0),
+    inFlight_(0),
+    stopping_(false)
+{
+    for (int i = 0; i < globalLimit_; i++) {
+        workers_.emplace_back(&NetworkScheduler::workerFunc, this);
+    }
+}
+
+NetworkScheduler::~NetworkScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        for (auto& queue : pending_) {
+            queue.clear();
+        }
+    }
+    taskAvailable_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void NetworkScheduler::schedule(const std::string& url, Task task, const TaskOptions& options) {
+    PendingTask item;
+    item.deadline = options.deadline;
+    item.host = hostFromUrl(url);
+    item.task = std::move(task);
+    item.onExpired = options.onExpired;
+    item.onFailure = options.onFailure;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        item.sequence = sequence_++;
+        pending_[options.priority < prCount ? options.priority : prLow].insert(std::move(item));
+    }
+    taskAvailable_.notify_one();
+}
+
+NetworkScheduler& NetworkScheduler::setGlobalLimit(int maxInFlight) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        globalLimit_ = std::max(maxInFlight, 1);
+    }
+    taskAvailable_.notify_all();
+    return *this;
+}
+
+NetworkScheduler& NetworkScheduler::setDefaultHostLimit(int maxInFlight) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        defaultHostLimit_ = std::max(maxInFlight, 0);
+    }
+    taskAvailable_.notify_all();
+    return *this;
+}
+
+NetworkScheduler& NetworkScheduler::setHostLimit(const std::string& host, int maxInFlight) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        hostState(host).limit = std::max(maxInFlight, 0);
+    }
+    taskAvailable_.notify_all();
+    return *this;
+}
+
+NetworkScheduler& NetworkScheduler::setHostBandwidth(const std::string& host, int64_t maxSendSpeed, int64_t maxRecvSpeed) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    HostState& state = hostState(host);
+    state.maxSendSpeed = std::max<int64_t>(maxSendSpeed, 0);
+    state.maxRecvSpeed = std::max<int64_t>(maxRecvSpeed, 0);
+    return *this;
+}
+
+void NetworkScheduler::waitForAll() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    allDone_.wait(lock, [this] {
+        return inFlight_ == 0 && std::all_of(std::begin(pending_), std::end(pending_),
+            [](const std::multiset<PendingTask>& queue) { return queue.empty(); });
+    });
+}
+
+size_t NetworkScheduler::pendingCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t count = 0;
+    for (const auto& queue : pending_) {
+        count += queue.size();
+    }
+    return count;
+}
+
+std::string NetworkScheduler::hostFromUrl(const std::string& url) {
+    return NetworkClientInternal::UrlAuthority(url);
+}
+
+NetworkScheduler::HostState& NetworkScheduler::hostState(const std::string& host) {
+    return hosts_[hostFromUrl(host)];
+}
+
+bool NetworkScheduler::takeTask(PendingTask& result, std::vector<PendingTask>& expired) {
+    if (inFlight_ >= globalLimit_) {
+        return false;
+    }
+    Clock::time_point now = Clock::now();
+
+    for (auto& queue : pending_) {
+        for (auto it = queue.begin(); it != queue.end();) {
+            if (it->deadline < now) {
+                expired.push_back(*it);
+                it = queue.erase(it);
+                continue;
+            }
+            HostState& host = hosts_[it->host];
+            int limit = host.limit >= 0 ? host.limit : defaultHostLimit_;
+            if (limit > 0 && host.inFlight >= limit) {
+                ++it;
+                continue;
+            }
+            result = *it;
+            queue.erase(it);
+            host.inFlight++;
+            inFlight_++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void NetworkScheduler::workerFunc() {
+    NetworkClient client;
+
+    for (;;) {
+        PendingTask task;
+        std::vector<PendingTask> expired;
+        bool haveTask = false;
+        curl_off_t maxSendSpeed = 0, maxRecvSpeed = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            for (;;) {
+                haveTask = takeTask(task, expired);
+                if (haveTask || !expired.empty() || stopping_) {
+                    break;
+                }
+                taskAvailable_.wait(lock);
+            }
+            if (!haveTask && expired.empty()) {
+                return;
+            }
+            if (haveTask) {
+                const HostState& host = hosts_[task.host];
+                maxSendSpeed = static_cast<curl_off_t>(host.maxSendSpeed / host.inFlight);
+                maxRecvSpeed = static_cast<curl_off_t>(host.maxRecvSpeed / host.inFlight);
+            }
+            // Expired tasks are counted as in flight until their callbacks have run
+            inFlight_ += static_cast<int>(expired.size());
+        }
+
+        for (const auto& item : expired) {
+            if (item.onExpired) {
+                item.onExpired();
+            }
+        }
+
+        if (haveTask) {
+            CURL* curl = client.getCurlHandle();
+            curl_easy_setopt(curl, CURLOPT_MAX_SEND_SPEED_LARGE, maxSendSpeed);
+            curl_easy_setopt(curl, CURLOPT_MAX_RECV_SPEED_LARGE, maxRecvSpeed);
+            // An exception must not escape the worker thread, that would terminate the process
+            try {
+                task.task(client);
+            } catch (...) {
+                if (task.onFailure) {
+                    task.onFailure(std::current_exception());
+                }
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            inFlight_ -= static_cast<int>(expired.size());
+            if (haveTask) {
+                hosts_[task.host].inFlight--;
+                inFlight_--;
+            }
+        }
+        taskAvailable_.notify_all();
+        allDone_.notify_all();
+    }
+}
@@ -0,0 +1,164 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef CURL_CPP_WRAPPER_NETWORK_SCHEDULER_H
+#define CURL_CPP_WRAPPER_NETWORK_SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "NetworkClient.h"
+
+/**
+ * Runs requests on a fixed set of worker threads, each owning a reusable NetworkClient
+ * (so connections are kept alive between tasks).
+ * Tasks are dispatched by priority class, then by earliest deadline, respecting
+ * global and per-host limits of requests in flight. Tasks whose deadline has passed
+ * before dispatch are dropped.
+ */
+class NetworkScheduler
+{
+public:
+    enum Priority
+    {
+        prHigh = 0,
+        prNormal,
+        prLow,
+        prCount
+    };
+
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<void(NetworkClient& client)> Task;
+
+    struct TaskOptions
+    {
+        Priority priority;
+        Clock::time_point deadline;
+        /**
+         * Called instead of the task if the deadline has passed before the task was dispatched.
+         */
+        std::function<void()> onExpired;
+        /**
+         * Called on the worker thread if the task throws; the worker keeps running.
+         */
+        std::function<void(std::exception_ptr error)> onFailure;
+
+        TaskOptions(): priority(prNormal), deadline(Clock::time_point::max()) {
+        }
+    };
+
+    explicit NetworkScheduler(int workerCount = 4);
+    ~NetworkScheduler();
+    NetworkScheduler(NetworkScheduler const&) = delete;
+    void operator=(NetworkScheduler const& x) = delete;
+
+    /**
+     * Queues a task. The url is used only to determine the host the request goes to,
+     * the task itself should set up the client and perform the request.
+     */
+    void schedule(const std::string& url, Task task, const TaskOptions& options = TaskOptions());
+
+    /**
+     * Limits the number of requests in flight. It can't exceed the number of workers.
+     */
+    NetworkScheduler& setGlobalLimit(int maxInFlight);
+
+    /**
+     * Limits the number of requests in flight to any single host (0 means no limit).
+     */
+    NetworkScheduler& setDefaultHostLimit(int maxInFlight);
+    NetworkScheduler& setHostLimit(const std::string& host, int maxInFlight);
+
+    /**
+     * Sets the bandwidth budget of the host in bytes per second (0 means unlimited).
+     * The budget is divided between requests in flight to that host when they are dispatched
+     * and is applied through CURLOPT_MAX_SEND_SPEED_LARGE/CURLOPT_MAX_RECV_SPEED_LARGE.
+     */
+    NetworkScheduler& setHostBandwidth(const std::string& host, int64_t maxSendSpeed, int64_t maxRecvSpeed);
+
+    /**
+     * Blocks until all queued tasks have finished or expired.
+     */
+    void waitForAll();
+
+    size_t pendingCount() const;
+
+    /**
+     * Returns lowercase "host:port" (port is omitted when it is not in the url).
+     */
+    static std::string hostFromUrl(const std::string& url);
+
+private:
+    struct PendingTask
+    {
+        Clock::time_point deadline;
+        uint64_t sequence;
+        std::string host;
+        Task task;
+        std::function<void()> onExpired;
+        std::function<void(std::exception_ptr error)> onFailure;
+
+        bool operator<(const PendingTask& other) const {
+            if (deadline != other.deadline) {
+                return deadline < other.deadline;
+            }
+            return sequence < other.sequence;
+        }
+    };
+
+    struct HostState
+    {
+        int inFlight;
+        int limit;
+        int64_t maxSendSpeed;
+        int64_t maxRecvSpeed;
+
+        HostState(): inFlight(0), limit(-1), maxSendSpeed(0), maxRecvSpeed(0) {
+        }
+    };
+
+    void workerFunc();
+    bool takeTask(PendingTask& result, std::vector<PendingTask>& expired);
+    HostState& hostState(const std::string& host);
+
+    mutable std::mutex mutex_;
+    std::condition_variable taskAvailable_;
+    std::condition_variable allDone_;
+    std::multiset<PendingTask> pending_[prCount];
+    std::map<std::string, HostState> hosts_;
+    std::vector<std::thread> workers_;
+    uint64_t sequence_;
+    int globalLimit_;
+    int defaultHostLimit_;
+    int inFlight_;
+    bool stopping_;
+};
+
+#endif
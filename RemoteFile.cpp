@@ -0,0 +1,458 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "RemoteFile.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+
+namespace {
+
+// Parses "bytes first-last/total" or "bytes */total" (unsatisfied range, first and last are set to -1).
+// total is set to -1 if it is unknown ("*").
+bool ParseContentRange(const std::string& value, int64_t& first, int64_t& last, int64_t& total) {
+    size_t pos = value.find("bytes");
+    if (pos == std::string::npos) {
+        return false;
+    }
+    pos += 5;
+    while (pos < value.size() && value[pos] == ' ') {
+        pos++;
+    }
+    size_t slash = value.find('/', pos);
+    if (slash == std::string::npos) {
+        return false;
+    }
+    std::string totalText = value.substr(slash + 1);
+    total = totalText.find('*') != std::string::npos ? -1 : strtoll(totalText.c_str(), nullptr, 10);
+    if (value.compare(pos, 1, "*") == 0) {
+        first = last = -1;
+        return true;
+    }
+    char* end = nullptr;
+    first = strtoll(value.c_str() + pos, &end, 10);
+    if (!end || *end != '-') {
+        return false;
+    }
+    last = strtoll(end + 1, nullptr, 10);
+    return true;
+}
+
+}
+
+RemoteFile::RemoteFile(const std::string& url, const Options& options):
+    url_(url),
+    options_(options),
+    multi_(nullptr),
+    opened_(false),
+    rangesSupported_(true),
+    size_(-1),
+    nextOffset_(-1),
+    readahead_(0)
+{
+    options_.blockSize = std::max<size_t>(options_.blockSize, 1);
+    options_.cacheBlocks = std::max<size_t>(options_.cacheBlocks, 1);
+    options_.maxRequestBlocks = std::max<size_t>(options_.maxRequestBlocks, 1);
+    options_.concurrency = std::max(options_.concurrency, 1);
+}
+
+RemoteFile::~RemoteFile() {
+    clients_.clear();
+    if (multi_) {
+        curl_multi_cleanup(multi_);
+    }
+}
+
+RemoteFile& RemoteFile::setClientSetup(ClientSetup setup) {
+    clientSetup_ = std::move(setup);
+    if (clientSetup_) {
+        for (auto& client : clients_) {
+            clientSetup_(*client);
+        }
+    }
+    return *this;
+}
+
+bool RemoteFile::open() {
+    if (opened_) {
+        return true;
+    }
+    NetworkClient& c = client(0);
+    prepareRequest(c, 0, static_cast<int64_t>(options_.blockSize) - 1);
+    bool success = c.doGet(url_);
+    stats_.requests++;
+    if (!success) {
+        return fail(c.errorString());
+    }
+    int code = c.responseCode();
+    std::string body = c.takeResponseBody();
+    stats_.bytesFetched += body.size();
+    int64_t first = 0, last = 0, total = -1;
+    if (code == 206 || code == 416) {
+        if (!ParseContentRange(c.responseHeaderByName("Content-Range"), first, last, total) || total < 0) {
+            return fail("Unknown size of the remote file");
+        }
+        if (code == 416) {
+            body.clear();
+        } else if (first != 0 || static_cast<int64_t>(body.size()) != std::min<int64_t>(total, options_.blockSize)) {
+            return fail("Unexpected Content-Range");
+        }
+    } else if (code == 200) {
+        // The server ignored the range and sent the whole file
+        total = static_cast<int64_t>(body.size());
+        rangesSupported_ = false;
+    } else {
+        return fail("Unexpected response code " + std::to_string(code));
+    }
+
+    etag_ = c.responseHeaderByName("ETag");
+    if (etag_.compare(0, 2, "W/") == 0) {
+        // Weak ETags can't be used with If-Match
+        etag_.clear();
+    }
+    lastModified_ = etag_.empty() ? c.responseHeaderByName("Last-Modified") : std::string();
+    size_ = total;
+    opened_ = true;
+    for (int64_t block = 0; block * static_cast<int64_t>(options_.blockSize) < static_cast<int64_t>(body.size()); block++) {
+        insertBlock(block, body.data() + block * options_.blockSize, blockLength(block));
+    }
+    return true;
+}
+
+int64_t RemoteFile::size() const {
+    return size_;
+}
+
+int64_t RemoteFile::read(int64_t offset, char* buffer, size_t length) {
+    if (!open()) {
+        return -1;
+    }
+    if (offset < 0) {
+        fail("Invalid offset");
+        return -1;
+    }
+    length = clampLength(offset, length);
+    if (!length) {
+        return 0;
+    }
+    if (offset == nextOffset_) {
+        readahead_ = std::min(readahead_ ? readahead_ * 2 : 1, options_.maxReadahead);
+    } else {
+        readahead_ = 0;
+    }
+    nextOffset_ = offset + static_cast<int64_t>(length);
+
+    std::vector<Range> ranges(1, Range(offset, length));
+    if (!readRanges(ranges, &buffer, readahead_)) {
+        return -1;
+    }
+    return static_cast<int64_t>(length);
+}
+
+std::string RemoteFile::read(int64_t offset, size_t length) {
+    std::string result;
+    if (!open() || offset < 0) {
+        return result;
+    }
+    result.resize(clampLength(offset, length));
+    if (result.empty()) {
+        return result;
+    }
+    if (read(offset, &result[0], result.size()) < 0) {
+        result.clear();
+    }
+    return result;
+}
+
+bool RemoteFile::readMany(const std::vector<Range>& ranges, std::vector<std::string>& results) {
+    results.assign(ranges.size(), std::string());
+    if (!open()) {
+        return false;
+    }
+    std::vector<Range> clamped;
+    std::vector<char*> buffers;
+    for (size_t i = 0; i < ranges.size(); i++) {
+        if (ranges[i].offset < 0) {
+            return fail("Invalid offset");
+        }
+        size_t length = clampLength(ranges[i].offset, ranges[i].length);
+        results[i].resize(length);
+        clamped.push_back(Range(ranges[i].offset, length));
+        buffers.push_back(length ? &results[i][0] : nullptr);
+    }
+    if (!readRanges(clamped, buffers.data(), 0)) {
+        results.assign(ranges.size(), std::string());
+        return false;
+    }
+    return true;
+}
+
+void RemoteFile::clearCache() {
+    blocks_.clear();
+    lru_.clear();
+}
+
+RemoteFile::Stats RemoteFile::stats() const {
+    return stats_;
+}
+
+std::string RemoteFile::errorString() const {
+    return errorString_;
+}
+
+NetworkClient& RemoteFile::client(size_t index) {
+    while (clients_.size() <= index) {
+        clients_.emplace_back(new NetworkClient());
+        if (clientSetup_) {
+            clientSetup_(*clients_.back());
+        }
+    }
+    return *clients_[index];
+}
+
+size_t RemoteFile::blockLength(int64_t block) const {
+    int64_t start = block * static_cast<int64_t>(options_.blockSize);
+    return static_cast<size_t>(std::max<int64_t>(std::min<int64_t>(options_.blockSize, size_ - start), 0));
+}
+
+size_t RemoteFile::clampLength(int64_t offset, size_t length) const {
+    if (offset >= size_) {
+        return 0;
+    }
+    return static_cast<size_t>(std::min<int64_t>(static_cast<int64_t>(length), size_ - offset));
+}
+
+bool RemoteFile::readRanges(const std::vector<Range>& ranges, char* const* buffers, size_t readahead) {
+    const int64_t blockSize = static_cast<int64_t>(options_.blockSize);
+    std::set<int64_t> missing;
+    int64_t lastBlock = -1;
+    for (const auto& range : ranges) {
+        if (!range.length) {
+            continue;
+        }
+        lastBlock = (range.offset + static_cast<int64_t>(range.length) - 1) / blockSize;
+        for (int64_t block = range.offset / blockSize; block <= lastBlock; block++) {
+            if (blocks_.count(block)) {
+                stats_.blockHits++;
+            } else {
+                missing.insert(block);
+            }
+        }
+    }
+    stats_.blockMisses += missing.size();
+    if (!missing.empty()) {
+        // Blocks following a sequential read are fetched with the same request
+        for (int64_t block = lastBlock + 1; readahead > 0 && block * blockSize < size_ && !blocks_.count(block); block++) {
+            missing.insert(block);
+            stats_.prefetchedBlocks++;
+            readahead--;
+        }
+        if (!rangesSupported_) {
+            return fail("The server doesn't support range requests");
+        }
+    }
+
+    std::vector<Run> runs;
+    for (int64_t block : missing) {
+        if (!runs.empty() && runs.back().firstBlock + static_cast<int64_t>(runs.back().blockCount) == block
+            && runs.back().blockCount < options_.maxRequestBlocks) {
+            runs.back().blockCount++;
+        } else {
+            runs.push_back({ block, 1 });
+        }
+    }
+    std::vector<std::string> bodies;
+    if (!fetchRuns(runs, bodies)) {
+        return false;
+    }
+    std::map<int64_t, const char*> fetched;
+    for (size_t i = 0; i < runs.size(); i++) {
+        for (size_t j = 0; j < runs[i].blockCount; j++) {
+            fetched[runs[i].firstBlock + static_cast<int64_t>(j)] = bodies[i].data() + j * options_.blockSize;
+        }
+    }
+
+    for (size_t i = 0; i < ranges.size(); i++) {
+        int64_t pos = ranges[i].offset;
+        int64_t end = pos + static_cast<int64_t>(ranges[i].length);
+        char* out = buffers[i];
+        while (pos < end) {
+            int64_t block = pos / blockSize;
+            size_t offsetInBlock = static_cast<size_t>(pos - block * blockSize);
+            size_t count = static_cast<size_t>(std::min<int64_t>(blockLength(block) - offsetInBlock, end - pos));
+            auto it = fetched.find(block);
+            const char* data = it != fetched.end() ? it->second : findBlock(block)->data.data();
+            memcpy(out, data + offsetInBlock, count);
+            out += count;
+            pos += static_cast<int64_t>(count);
+        }
+    }
+    // Blocks are cached only after copying, so they can't evict blocks needed by this read
+    for (const auto& it : fetched) {
+        insertBlock(it.first, it.second, blockLength(it.first));
+    }
+    return true;
+}
+
+bool RemoteFile::fetchRuns(const std::vector<Run>& runs, std::vector<std::string>& bodies) {
+    const int64_t blockSize = static_cast<int64_t>(options_.blockSize);
+    bodies.resize(runs.size());
+    auto firstByte = [&](const Run& run) {
+        return run.firstBlock * blockSize;
+    };
+    auto lastByte = [&](const Run& run) {
+        int64_t lastBlock = run.firstBlock + static_cast<int64_t>(run.blockCount) - 1;
+        return lastBlock * blockSize + static_cast<int64_t>(blockLength(lastBlock)) - 1;
+    };
+
+    if (runs.size() == 1) {
+        NetworkClient& c = client(0);
+        prepareRequest(c, firstByte(runs[0]), lastByte(runs[0]));
+        bool success = c.doGet(url_);
+        return checkResponse(c, success, firstByte(runs[0]), lastByte(runs[0]), bodies[0]);
+    }
+    if (runs.empty()) {
+        return true;
+    }
+
+    if (!multi_) {
+        multi_ = curl_multi_init();
+    }
+    std::map<CURL*, std::pair<NetworkClient*, size_t>> active;
+    size_t next = 0;
+    bool ok = true;
+    auto startNext = [&](NetworkClient& c) {
+        if (next >= runs.size() || !ok) {
+            return;
+        }
+        size_t index = next++;
+        prepareRequest(c, firstByte(runs[index]), lastByte(runs[index]));
+        if (!c.startGet(url_)) {
+            ok = fail(c.errorString());
+            return;
+        }
+        curl_multi_add_handle(multi_, c.getCurlHandle());
+        active[c.getCurlHandle()] = std::make_pair(&c, index);
+    };
+    size_t clientCount = std::min(runs.size(), static_cast<size_t>(options_.concurrency));
+    for (size_t i = 0; i < clientCount; i++) {
+        startNext(client(i));
+    }
+
+    while (!active.empty()) {
+        int running = 0;
+        curl_multi_perform(multi_, &running);
+        int left = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi_, &left)) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            // The message is invalidated by curl_multi_remove_handle()
+            CURL* handle = msg->easy_handle;
+            CURLcode result = msg->data.result;
+            auto it = active.find(handle);
+            if (it == active.end()) {
+                continue;
+            }
+            NetworkClient& c = *it->second.first;
+            size_t index = it->second.second;
+            active.erase(it);
+            curl_multi_remove_handle(multi_, handle);
+            bool success = c.finishRequest(result);
+            if (ok) {
+                ok = checkResponse(c, success, firstByte(runs[index]), lastByte(runs[index]), bodies[index]);
+            }
+            startNext(c);
+        }
+        if (!active.empty()) {
+            curl_multi_poll(multi_, nullptr, 0, 100, nullptr);
+        }
+    }
+    return ok;
+}
+
+void RemoteFile::prepareRequest(NetworkClient& client, int64_t first, int64_t last) {
+    client.addQueryHeader("Range", "bytes=" + std::to_string(first) + "-" + std::to_string(last));
+    // Ranges refer to the encoded representation, so the response must not be compressed
+    client.addQueryHeader("Accept-Encoding", "identity");
+    if (!etag_.empty()) {
+        client.addQueryHeader("If-Match", etag_);
+    } else if (!lastModified_.empty()) {
+        client.addQueryHeader("If-Unmodified-Since", lastModified_);
+    }
+}
+
+bool RemoteFile::checkResponse(NetworkClient& client, bool success, int64_t first, int64_t last, std::string& body) {
+    stats_.requests++;
+    if (!success) {
+        return fail(client.errorString());
+    }
+    int code = client.responseCode();
+    if (code == 412) {
+        return fail("The remote file has changed");
+    }
+    if (code != 206) {
+        return fail("Unexpected response code " + std::to_string(code));
+    }
+    body = client.takeResponseBody();
+    stats_.bytesFetched += body.size();
+    int64_t rangeFirst = 0, rangeLast = 0, total = -1;
+    if (!ParseContentRange(client.responseHeaderByName("Content-Range"), rangeFirst, rangeLast, total)
+        || rangeFirst != first || rangeLast != last || static_cast<int64_t>(body.size()) != last - first + 1) {
+        return fail("Unexpected Content-Range");
+    }
+    if (total >= 0 && total != size_) {
+        return fail("The remote file has changed");
+    }
+    return true;
+}
+
+const RemoteFile::Block* RemoteFile::findBlock(int64_t block) {
+    auto it = blocks_.find(block);
+    if (it == blocks_.end()) {
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.lruPosition);
+    return &it->second;
+}
+
+void RemoteFile::insertBlock(int64_t block, const char* data, size_t length) {
+    auto it = blocks_.find(block);
+    if (it != blocks_.end()) {
+        it->second.data.assign(data, length);
+        lru_.splice(lru_.begin(), lru_, it->second.lruPosition);
+        return;
+    }
+    while (blocks_.size() >= options_.cacheBlocks) {
+        blocks_.erase(lru_.back());
+        lru_.pop_back();
+    }
+    lru_.push_front(block);
+    Block& item = blocks_[block];
+    item.data.assign(data, length);
+    item.lruPosition = lru_.begin();
+}
+
+bool RemoteFile::fail(const std::string& error) {
+    errorString_ = error;
+    return false;
+}
@@ -0,0 +1,173 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef CURL_CPP_WRAPPER_REMOTE_FILE_H
+#define CURL_CPP_WRAPPER_REMOTE_FILE_H
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "NetworkClient.h"
+
+/**
+ * Random access to a remote file over HTTP Range requests.
+ * Data is fetched in aligned blocks which are kept in an LRU cache. Missing adjacent blocks
+ * are fetched with one request, and sequential reads make the following blocks to be fetched
+ * together with the missing ones (the readahead window doubles with every sequential read).
+ * readMany() fetches the missing parts of several ranges concurrently.
+ * The object is not thread safe.
+ */
+class RemoteFile
+{
+public:
+    struct Options
+    {
+        size_t blockSize;
+        /**
+         * Maximum number of blocks kept in the cache.
+         */
+        size_t cacheBlocks;
+        /**
+         * Maximum number of blocks fetched ahead of sequential reads (0 disables readahead).
+         */
+        size_t maxReadahead;
+        /**
+         * Maximum number of blocks fetched with a single request.
+         */
+        size_t maxRequestBlocks;
+        /**
+         * Maximum number of requests in flight in readMany().
+         */
+        int concurrency;
+
+        Options(): blockSize(64 * 1024), cacheBlocks(256), maxReadahead(16), maxRequestBlocks(64), concurrency(4) {
+        }
+    };
+
+    struct Range
+    {
+        int64_t offset;
+        size_t length;
+
+        Range(int64_t offset = 0, size_t length = 0): offset(offset), length(length) {
+        }
+    };
+
+    struct Stats
+    {
+        uint64_t requests;
+        uint64_t bytesFetched;
+        uint64_t blockHits;
+        uint64_t blockMisses;
+        uint64_t prefetchedBlocks;
+
+        Stats(): requests(0), bytesFetched(0), blockHits(0), blockMisses(0), prefetchedBlocks(0) {
+        }
+    };
+
+    /**
+     * Called for every client created by the object, e.g. to set a proxy or authentication headers.
+     * Per-request settings (like addQueryHeader()) must not be used there.
+     */
+    typedef std::function<void(NetworkClient& client)> ClientSetup;
+
+    explicit RemoteFile(const std::string& url, const Options& options = Options());
+    ~RemoteFile();
+    RemoteFile(RemoteFile const&) = delete;
+    void operator=(RemoteFile const& x) = delete;
+
+    RemoteFile& setClientSetup(ClientSetup setup);
+
+    /**
+     * Determines the size of the file (the first block is fetched and cached).
+     * Called automatically by the first read. Later requests are made with If-Match
+     * (or If-Unmodified-Since) so a change of the remote file is reported as an error.
+     */
+    bool open();
+
+    /**
+     * Returns -1 if the file has not been opened.
+     */
+    int64_t size() const;
+
+    /**
+     * Reads up to length bytes (less at the end of the file).
+     * @return the number of bytes read or -1 on error.
+     */
+    int64_t read(int64_t offset, char* buffer, size_t length);
+    std::string read(int64_t offset, size_t length);
+
+    /**
+     * Reads several ranges at once. results receives the data of each range.
+     */
+    bool readMany(const std::vector<Range>& ranges, std::vector<std::string>& results);
+
+    void clearCache();
+    Stats stats() const;
+    std::string errorString() const;
+
+private:
+    struct Run
+    {
+        int64_t firstBlock;
+        size_t blockCount;
+    };
+
+    struct Block
+    {
+        std::string data;
+        std::list<int64_t>::iterator lruPosition;
+    };
+
+    NetworkClient& client(size_t index);
+    size_t blockLength(int64_t block) const;
+    size_t clampLength(int64_t offset, size_t length) const;
+    bool readRanges(const std::vector<Range>& ranges, char* const* buffers, size_t readahead);
+    bool fetchRuns(const std::vector<Run>& runs, std::vector<std::string>& bodies);
+    void prepareRequest(NetworkClient& client, int64_t first, int64_t last);
+    bool checkResponse(NetworkClient& client, bool success, int64_t first, int64_t last, std::string& body);
+    const Block* findBlock(int64_t block);
+    void insertBlock(int64_t block, const char* data, size_t length);
+    bool fail(const std::string& error);
+
+    std::string url_;
+    Options options_;
+    ClientSetup clientSetup_;
+    std::vector<std::unique_ptr<NetworkClient>> clients_;
+    CURLM* multi_;
+    bool opened_;
+    bool rangesSupported_;
+    int64_t size_;
+    std::string etag_;
+    std::string lastModified_;
+    std::map<int64_t, Block> blocks_;
+    std::list<int64_t> lru_;
+    int64_t nextOffset_;
+    size_t readahead_;
+    Stats stats_;
+    std::string errorString_;
+};
+
+#endif
@@ -0,0 +1,142 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "RequestCoalescer.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace {
+
+std::string ToLower(std::string str) {
+    for (auto& c : str) {
+        c = static_cast<char>(::tolower(static_cast<unsigned char>(c)));
+    }
+    return str;
+}
+
+}
+
+RequestCoalescer::RequestCoalescer(const std::vector<std::string>& keyHeaders) {
+    for (const auto& name : keyHeaders) {
+        keyHeaders_.push_back(ToLower(name));
+    }
+    // Credentials always distinguish requests, otherwise one user could receive another user's response
+    keyHeaders_.push_back("authorization");
+    keyHeaders_.push_back("cookie");
+    std::sort(keyHeaders_.begin(), keyHeaders_.end());
+    keyHeaders_.erase(std::unique(keyHeaders_.begin(), keyHeaders_.end()), keyHeaders_.end());
+}
+
+RequestCoalescer::Result RequestCoalescer::get(NetworkClient& client, const std::string& url, const NetworkBatch::HeaderList& headers) {
+    return perform(client, "GET", url, headers);
+}
+
+RequestCoalescer::Result RequestCoalescer::head(NetworkClient& client, const std::string& url, const NetworkBatch::HeaderList& headers) {
+    return perform(client, "HEAD", url, headers);
+}
+
+RequestCoalescer::Stats RequestCoalescer::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+RequestCoalescer::Result RequestCoalescer::perform(NetworkClient& client, const std::string& method, const std::string& url,
+                                                   const NetworkBatch::HeaderList& headers) {
+    std::string key = requestKey(method, url, headers);
+    std::shared_ptr<Flight> flight;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = flights_.find(key);
+        if (it != flights_.end()) {
+            flight = it->second;
+            stats_.coalesced++;
+            flight->finished.wait(lock, [&flight] { return flight->done; });
+            Result result = flight->result;
+            result.shared = true;
+            return result;
+        }
+        flight = std::make_shared<Flight>();
+        flights_[key] = flight;
+        stats_.transfers++;
+    }
+
+    // Completes the flight even if the transfer throws, so waiters and later callers are not stuck
+    struct FlightGuard
+    {
+        RequestCoalescer& coalescer;
+        const std::string& key;
+        std::shared_ptr<Flight> flight;
+        bool completed;
+
+        ~FlightGuard() {
+            if (!completed) {
+                Result result;
+                result.body = std::make_shared<const std::string>();
+                result.errorString = "Request failed with an exception";
+                coalescer.completeFlight(key, flight, result);
+            }
+        }
+    } guard = { *this, key, flight, false };
+
+    NetworkBatch::Request request;
+    request.method = method;
+    request.url = url;
+    request.headers = headers;
+    NetworkBatch::Result batchResult;
+    NetworkBatch::perform(client, request, batchResult);
+
+    Result result;
+    result.curlResult = batchResult.curlResult;
+    result.responseCode = batchResult.responseCode;
+    result.body = std::make_shared<const std::string>(std::move(batchResult.body));
+    result.headers = std::move(batchResult.headers);
+    result.errorString = std::move(batchResult.errorString);
+    guard.completed = true;
+    completeFlight(key, flight, result);
+    return result;
+}
+
+void RequestCoalescer::completeFlight(const std::string& key, const std::shared_ptr<Flight>& flight, const Result& result) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        flight->result = result;
+        flight->done = true;
+        flights_.erase(key);
+    }
+    flight->finished.notify_all();
+}
+
+std::string RequestCoalescer::requestKey(const std::string& method, const std::string& url,
+                                         const NetworkBatch::HeaderList& headers) const {
+    std::string key = method + " " + url;
+    for (const auto& name : keyHeaders_) {
+        key += '\n';
+        key += name;
+        key += ':';
+        for (const auto& header : headers) {
+            if (ToLower(header.first) == name) {
+                key += header.second;
+                key += ',';
+            }
+        }
+    }
+    return key;
+}
@@ -0,0 +1,106 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef CURL_CPP_WRAPPER_REQUEST_COALESCER_H
+#define CURL_CPP_WRAPPER_REQUEST_COALESCER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "NetworkBatch.h"
+#include "NetworkClient.h"
+
+/**
+ * Single-flight layer for idempotent requests: when an identical request (same method, url and
+ * values of the key headers) is already in flight, the caller waits for it instead of making
+ * its own transfer. All callers receive the same immutable body buffer.
+ * Only the request which actually performs the transfer uses its client.
+ */
+class RequestCoalescer
+{
+public:
+    struct Result
+    {
+        int curlResult;
+        int responseCode;
+        std::shared_ptr<const std::string> body;
+        NetworkBatch::HeaderList headers;
+        std::string errorString;
+        /**
+         * True if the result came from a transfer started by another caller.
+         */
+        bool shared;
+
+        Result(): curlResult(-1), responseCode(-1), shared(false) {
+        }
+    };
+
+    struct Stats
+    {
+        uint64_t transfers;
+        uint64_t coalesced;
+
+        Stats(): transfers(0), coalesced(0) {
+        }
+    };
+
+    /**
+     * @param keyHeaders names of request headers which distinguish requests (e.g. Accept).
+     * Authorization and Cookie are always part of the key.
+     * Other headers are sent as given by the caller which performs the transfer.
+     * If the transfer throws, the exception propagates to its caller and waiters receive a failed result.
+     */
+    explicit RequestCoalescer(const std::vector<std::string>& keyHeaders = std::vector<std::string>());
+    RequestCoalescer(RequestCoalescer const&) = delete;
+    void operator=(RequestCoalescer const& x) = delete;
+
+    Result get(NetworkClient& client, const std::string& url, const NetworkBatch::HeaderList& headers = NetworkBatch::HeaderList());
+    Result head(NetworkClient& client, const std::string& url, const NetworkBatch::HeaderList& headers = NetworkBatch::HeaderList());
+
+    Stats stats() const;
+
+private:
+    struct Flight
+    {
+        std::condition_variable finished;
+        bool done;
+        Result result;
+
+        Flight(): done(false) {
+        }
+    };
+
+    Result perform(NetworkClient& client, const std::string& method, const std::string& url,
+                   const NetworkBatch::HeaderList& headers);
+    void completeFlight(const std::string& key, const std::shared_ptr<Flight>& flight, const Result& result);
+    std::string requestKey(const std::string& method, const std::string& url, const NetworkBatch::HeaderList& headers) const;
+
+    std::vector<std::string> keyHeaders_;
+    mutable std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<Flight>> flights_;
+    Stats stats_;
+};
+
+#endif
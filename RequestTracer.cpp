@@ -0,0 +1,332 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "RequestTracer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <thread>
+
+namespace {
+
+struct ThreadContext
+{
+    std::string traceId;
+    std::string spanId;
+    std::string flags;
+    std::string traceState;
+};
+
+thread_local ThreadContext CurrentContext;
+
+int64_t NowUnixNano() {
+    return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+bool IsLowerHex(const std::string& str) {
+    for (char c : str) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IsZeroId(const std::string& id) {
+    return id.find_first_not_of('0') == std::string::npos;
+}
+
+/**
+ * Replaces credentials and query values of the url with "REDACTED" and drops the fragment,
+ * so that tokens passed in urls don't end up in traces.
+ */
+std::string RedactUrl(const std::string& url) {
+    size_t fragment = url.find('#');
+    std::string result = url.substr(0, fragment);
+    size_t start = result.find("://");
+    start = start == std::string::npos ? 0 : start + 3;
+    size_t end = result.find_first_of("/?", start);
+    size_t at = result.rfind('@', end == std::string::npos ? std::string::npos : end);
+    if (at != std::string::npos && at >= start) {
+        result.replace(start, at - start, "REDACTED:REDACTED");
+    }
+    size_t query = result.find('?');
+    if (query == std::string::npos) {
+        return result;
+    }
+    std::string redacted = result.substr(0, query + 1);
+    size_t pos = query + 1;
+    while (pos <= result.size()) {
+        size_t next = result.find('&', pos);
+        std::string param = result.substr(pos, next == std::string::npos ? std::string::npos : next - pos);
+        size_t equals = param.find('=');
+        redacted += equals == std::string::npos ? param : param.substr(0, equals + 1) + "REDACTED";
+        if (next == std::string::npos) {
+            break;
+        }
+        redacted += '&';
+        pos = next + 1;
+    }
+    return redacted;
+}
+
+std::string JsonEscape(const std::string& str) {
+    std::string result;
+    result.reserve(str.size() + 2);
+    for (unsigned char c : str) {
+        switch (c) {
+            case '"':
+                result += "\\\"";
+                break;
+            case '\\':
+                result += "\\\\";
+                break;
+            case '\n':
+                result += "\\n";
+                break;
+            case '\r':
+                result += "\\r";
+                break;
+            case '\t':
+                result += "\\t";
+                break;
+            default:
+                if (c < 0x20) {
+                    char buffer[8];
+                    snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    result += buffer;
+                } else {
+                    result += static_cast<char>(c);
+                }
+        }
+    }
+    return result;
+}
+
+}
+
+OtlpJsonFileExporter::OtlpJsonFileExporter(const std::string& fileName, const std::string& serviceName):
+    fileName_(fileName),
+    serviceName_(serviceName)
+{
+}
+
+void OtlpJsonFileExporter::exportSpan(const RequestSpan& span) {
+    std::string line = toJson(span, serviceName_) + "\n";
+    std::lock_guard<std::mutex> lock(mutex_);
+    FILE* f = NetworkClientInternal::Fopen(fileName_.c_str(), "ab");
+    if (f) {
+        fwrite(line.data(), 1, line.size(), f);
+        fclose(f);
+    }
+}
+
+std::string OtlpJsonFileExporter::toJson(const RequestSpan& span, const std::string& serviceName) {
+    std::string attributes;
+    for (const auto& it : span.stringAttributes) {
+        attributes += (attributes.empty() ? "" : ",") + std::string("{\"key\":\"") + JsonEscape(it.first)
+            + "\",\"value\":{\"stringValue\":\"" + JsonEscape(it.second) + "\"}}";
+    }
+    for (const auto& it : span.intAttributes) {
+        attributes += (attributes.empty() ? "" : ",") + std::string("{\"key\":\"") + JsonEscape(it.first)
+            + "\",\"value\":{\"intValue\":\"" + std::to_string(it.second) + "\"}}";
+    }
+    std::string events;
+    for (const auto& event : span.events) {
+        events += (events.empty() ? "" : ",") + std::string("{\"timeUnixNano\":\"") + std::to_string(event.timeUnixNano)
+            + "\",\"name\":\"" + JsonEscape(event.name) + "\"}";
+    }
+
+    std::string json = "{\"resourceSpans\":[{\"resource\":{\"attributes\":[{\"key\":\"service.name\",\"value\":{\"stringValue\":\""
+        + JsonEscape(serviceName) + "\"}}]},\"scopeSpans\":[{\"scope\":{\"name\":\"curl-cpp-wrapper\"},\"spans\":[{";
+    json += "\"traceId\":\"" + span.traceId + "\",\"spanId\":\"" + span.spanId + "\",";
+    if (!span.parentSpanId.empty()) {
+        json += "\"parentSpanId\":\"" + span.parentSpanId + "\",";
+    }
+    if (!span.traceState.empty()) {
+        json += "\"traceState\":\"" + JsonEscape(span.traceState) + "\",";
+    }
+    // kind 3 is SPAN_KIND_CLIENT, status code 0 is STATUS_CODE_UNSET (instrumentation doesn't set OK), 2 is STATUS_CODE_ERROR
+    json += "\"name\":\"" + JsonEscape(span.name) + "\",\"kind\":3,"
+        + "\"startTimeUnixNano\":\"" + std::to_string(span.startTimeUnixNano) + "\","
+        + "\"endTimeUnixNano\":\"" + std::to_string(span.endTimeUnixNano) + "\","
+        + "\"attributes\":[" + attributes + "],\"events\":[" + events + "],"
+        + "\"status\":{\"code\":" + (span.error ? "2" : "0");
+    if (!span.statusMessage.empty()) {
+        json += ",\"message\":\"" + JsonEscape(span.statusMessage) + "\"";
+    }
+    json += "}}]}]}]}";
+    return json;
+}
+
+RequestTracer::RequestTracer(std::shared_ptr<SpanExporter> exporter): exporter_(std::move(exporter)) {
+}
+
+RequestTracer::~RequestTracer() {
+}
+
+void RequestTracer::attach(NetworkClient& client) {
+    client.addRequestObserver(this);
+}
+
+void RequestTracer::detach(NetworkClient& client) {
+    client.removeRequestObserver(this);
+    std::lock_guard<std::mutex> lock(mutex_);
+    spans_.erase(&client);
+}
+
+bool RequestTracer::setThreadContext(const std::string& traceparent, const std::string& tracestate) {
+    // version-traceid-parentid-flags
+    if (traceparent.size() < 55 || traceparent[2] != '-' || traceparent[35] != '-' || traceparent[52] != '-'
+        || (traceparent.size() > 55 && traceparent[55] != '-')) {
+        return false;
+    }
+    std::string version = traceparent.substr(0, 2);
+    std::string traceId = traceparent.substr(3, 32);
+    std::string spanId = traceparent.substr(36, 16);
+    std::string flags = traceparent.substr(53, 2);
+    if (!IsLowerHex(version) || version == "ff" || (version == "00" && traceparent.size() != 55)
+        || !IsLowerHex(traceId) || IsZeroId(traceId) || !IsLowerHex(spanId) || IsZeroId(spanId) || !IsLowerHex(flags)) {
+        return false;
+    }
+    CurrentContext.traceId = traceId;
+    CurrentContext.spanId = spanId;
+    CurrentContext.flags = flags;
+    CurrentContext.traceState = tracestate;
+    return true;
+}
+
+void RequestTracer::clearThreadContext() {
+    CurrentContext = ThreadContext();
+}
+
+std::string RequestTracer::traceparent(NetworkClient& client) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = spans_.find(&client);
+    if (it == spans_.end()) {
+        return std::string();
+    }
+    return "00-" + it->second.traceId + "-" + it->second.spanId + "-" + it->second.traceFlags;
+}
+
+std::string RequestTracer::generateId(size_t bytes) {
+    static thread_local std::mt19937_64 generator(static_cast<uint64_t>(std::random_device{}())
+        ^ static_cast<uint64_t>(NowUnixNano()) ^ std::hash<std::thread::id>()(std::this_thread::get_id()));
+    static const char hexDigits[] = "0123456789abcdef";
+    std::string id;
+    do {
+        id.clear();
+        for (size_t i = 0; i < bytes; i += 8) {
+            uint64_t value = generator();
+            for (size_t j = 0; j < 8 && i + j < bytes; j++) {
+                id += hexDigits[(value >> 4) & 0xF];
+                id += hexDigits[value & 0xF];
+                value >>= 8;
+            }
+        }
+    } while (IsZeroId(id));
+    return id;
+}
+
+void RequestTracer::onRequestStart(NetworkClient& client) {
+    RequestSpan span;
+    if (CurrentContext.traceId.empty()) {
+        span.traceId = generateId(16);
+    } else {
+        span.traceId = CurrentContext.traceId;
+        span.parentSpanId = CurrentContext.spanId;
+        span.traceState = CurrentContext.traceState;
+    }
+    span.spanId = generateId(8);
+    span.traceFlags = CurrentContext.flags.empty() ? "01" : CurrentContext.flags;
+    span.name = "HTTP";
+    span.startTimeUnixNano = NowUnixNano();
+
+    client.addQueryHeader("traceparent", "00-" + span.traceId + "-" + span.spanId + "-" + span.traceFlags);
+    if (!span.traceState.empty()) {
+        client.addQueryHeader("tracestate", span.traceState);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    spans_[&client] = std::move(span);
+}
+
+void RequestTracer::onRequestFinish(NetworkClient& client) {
+    RequestSpan span;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = spans_.find(&client);
+        if (it == spans_.end()) {
+            return;
+        }
+        span = it->second;
+    }
+    span.endTimeUnixNano = NowUnixNano();
+
+    const char* method = nullptr;
+#if LIBCURL_VERSION_NUM >= 0x074800
+    curl_easy_getinfo(client.getCurlHandle(), CURLINFO_EFFECTIVE_METHOD, &method);
+#endif
+    if (method) {
+        span.name = method;
+        span.stringAttributes.emplace_back("http.request.method", method);
+    }
+    span.stringAttributes.emplace_back("url.full", RedactUrl(client.url()));
+    int responseCode = client.responseCode();
+    if (responseCode > 0) {
+        span.intAttributes.emplace_back("http.response.status_code", responseCode);
+    }
+    span.intAttributes.emplace_back("curl.result", client.getCurlResult());
+
+    NetworkClient::Timings timings = client.responseTimings();
+    struct
+    {
+        const char* name;
+        int64_t time;
+    } phases[] = {
+        { "name_lookup", timings.nameLookup },
+        { "connect", timings.connect },
+        { "tls_handshake", timings.appConnect },
+        { "request_sent", timings.preTransfer },
+        { "first_byte", timings.startTransfer },
+    };
+    for (const auto& phase : phases) {
+        if (phase.time > 0) {
+            span.events.push_back({ phase.name, span.startTimeUnixNano + phase.time * 1000 });
+        }
+    }
+    if (timings.redirect > 0) {
+        span.intAttributes.emplace_back("http.redirect_time_us", timings.redirect);
+    }
+
+    if (client.getCurlResult() != CURLE_OK) {
+        span.error = true;
+        span.statusMessage = client.errorString();
+    } else if (responseCode >= 400) {
+        span.error = true;
+    }
+
+    if (exporter_) {
+        exporter_->exportSpan(span);
+    }
+}
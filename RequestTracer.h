@@ -0,0 +1,130 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef CURL_CPP_WRAPPER_REQUEST_TRACER_H
+#define CURL_CPP_WRAPPER_REQUEST_TRACER_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "NetworkClient.h"
+
+/**
+ * Distributed tracing span of a single HTTP request (W3C Trace Context ids in lowercase hex).
+ */
+struct RequestSpan
+{
+    struct Event
+    {
+        std::string name;
+        int64_t timeUnixNano;
+    };
+
+    std::string traceId;
+    std::string spanId;
+    std::string parentSpanId;
+    std::string traceState;
+    std::string traceFlags;
+    std::string name;
+    int64_t startTimeUnixNano;
+    int64_t endTimeUnixNano;
+    std::vector<std::pair<std::string, std::string>> stringAttributes;
+    std::vector<std::pair<std::string, int64_t>> intAttributes;
+    std::vector<Event> events;
+    bool error;
+    std::string statusMessage;
+
+    RequestSpan(): startTimeUnixNano(0), endTimeUnixNano(0), error(false) {
+    }
+};
+
+/**
+ * Receives finished spans. Called from the thread which performed the request.
+ */
+class SpanExporter
+{
+public:
+    virtual ~SpanExporter() = default;
+    virtual void exportSpan(const RequestSpan& span) = 0;
+};
+
+/**
+ * Appends spans to a file in the OTLP/JSON format, one ExportTraceServiceRequest per line.
+ */
+class OtlpJsonFileExporter: public SpanExporter
+{
+public:
+    explicit OtlpJsonFileExporter(const std::string& fileName, const std::string& serviceName = "curl-cpp-wrapper");
+    void exportSpan(const RequestSpan& span) override;
+
+    static std::string toJson(const RequestSpan& span, const std::string& serviceName);
+
+private:
+    std::mutex mutex_;
+    std::string fileName_;
+    std::string serviceName_;
+};
+
+/**
+ * Opens a client span for every request of attached clients, injects the traceparent/tracestate
+ * headers (https://www.w3.org/TR/trace-context/) and exports the span with curl timing phases
+ * as events when the request finishes. Credentials and query values in url.full are replaced with "REDACTED".
+ * Requests become children of the context set by setThreadContext(), otherwise each request starts a new trace.
+ */
+class RequestTracer: public NetworkClient::RequestObserver
+{
+public:
+    explicit RequestTracer(std::shared_ptr<SpanExporter> exporter);
+    ~RequestTracer();
+    RequestTracer(RequestTracer const&) = delete;
+    void operator=(RequestTracer const& x) = delete;
+
+    void attach(NetworkClient& client);
+    void detach(NetworkClient& client);
+
+    /**
+     * Sets the parent context for requests made by the current thread.
+     * Returns false if traceparent is malformed.
+     */
+    static bool setThreadContext(const std::string& traceparent, const std::string& tracestate = "");
+    static void clearThreadContext();
+
+    /**
+     * Returns the traceparent header value of the request in progress (or of the last request) of the client.
+     */
+    std::string traceparent(NetworkClient& client) const;
+
+    static std::string generateId(size_t bytes);
+
+    void onRequestStart(NetworkClient& client) override;
+    void onRequestFinish(NetworkClient& client) override;
+
+private:
+    std::shared_ptr<SpanExporter> exporter_;
+    mutable std::mutex mutex_;
+    std::map<NetworkClient*, RequestSpan> spans_;
+};
+
+#endif
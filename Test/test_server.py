@@ -2,19 +2,157 @@ from flask import Flask
 from flask import request
 from flask import Response
 from flask import jsonify
+import base64
+import gzip
 import hashlib
 import json
+import os
+import socket
+import sys
+import threading
+import time
+from werkzeug.serving import make_server
 
 app = Flask(__name__)
 
+big_data = bytes((i * 7) % 251 for i in range(1024 * 1024))
+
 @app.route('/get')
 def get():
     return jsonify({'get': 'ok'})
 
+@app.route('/sleep')
+def sleep():
+    time.sleep(int(request.args.get('ms', 0)) / 1000.0)
+    return jsonify({'slept': request.args.get('ms')})
+
+@app.route('/status')
+def status():
+    return Response(b'', status=int(request.args.get('code', 200)))
+
+@app.route('/stall')
+def stall():
+    # Sends the beginning of the body, then nothing for `ms` milliseconds
+    delay = int(request.args.get('ms', 0)) / 1000.0
+
+    def generate():
+        yield b'x' * 1000
+        time.sleep(delay)
+        yield b'y' * 1000
+
+    return Response(generate(), status=200, mimetype='application/octet-stream')
+
+@app.route('/events')
+def events():
+    # Each connection continues after Last-Event-ID, the last one is told to stop with 204
+    last_id = request.headers.get('Last-Event-ID', '')
+    idle = request.args.get('idle')
+    if last_id == '3':
+        return Response(status=204)
+
+    def generate():
+        if idle:
+            yield b'data: waiting\n\n'
+            time.sleep(10)
+        elif not last_id:
+            yield b'\xef\xbb\xbfretry: 100\n\n: keepalive\n\n'
+            yield b'id: 1\nevent: update\ndata: first\ndata:  line\n\n'
+            yield b'data: sec'
+            yield b'ond\r\nid: 2\r\n\r'
+            yield b'\ndata: dropped'
+        else:
+            yield b'id: 3\ndata: third\n\n'
+
+    return Response(generate(), status=200, mimetype='text/event-stream')
+
+@app.route('/download_big')
+def download_big():
+    # Supports Range and If-Range, the body is sent slowly so the download can be interrupted
+    etag = '"%s"' % request.args.get('etag', 'big-v1')
+    headers = {'ETag': etag, 'Accept-Ranges': 'bytes'}
+    start = 0
+    status = 200
+    range_header = request.headers.get('Range')
+    if_range = request.headers.get('If-Range')
+    if range_header and (if_range is None or if_range == etag):
+        start = int(range_header.split('=')[1].split('-')[0])
+        if start >= len(big_data):
+            return Response(b'Range Not Satisfiable', status=416,
+                            headers={'ETag': etag, 'Content-Range': 'bytes */%d' % len(big_data)})
+        status = 206
+        headers['Content-Range'] = 'bytes %d-%d/%d' % (start, len(big_data) - 1, len(big_data))
+    headers['Content-Length'] = str(len(big_data) - start)
+
+    def generate():
+        for pos in range(start, len(big_data), 65536):
+            time.sleep(0.01)
+            yield big_data[pos:pos + 65536]
+
+    return Response(generate(), status=status, headers=headers, mimetype='application/octet-stream')
+
+@app.route('/ranged')
+def ranged():
+    # Serves big_data with single "bytes=first-last" ranges, If-Match is checked against the ETag
+    etag = '"%s"' % request.args.get('etag', 'ranged-v1')
+    headers = {'ETag': etag, 'Accept-Ranges': 'bytes'}
+    if_match = request.headers.get('If-Match')
+    if if_match is not None and if_match != etag:
+        return Response(b'', status=412, headers=headers)
+    range_header = request.headers.get('Range')
+    if not range_header:
+        return Response(big_data, status=200, headers=headers, mimetype='application/octet-stream')
+    first, last = range_header.split('=')[1].split('-')
+    first = int(first)
+    last = min(int(last) if last else len(big_data) - 1, len(big_data) - 1)
+    if first >= len(big_data):
+        headers['Content-Range'] = 'bytes */%d' % len(big_data)
+        return Response(b'', status=416, headers=headers)
+    headers['Content-Range'] = 'bytes %d-%d/%d' % (first, last, len(big_data))
+    return Response(big_data[first:last + 1], status=206, headers=headers, mimetype='application/octet-stream')
+
+@app.route('/download_with_digest')
+def download_with_digest():
+    with open(os.path.join(os.path.dirname(os.path.abspath(__file__)), 'TestData', 'webp-supported.webp'), 'rb') as f:
+        data = f.read()
+    md5 = hashlib.md5(data).digest()
+    sha256 = hashlib.sha256(data).digest()
+    if request.args.get('bad'):
+        sha256 = hashlib.sha256(b'other').digest()
+    headers = {
+        'Content-MD5': base64.b64encode(md5).decode(),
+        'Digest': 'md5=%s, sha-256=%s' % (base64.b64encode(md5).decode(), base64.b64encode(sha256).decode()),
+    }
+    return Response(data, status=200, headers=headers, mimetype='image/webp')
+
+@app.route('/json_array')
+def json_array():
+    count = int(request.args.get('count', 1000))
+    broken = request.args.get('broken')
+
+    def generate():
+        yield '['
+        for i in range(count):
+            if i > 0:
+                yield ','
+            if broken and i == count // 2:
+                yield '{"id": oops}'
+            else:
+                yield json.dumps({'id': i, 'name': 'item %d' % i, 'tags': ['a', 'b'], 'ok': i % 2 == 0})
+        yield ']'
+
+    return Response(generate(), mimetype='application/json')
+
 @app.route('/get_hello')
 def get_hello():
     return jsonify({'hello': request.args.get('name')})
 
+@app.route('/request_method')
+def request_method():
+    # Flask answers HEAD through the GET view, the method is also reported in a header
+    response = jsonify({'method': request.method})
+    response.headers['X-Request-Method'] = request.method
+    return response
+
 @app.route('/get_full')
 def get_full():
     return jsonify({
@@ -23,6 +161,13 @@ def get_full():
         'custom_header': request.headers.get('X-Hello-World')
     })
 
+@app.route('/trace_context')
+def trace_context():
+    return jsonify({
+        'traceparent': request.headers.get('traceparent'),
+        'tracestate': request.headers.get('tracestate')
+    })
+
 @app.route('/post', methods = ['POST'])
 def post():
     return jsonify({'hello': request.form['name']})
@@ -37,6 +182,22 @@ def upload_multipart():
 def upload():
     return jsonify({'hash': hashlib.md5(request.data).hexdigest()}), 201   
 
+@app.route('/upload_compressed', methods = ['POST', 'PUT'])
+def upload_compressed():
+    encoding = request.headers.get('Content-Encoding')
+    data = request.get_data()
+    if encoding == 'gzip':
+        data = gzip.decompress(data)
+    elif encoding == 'zstd':
+        try:
+            import zstandard
+        except ImportError:
+            return '', 415
+        data = zstandard.ZstdDecompressor().stream_reader(data).read()
+    return jsonify({'hash': hashlib.md5(data).hexdigest(), 'sha256': hashlib.sha256(data).hexdigest(),
+                    'encoding': encoding, 'size': len(data),
+                    'transfer_encoding': request.headers.get('Transfer-Encoding')})
+
 @app.route('/empty_post_response', methods = ['POST'])
 def empty_post_response():
     return '', 204
@@ -54,5 +215,106 @@ def delete():
 def trace():
     return Response(request.data, status=200, mimetype='message/http')
 
+UNIX_SOCKET_PATH = '/tmp/curl_cpp_wrapper_test.sock'
+ABSTRACT_SOCKET_NAME = 'curl_cpp_wrapper_test'
+
+def serve_unix_sockets():
+    if not hasattr(socket, 'AF_UNIX'):
+        return
+    if os.path.exists(UNIX_SOCKET_PATH):
+        os.unlink(UNIX_SOCKET_PATH)
+    servers = [make_server('unix://' + UNIX_SOCKET_PATH, 0, app, threaded=True)]
+    if sys.platform.startswith('linux'):
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.bind('\0' + ABSTRACT_SOCKET_NAME)
+        sock.listen(128)
+        servers.append(make_server('unix://' + ABSTRACT_SOCKET_NAME, 0, app, threaded=True, fd=sock.fileno()))
+    for server in servers:
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+
+WEBSOCKET_PORT = 5001
+WEBSOCKET_GUID = '258EAFA5-E914-47DA-95CA-C5AB0DC85B11'
+
+def ws_recv_exact(conn, size):
+    data = b''
+    while len(data) < size:
+        chunk = conn.recv(size - len(data))
+        if not chunk:
+            raise ConnectionError()
+        data += chunk
+    return data
+
+def ws_send_frame(conn, opcode, payload, fin=True):
+    header = bytes([(0x80 if fin else 0) | opcode])
+    if len(payload) < 126:
+        header += bytes([len(payload)])
+    elif len(payload) < 65536:
+        header += bytes([126]) + len(payload).to_bytes(2, 'big')
+    else:
+        header += bytes([127]) + len(payload).to_bytes(8, 'big')
+    conn.sendall(header + payload)
+
+# Echoes every frame as received (fragmentation included); the text message "fragmented"
+# is answered with a message split into three frames.
+def ws_echo(conn):
+    request = b''
+    while b'\r\n\r\n' not in request:
+        chunk = conn.recv(4096)
+        if not chunk:
+            return
+        request += chunk
+    key = ''
+    for line in request.decode('latin-1').split('\r\n'):
+        name, _, value = line.partition(':')
+        if name.strip().lower() == 'sec-websocket-key':
+            key = value.strip()
+    accept = base64.b64encode(hashlib.sha1((key + WEBSOCKET_GUID).encode()).digest()).decode()
+    conn.sendall(('HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n'
+                  'Sec-WebSocket-Accept: ' + accept + '\r\n\r\n').encode())
+    while True:
+        first, second = ws_recv_exact(conn, 2)
+        length = second & 0x7f
+        if length == 126:
+            length = int.from_bytes(ws_recv_exact(conn, 2), 'big')
+        elif length == 127:
+            length = int.from_bytes(ws_recv_exact(conn, 8), 'big')
+        mask = ws_recv_exact(conn, 4) if second & 0x80 else b'\0\0\0\0'
+        payload = bytes(b ^ mask[i % 4] for i, b in enumerate(ws_recv_exact(conn, length)))
+        opcode = first & 0x0f
+        if opcode == 0x8:
+            ws_send_frame(conn, 0x8, payload[:2])
+            return
+        if opcode == 0x9:
+            ws_send_frame(conn, 0xA, payload)
+        elif opcode == 0x1 and payload == b'fragmented':
+            ws_send_frame(conn, 0x1, b'abc', False)
+            ws_send_frame(conn, 0x0, b'def', False)
+            ws_send_frame(conn, 0x0, b'ghi')
+        elif opcode != 0xA:
+            ws_send_frame(conn, opcode, payload, bool(first & 0x80))
+
+def serve_websocket_echo():
+    listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    listener.bind(('127.0.0.1', WEBSOCKET_PORT))
+    listener.listen(16)
+
+    def handle(conn):
+        try:
+            ws_echo(conn)
+        except (ConnectionError, OSError):
+            pass
+        finally:
+            conn.close()
+
+    def accept_loop():
+        while True:
+            conn, _ = listener.accept()
+            threading.Thread(target=handle, args=(conn,), daemon=True).start()
+
+    threading.Thread(target=accept_loop, daemon=True).start()
+
 if __name__ == '__main__':
+    serve_unix_sockets()
+    serve_websocket_echo()
     app.run()
@@ -0,0 +1,122 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+// Counts C++ heap allocations made while a response is being received,
+// with the body collected into a std::string and into a caller-provided buffer.
+// Allocations made by libcurl are counted separately through the allocator installed by NetworkClient::globalInit().
+// Usage: allocation_benchmark <url> [requests] [pool]
+// Example (with Test/test_server.py running):
+//   allocation_benchmark http://127.0.0.1:5000/get_hello?name=a 1000 pool
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <cstring>
+#include <string>
+
+#include "../NetworkClient.h"
+
+namespace {
+
+std::atomic<uint64_t> allocationCount(0);
+
+bool Perform(NetworkClient& client, const std::string& url, uint64_t& allocations, uint64_t& curlAllocations) {
+    if (!client.startGet(url)) {
+        return false;
+    }
+    uint64_t before = allocationCount.load();
+    CURLcode result = curl_easy_perform(client.getCurlHandle());
+    allocations += allocationCount.load() - before;
+    bool success = client.finishRequest(result);
+    curlAllocations += client.requestAllocationStats().allocations;
+    return success;
+}
+
+bool Measure(const char* name, NetworkClient& client, const std::string& url, int count, bool takeBody) {
+    uint64_t allocations = 0;
+    uint64_t curlAllocations = 0;
+    size_t bodySize = 0;
+    // Warm up, so the connection and internal buffers are already there
+    for (int i = 0; i < count + 10; i++) {
+        if (i == 10) {
+            allocations = 0;
+            curlAllocations = 0;
+        }
+        if (!Perform(client, url, allocations, curlAllocations)) {
+            fprintf(stderr, "Request failed: %s\n", client.errorString().c_str());
+            return false;
+        }
+        if (takeBody) {
+            bodySize = client.takeResponseBody().size();
+        } else {
+            bodySize = client.responseBodyView().size;
+        }
+    }
+    printf("%-8s body %6zu bytes   %8.2f allocations per request, %8.2f by libcurl\n", name, bodySize,
+           static_cast<double>(allocations) / count, static_cast<double>(curlAllocations) / count);
+    return true;
+}
+
+}
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <url> [requests] [pool]\n", argv[0]);
+        return 1;
+    }
+    std::string url = argv[1];
+    int count = argc > 2 ? std::max(atoi(argv[2]), 1) : 1000;
+    NetworkClient::GlobalOptions options;
+    options.allocator = argc > 3 && !strcmp(argv[3], "pool") ? NetworkClient::amPool : NetworkClient::amCounting;
+    if (!NetworkClient::globalInit(options)) {
+        fprintf(stderr, "Failed to initialize libcurl\n");
+        return 1;
+    }
+
+    NetworkClient client;
+    if (!Measure("string", client, url, count, true)) {
+        return 1;
+    }
+    static char buffer[64 * 1024];
+    client.setResponseBuffer(buffer, sizeof(buffer));
+    if (!Measure("buffer", client, url, count, false)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,401 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+// HTTP load generator built on NetworkClient.
+// Closed loop (default): each connection sends the next request as soon as the previous one finishes.
+// Open loop (-R): requests are started at a constant rate and latency is measured from the time
+// a request was scheduled to start, so a stalled server is not hidden by the load generator
+// slowing down (coordinated omission).
+// Usage: load_generator [options] <url>
+//   -c <connections>   clients running in parallel (default 8)
+//   -d <seconds>       duration (default 10)
+//   -n <requests>      stop after this number of requests
+//   -R <rate>          requests per second, open loop
+//   -X <method>        request method
+//   -H <header>        add a request header ("Name: value"), can be repeated
+//   -D <data>          request body (POST by default)
+//   -u <file>          upload the file (PUT by default)
+//   -f text|csv|json   output format (default text)
+// Example (with Test/test_server.py running):
+//   load_generator -c 4 -d 5 -R 200 http://127.0.0.1:5000/get_hello?name=a
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../NetworkClient.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * HDR-style histogram of microsecond values with about 0.1% precision.
+ * Values below 2^SubBits are counted exactly, above that each power of two
+ * is split into 2^(SubBits - 1) buckets.
+ */
+class Histogram
+{
+public:
+    enum { SubBits = 11, MaxShift = 40 };
+
+    Histogram(): counts_((MaxShift + 2) << (SubBits - 1)), count_(0), min_(0), max_(0), sum_(0) {
+    }
+
+    void record(int64_t value) {
+        value = std::max<int64_t>(value, 0);
+        counts_[std::min(bucketIndex(value), counts_.size() - 1)]++;
+        min_ = count_ ? std::min(min_, value) : value;
+        max_ = count_ ? std::max(max_, value) : value;
+        sum_ += static_cast<double>(value);
+        count_++;
+    }
+
+    void merge(const Histogram& other) {
+        if (!other.count_) {
+            return;
+        }
+        for (size_t i = 0; i < counts_.size(); i++) {
+            counts_[i] += other.counts_[i];
+        }
+        min_ = count_ ? std::min(min_, other.min_) : other.min_;
+        max_ = count_ ? std::max(max_, other.max_) : other.max_;
+        sum_ += other.sum_;
+        count_ += other.count_;
+    }
+
+    uint64_t count() const {
+        return count_;
+    }
+
+    int64_t min() const {
+        return min_;
+    }
+
+    int64_t max() const {
+        return max_;
+    }
+
+    double mean() const {
+        return count_ ? sum_ / count_ : 0;
+    }
+
+    int64_t percentile(double percent) const {
+        if (!count_) {
+            return 0;
+        }
+        uint64_t target = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(percent / 100.0 * count_)), 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); i++) {
+            seen += counts_[i];
+            if (seen >= target) {
+                return std::min(bucketHighest(i), max_);
+            }
+        }
+        return max_;
+    }
+
+private:
+    static size_t bucketIndex(int64_t value) {
+        const int64_t exact = 1LL << SubBits;
+        if (value < exact) {
+            return static_cast<size_t>(value);
+        }
+        int msb = 0;
+        while ((value >> (msb + 1)) != 0) {
+            msb++;
+        }
+        int shift = msb - SubBits + 1;
+        return static_cast<size_t>(exact + ((shift - 1) << (SubBits - 1)) + ((value >> shift) - (exact >> 1)));
+    }
+
+    static int64_t bucketHighest(size_t index) {
+        const int64_t exact = 1LL << SubBits;
+        if (static_cast<int64_t>(index) < exact) {
+            return static_cast<int64_t>(index);
+        }
+        int64_t offset = static_cast<int64_t>(index) - exact;
+        int shift = static_cast<int>(offset >> (SubBits - 1)) + 1;
+        int64_t mantissa = (offset & ((exact >> 1) - 1)) + (exact >> 1);
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t count_;
+    int64_t min_;
+    int64_t max_;
+    double sum_;
+};
+
+enum Phase
+{
+    phNameLookup = 0,
+    phConnect,
+    phTls,
+    phFirstByte,
+    phTotal,
+    phCount
+};
+
+const char* PhaseNames[phCount] = { "dns", "connect", "tls", "first_byte", "total" };
+
+struct Options
+{
+    std::string url;
+    int connections;
+    double duration;
+    int64_t maxRequests;
+    double rate;
+    std::string method;
+    std::vector<std::string> headers;
+    std::string data;
+    bool hasData;
+    std::string uploadFile;
+    std::string format;
+
+    Options(): connections(8), duration(10), maxRequests(-1), rate(0), hasData(false), format("text") {
+    }
+};
+
+struct WorkerStats
+{
+    Histogram phases[phCount];
+    uint64_t errors;
+    uint64_t bytes;
+    std::map<int, uint64_t> codes;
+
+    WorkerStats(): errors(0), bytes(0) {
+    }
+};
+
+class LoadRun
+{
+public:
+    explicit LoadRun(const Options& options): options_(options), nextTicket_(0), stop_(false) {
+    }
+
+    void run(WorkerStats& total, double& elapsed) {
+        std::vector<WorkerStats> stats(options_.connections);
+        std::vector<std::thread> threads;
+        start_ = Clock::now();
+        deadline_ = start_ + std::chrono::microseconds(static_cast<int64_t>(options_.duration * 1e6));
+        for (int i = 0; i < options_.connections; i++) {
+            threads.emplace_back(&LoadRun::worker, this, std::ref(stats[i]));
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        elapsed = std::chrono::duration<double>(Clock::now() - start_).count();
+        for (const auto& item : stats) {
+            for (int phase = 0; phase < phCount; phase++) {
+                total.phases[phase].merge(item.phases[phase]);
+            }
+            total.errors += item.errors;
+            total.bytes += item.bytes;
+            for (const auto& code : item.codes) {
+                total.codes[code.first] += code.second;
+            }
+        }
+    }
+
+private:
+    void worker(WorkerStats& stats) {
+        NetworkClient client;
+        for (;;) {
+            int64_t ticket = nextTicket_++;
+            if (stop_ || (options_.maxRequests >= 0 && ticket >= options_.maxRequests)) {
+                return;
+            }
+            Clock::time_point intended = Clock::now();
+            if (options_.rate > 0) {
+                // Open loop: the request is due at a fixed time regardless of how long the previous ones took
+                intended = start_ + std::chrono::microseconds(static_cast<int64_t>(ticket * 1e6 / options_.rate));
+                if (intended >= deadline_) {
+                    stop_ = true;
+                    return;
+                }
+                std::this_thread::sleep_until(intended);
+            } else if (intended >= deadline_) {
+                stop_ = true;
+                return;
+            }
+
+            bool ok = perform(client);
+            Clock::time_point finished = Clock::now();
+            if (!ok) {
+                stats.errors++;
+                continue;
+            }
+            NetworkClient::Timings timings = client.responseTimings();
+            stats.codes[client.responseCode()]++;
+            stats.bytes += client.responseBodyView().size;
+            stats.phases[phNameLookup].record(timings.nameLookup);
+            stats.phases[phConnect].record(timings.connect - timings.nameLookup);
+            stats.phases[phTls].record(timings.appConnect > 0 ? timings.appConnect - timings.connect : 0);
+            stats.phases[phFirstByte].record(timings.startTransfer - timings.preTransfer);
+            stats.phases[phTotal].record(std::chrono::duration_cast<std::chrono::microseconds>(finished - intended).count());
+        }
+    }
+
+    bool perform(NetworkClient& client) {
+        for (const auto& header : options_.headers) {
+            size_t colon = header.find(':');
+            std::string value = colon == std::string::npos ? std::string() : header.substr(colon + 1);
+            value.erase(0, value.find_first_not_of(' '));
+            client.addQueryHeader(header.substr(0, colon), value);
+        }
+        if (!options_.method.empty()) {
+            client.setMethod(options_.method);
+        }
+        client.setUrl(options_.url);
+        if (!options_.uploadFile.empty()) {
+            if (options_.method.empty()) {
+                client.setMethod("PUT");
+            }
+            return client.doUpload(options_.uploadFile, "");
+        }
+        if (options_.hasData) {
+            return client.doPost(options_.data);
+        }
+        return client.doGet();
+    }
+
+    const Options& options_;
+    Clock::time_point start_;
+    Clock::time_point deadline_;
+    std::atomic<int64_t> nextTicket_;
+    std::atomic<bool> stop_;
+};
+
+void PrintText(const WorkerStats& stats, double elapsed) {
+    const Histogram& total = stats.phases[phTotal];
+    printf("%llu requests in %.2f s, %.1f requests/s, %.2f MB/s, %llu errors\n",
+           static_cast<unsigned long long>(total.count()), elapsed, total.count() / elapsed,
+           stats.bytes / elapsed / (1024 * 1024), static_cast<unsigned long long>(stats.errors));
+    for (const auto& code : stats.codes) {
+        printf("  HTTP %d: %llu\n", code.first, static_cast<unsigned long long>(code.second));
+    }
+    printf("%-11s %10s %10s %10s %10s %10s %10s %10s\n", "phase (us)", "min", "mean", "p50", "p90", "p99", "p99.9", "max");
+    for (int phase = 0; phase < phCount; phase++) {
+        const Histogram& h = stats.phases[phase];
+        printf("%-11s %10lld %10.1f %10lld %10lld %10lld %10lld %10lld\n", PhaseNames[phase],
+               static_cast<long long>(h.min()), h.mean(), static_cast<long long>(h.percentile(50)),
+               static_cast<long long>(h.percentile(90)), static_cast<long long>(h.percentile(99)),
+               static_cast<long long>(h.percentile(99.9)), static_cast<long long>(h.max()));
+    }
+}
+
+void PrintCsv(const WorkerStats& stats) {
+    printf("phase,count,min_us,mean_us,p50_us,p90_us,p99_us,p999_us,max_us\n");
+    for (int phase = 0; phase < phCount; phase++) {
+        const Histogram& h = stats.phases[phase];
+        printf("%s,%llu,%lld,%.1f,%lld,%lld,%lld,%lld,%lld\n", PhaseNames[phase],
+               static_cast<unsigned long long>(h.count()), static_cast<long long>(h.min()), h.mean(),
+               static_cast<long long>(h.percentile(50)), static_cast<long long>(h.percentile(90)),
+               static_cast<long long>(h.percentile(99)), static_cast<long long>(h.percentile(99.9)),
+               static_cast<long long>(h.max()));
+    }
+}
+
+void PrintJson(const WorkerStats& stats, double elapsed) {
+    const Histogram& total = stats.phases[phTotal];
+    printf("{\"requests\":%llu,\"errors\":%llu,\"elapsed_s\":%.3f,\"requests_per_s\":%.1f,\"bytes\":%llu,\"codes\":{",
+           static_cast<unsigned long long>(total.count()), static_cast<unsigned long long>(stats.errors), elapsed,
+           total.count() / elapsed, static_cast<unsigned long long>(stats.bytes));
+    bool first = true;
+    for (const auto& code : stats.codes) {
+        printf("%s\"%d\":%llu", first ? "" : ",", code.first, static_cast<unsigned long long>(code.second));
+        first = false;
+    }
+    printf("},\"phases\":{");
+    for (int phase = 0; phase < phCount; phase++) {
+        const Histogram& h = stats.phases[phase];
+        printf("%s\"%s\":{\"count\":%llu,\"min_us\":%lld,\"mean_us\":%.1f,\"p50_us\":%lld,\"p90_us\":%lld,"
+               "\"p99_us\":%lld,\"p999_us\":%lld,\"max_us\":%lld}", phase ? "," : "", PhaseNames[phase],
+               static_cast<unsigned long long>(h.count()), static_cast<long long>(h.min()), h.mean(),
+               static_cast<long long>(h.percentile(50)), static_cast<long long>(h.percentile(90)),
+               static_cast<long long>(h.percentile(99)), static_cast<long long>(h.percentile(99.9)),
+               static_cast<long long>(h.max()));
+    }
+    printf("}}\n");
+}
+
+bool ParseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.size() == 2 && arg[0] == '-') {
+            if (i + 1 >= argc) {
+                return false;
+            }
+            const char* value = argv[++i];
+            switch (arg[1]) {
+                case 'c': options.connections = std::max(atoi(value), 1); break;
+                case 'd': options.duration = atof(value); break;
+                case 'n': options.maxRequests = atoll(value); break;
+                case 'R': options.rate = atof(value); break;
+                case 'X': options.method = value; break;
+                case 'H': options.headers.push_back(value); break;
+                case 'D': options.data = value; options.hasData = true; break;
+                case 'u': options.uploadFile = value; break;
+                case 'f': options.format = value; break;
+                default: return false;
+            }
+        } else {
+            options.url = arg;
+        }
+    }
+    if (options.maxRequests >= 0 && options.duration <= 0) {
+        options.duration = 365 * 24 * 3600.0;
+    }
+    return !options.url.empty() && (options.format == "text" || options.format == "csv" || options.format == "json");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        fprintf(stderr, "Usage: %s [-c connections] [-d seconds] [-n requests] [-R rate] [-X method] [-H header]\n"
+                        "       [-D data] [-u file] [-f text|csv|json] <url>\n", argv[0]);
+        return 1;
+    }
+    WorkerStats stats;
+    double elapsed = 0;
+    LoadRun run(options);
+    run.run(stats, elapsed);
+
+    if (options.format == "csv") {
+        PrintCsv(stats);
+    } else if (options.format == "json") {
+        PrintJson(stats, elapsed);
+    } else {
+        PrintText(stats, elapsed);
+    }
+    return stats.phases[phTotal].count() ? 0 : 1;
+}
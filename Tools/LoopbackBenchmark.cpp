@@ -0,0 +1,95 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+// Compares request latency over the TCP loopback and over a Unix domain socket.
+// Usage: loopback_benchmark <url> <socket path> [requests]
+// Prefix the socket path with '@' to use an abstract socket.
+// Example (with Test/test_server.py running):
+//   loopback_benchmark http://127.0.0.1:5000/get_hello?name=a /tmp/curl_cpp_wrapper_test.sock 2000
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../NetworkClient.h"
+
+namespace {
+
+bool Measure(NetworkClient& client, const std::string& url, int count, std::vector<double>& latencies) {
+    // Warm up, so the connection is established before measurement
+    if (!client.doGet(url)) {
+        fprintf(stderr, "Request failed: %s\n", client.errorString().c_str());
+        return false;
+    }
+    latencies.clear();
+    for (int i = 0; i < count; i++) {
+        auto start = std::chrono::steady_clock::now();
+        if (!client.doGet(url)) {
+            fprintf(stderr, "Request failed: %s\n", client.errorString().c_str());
+            return false;
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    return true;
+}
+
+void PrintStats(const char* name, const std::vector<double>& latencies) {
+    double sum = 0;
+    for (double latency : latencies) {
+        sum += latency;
+    }
+    printf("%-6s mean %9.1f us   p50 %9.1f us   p99 %9.1f us\n", name, sum / latencies.size(),
+           latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100]);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <url> <socket path> [requests]\n", argv[0]);
+        return 1;
+    }
+    std::string url = argv[1];
+    std::string socketPath = argv[2];
+    int count = argc > 3 ? std::max(atoi(argv[3]), 1) : 1000;
+    bool abstract = !socketPath.empty() && socketPath[0] == '@';
+    if (abstract) {
+        socketPath.erase(0, 1);
+    }
+
+    std::vector<double> latencies;
+    NetworkClient tcpClient;
+    if (!Measure(tcpClient, url, count, latencies)) {
+        return 1;
+    }
+    PrintStats("tcp", latencies);
+
+    NetworkClient unixClient;
+    unixClient.setUnixSocket(socketPath, abstract);
+    if (!Measure(unixClient, url, count, latencies)) {
+        return 1;
+    }
+    PrintStats("unix", latencies);
+    return 0;
+}
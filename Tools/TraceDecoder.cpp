@@ -0,0 +1,86 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+// Prints a dump written by TraceRecorder in a readable form.
+// Usage: trace_decoder <dump file>
+
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "../TraceRecorder.h"
+
+namespace {
+
+std::string EscapeData(const char* data, size_t size) {
+    std::string result;
+    for (size_t i = 0; i < size; i++) {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        if (c == '\r') {
+            result += "\\r";
+        } else if (c == '\n') {
+            result += "\\n";
+        } else if (c == '\\') {
+            result += "\\\\";
+        } else if (c < 0x20 || c >= 0x7F) {
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), "\\x%02x", c);
+            result += buffer;
+        } else {
+            result += static_cast<char>(c);
+        }
+    }
+    return result;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <dump file>\n", argv[0]);
+        return 1;
+    }
+    std::vector<TraceRecorder::Record> records;
+    int64_t wallClockOffset = 0;
+    if (!TraceRecorder::readDump(argv[1], records, wallClockOffset)) {
+        fprintf(stderr, "Unable to read trace dump '%s'\n", argv[1]);
+        return 1;
+    }
+
+    for (const auto& record : records) {
+        int64_t wallTime = static_cast<int64_t>(record.timestamp) + wallClockOffset;
+        time_t seconds = static_cast<time_t>(wallTime / 1000000000);
+        struct tm tmTime;
+#ifdef _WIN32
+        gmtime_s(&tmTime, &seconds);
+#else
+        gmtime_r(&seconds, &tmTime);
+#endif
+        char timeBuffer[32];
+        strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%dT%H:%M:%S", &tmTime);
+        printf("%s.%09lldZ handle=%u %-14s size=%u%s \"%s\"\n", timeBuffer,
+               static_cast<long long>(wallTime % 1000000000), record.handleId,
+               TraceRecorder::eventTypeName(record.type).c_str(), record.size,
+               record.dataSize < record.size ? " (truncated)" : "",
+               EscapeData(record.data, record.dataSize).c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,278 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "TraceRecorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+const char DumpMagic[8] = { 'N', 'C', 'T', 'R', 'A', 'C', 'E', '1' };
+
+uint64_t SteadyNanoseconds() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+int64_t SystemNanoseconds() {
+    return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+}
+
+struct TraceRecorder::Ring
+{
+    struct Slot
+    {
+        // 0 while the record is being written, otherwise the write index + 1
+        std::atomic<uint64_t> sequence;
+        Record record;
+    };
+
+    explicit Ring(size_t capacity): slots(capacity), mask(capacity - 1), head(0), clearedUpTo(0), alive(true) {
+    }
+
+    // Called only by the owning thread
+    void write(uint32_t handleId, EventType type, const char* data, size_t size) {
+        uint64_t index = head.load(std::memory_order_relaxed);
+        Slot& slot = slots[index & mask];
+        slot.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        Record& record = slot.record;
+        record.sequence = index;
+        record.timestamp = SteadyNanoseconds();
+        record.handleId = handleId;
+        record.size = static_cast<uint32_t>(std::min<size_t>(size, UINT32_MAX));
+        record.type = static_cast<uint8_t>(type);
+        record.dataSize = static_cast<uint8_t>(std::min<size_t>(size, MaxRecordData));
+        if (record.dataSize) {
+            memcpy(record.data, data, record.dataSize);
+        }
+
+        slot.sequence.store(index + 1, std::memory_order_release);
+        head.store(index + 1, std::memory_order_release);
+    }
+
+    void read(std::vector<Record>& out) const {
+        uint64_t end = head.load(std::memory_order_acquire);
+        uint64_t start = std::max<uint64_t>(end > slots.size() ? end - slots.size() : 0,
+                                            clearedUpTo.load(std::memory_order_acquire));
+        for (uint64_t i = start; i < end; i++) {
+            const Slot& slot = slots[i & mask];
+            uint64_t before = slot.sequence.load(std::memory_order_acquire);
+            if (before != i + 1) {
+                continue;
+            }
+            Record record = slot.record;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != before) {
+                // Overwritten while it was being copied
+                continue;
+            }
+            out.push_back(record);
+        }
+    }
+
+    std::vector<Slot> slots;
+    size_t mask;
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> clearedUpTo;
+    std::atomic<bool> alive;
+};
+
+TraceRecorder::TraceRecorder(): nextHandleId_(0), ringCapacity_(4096) {
+}
+
+TraceRecorder& TraceRecorder::instance() {
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+TraceRecorder::Ring& TraceRecorder::threadRing() {
+    struct RingHolder
+    {
+        std::shared_ptr<Ring> ring;
+
+        ~RingHolder() {
+            if (ring) {
+                ring->alive = false;
+            }
+        }
+    };
+    static thread_local RingHolder holder;
+
+    if (!holder.ring) {
+        holder.ring = std::make_shared<Ring>(ringCapacity_.load());
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.push_back(holder.ring);
+    }
+    return *holder.ring;
+}
+
+void TraceRecorder::attach(NetworkClient& client) {
+    uint32_t id = ++nextHandleId_;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        handleIds_[&client] = id;
+    }
+    CURL* curl = client.getCurlHandle();
+    curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, &TraceRecorder::debugCallback);
+    curl_easy_setopt(curl, CURLOPT_DEBUGDATA, reinterpret_cast<void*>(static_cast<uintptr_t>(id)));
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+    client.addRequestObserver(this);
+}
+
+void TraceRecorder::detach(NetworkClient& client) {
+    CURL* curl = client.getCurlHandle();
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
+    curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, nullptr);
+    curl_easy_setopt(curl, CURLOPT_DEBUGDATA, nullptr);
+    client.removeRequestObserver(this);
+    std::lock_guard<std::mutex> lock(mutex_);
+    handleIds_.erase(&client);
+}
+
+void TraceRecorder::setRingCapacity(size_t records) {
+    size_t capacity = 16;
+    while (capacity < records) {
+        capacity *= 2;
+    }
+    ringCapacity_ = capacity;
+}
+
+void TraceRecorder::setDumpOnErrorFile(const std::string& fileName) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dumpOnErrorFile_ = fileName;
+}
+
+std::vector<TraceRecorder::Record> TraceRecorder::snapshot() const {
+    std::vector<Record> records;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& ring : rings_) {
+            ring->read(records);
+        }
+    }
+    std::stable_sort(records.begin(), records.end(), [](const Record& a, const Record& b) {
+        return a.timestamp < b.timestamp;
+    });
+    return records;
+}
+
+bool TraceRecorder::dump(const std::string& fileName) const {
+    std::vector<Record> records = snapshot();
+    FILE* f = NetworkClientInternal::Fopen(fileName.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    int64_t wallClockOffset = SystemNanoseconds() - static_cast<int64_t>(SteadyNanoseconds());
+    uint32_t recordSize = sizeof(Record);
+    uint32_t count = static_cast<uint32_t>(records.size());
+    bool ok = fwrite(DumpMagic, sizeof(DumpMagic), 1, f) == 1
+        && fwrite(&wallClockOffset, sizeof(wallClockOffset), 1, f) == 1
+        && fwrite(&recordSize, sizeof(recordSize), 1, f) == 1
+        && fwrite(&count, sizeof(count), 1, f) == 1
+        && (records.empty() || fwrite(&records[0], sizeof(Record), records.size(), f) == records.size());
+    return fclose(f) == 0 && ok;
+}
+
+void TraceRecorder::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& ring : rings_) {
+        ring->clearedUpTo = ring->head.load();
+    }
+    // Rings of finished threads are not needed anymore
+    rings_.erase(std::remove_if(rings_.begin(), rings_.end(), [](const std::shared_ptr<Ring>& ring) {
+        return !ring->alive;
+    }), rings_.end());
+}
+
+void TraceRecorder::record(uint32_t handleId, EventType type, const char* data, size_t size) {
+    threadRing().write(handleId, type, data, size);
+}
+
+bool TraceRecorder::readDump(const std::string& fileName, std::vector<Record>& records, int64_t& wallClockOffset) {
+    FILE* f = NetworkClientInternal::Fopen(fileName.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    char magic[sizeof(DumpMagic)];
+    uint32_t recordSize = 0, count = 0;
+    bool ok = fread(magic, sizeof(magic), 1, f) == 1 && memcmp(magic, DumpMagic, sizeof(magic)) == 0
+        && fread(&wallClockOffset, sizeof(wallClockOffset), 1, f) == 1
+        && fread(&recordSize, sizeof(recordSize), 1, f) == 1 && recordSize == sizeof(Record)
+        && fread(&count, sizeof(count), 1, f) == 1;
+    if (ok) {
+        records.resize(count);
+        ok = count == 0 || fread(&records[0], sizeof(Record), count, f) == count;
+    }
+    fclose(f);
+    return ok;
+}
+
+std::string TraceRecorder::eventTypeName(int type) {
+    static const char* names[] = {
+        "TEXT", "HEADER_IN", "HEADER_OUT", "DATA_IN", "DATA_OUT", "SSL_DATA_IN", "SSL_DATA_OUT",
+        "REQUEST_START", "REQUEST_FINISH"
+    };
+    if (type >= 0 && type < static_cast<int>(sizeof(names) / sizeof(names[0]))) {
+        return names[type];
+    }
+    return "UNKNOWN";
+}
+
+void TraceRecorder::onRequestStart(NetworkClient& client) {
+    std::string url = client.url();
+    record(handleId(client), etRequestStart, url.data(), url.size());
+}
+
+void TraceRecorder::onRequestFinish(NetworkClient& client) {
+    char text[MaxRecordData + 1];
+    int length = snprintf(text, sizeof(text), "result=%d code=%d", client.getCurlResult(), client.responseCode());
+    record(handleId(client), etRequestFinish, text, std::min<size_t>(length, MaxRecordData));
+
+    if (client.getCurlResult() != CURLE_OK) {
+        std::string fileName;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            fileName = dumpOnErrorFile_;
+        }
+        if (!fileName.empty()) {
+            dump(fileName);
+        }
+    }
+}
+
+uint32_t TraceRecorder::handleId(NetworkClient& client) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = handleIds_.find(&client);
+    return it == handleIds_.end() ? 0 : it->second;
+}
+
+int TraceRecorder::debugCallback(CURL*, curl_infotype type, char* data, size_t size, void* userp) {
+    if (type < CURLINFO_END) {
+        instance().record(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(userp)), static_cast<EventType>(type), data, size);
+    }
+    return 0;
+}
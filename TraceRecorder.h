@@ -0,0 +1,134 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef CURL_CPP_WRAPPER_TRACE_RECORDER_H
+#define CURL_CPP_WRAPPER_TRACE_RECORDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "NetworkClient.h"
+
+/**
+ * Always-on flight recorder of wire-level events, built on CURLOPT_DEBUGFUNCTION.
+ * Each thread writes compact fixed-size records into its own ring buffer without locks,
+ * older records are overwritten. Rings of all threads can be dumped to a binary file
+ * on demand or automatically when a request of an attached client fails.
+ * Dumps are decoded with the trace_decoder tool (see the Tools directory).
+ */
+class TraceRecorder: public NetworkClient::RequestObserver
+{
+public:
+    enum EventType
+    {
+        // The first values match curl_infotype
+        etText = 0,
+        etHeaderIn,
+        etHeaderOut,
+        etDataIn,
+        etDataOut,
+        etSslDataIn,
+        etSslDataOut,
+        etRequestStart,
+        etRequestFinish
+    };
+
+    enum { MaxRecordData = 38 };
+
+    /**
+     * 64 bytes per record. Only the first MaxRecordData bytes of the event data are kept,
+     * size holds the original length.
+     */
+    struct Record
+    {
+        uint64_t sequence;
+        uint64_t timestamp; // nanoseconds, steady clock
+        uint32_t handleId;
+        uint32_t size;
+        uint8_t type;
+        uint8_t dataSize;
+        char data[MaxRecordData];
+    };
+
+    static TraceRecorder& instance();
+
+    /**
+     * Enables tracing for the client (turns on CURLOPT_VERBOSE with a custom debug function).
+     */
+    void attach(NetworkClient& client);
+    void detach(NetworkClient& client);
+
+    /**
+     * Sets the number of records in the ring of each thread (rounded up to a power of two).
+     * Applies to threads which start recording afterwards.
+     */
+    void setRingCapacity(size_t records);
+
+    /**
+     * If not empty, rings are dumped to this file when a request of an attached client fails.
+     */
+    void setDumpOnErrorFile(const std::string& fileName);
+
+    /**
+     * Returns records of all threads ordered by time.
+     */
+    std::vector<Record> snapshot() const;
+    bool dump(const std::string& fileName) const;
+
+    /**
+     * Drops all records.
+     */
+    void clear();
+
+    void record(uint32_t handleId, EventType type, const char* data, size_t size);
+
+    /**
+     * Reads a dump file. wallClockOffset receives the value to add to record timestamps
+     * to get nanoseconds since the Unix epoch.
+     */
+    static bool readDump(const std::string& fileName, std::vector<Record>& records, int64_t& wallClockOffset);
+    static std::string eventTypeName(int type);
+
+    void onRequestStart(NetworkClient& client) override;
+    void onRequestFinish(NetworkClient& client) override;
+
+private:
+    struct Ring;
+
+    TraceRecorder();
+    Ring& threadRing();
+    uint32_t handleId(NetworkClient& client) const;
+    static int debugCallback(CURL* handle, curl_infotype type, char* data, size_t size, void* userp);
+
+    mutable std::mutex mutex_;
+    std::vector<std::shared_ptr<Ring>> rings_;
+    std::map<NetworkClient*, uint32_t> handleIds_;
+    std::atomic<uint32_t> nextHandleId_;
+    std::atomic<size_t> ringCapacity_;
+    std::string dumpOnErrorFile_;
+};
+
+#endif
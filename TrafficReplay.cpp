@@ -0,0 +1,339 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "TrafficReplay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char ReplayMagic[8] = { 'N', 'C', 'R', 'E', 'P', 'L', 'A', 'Y' };
+const uint32_t ReplayVersion = 1;
+
+/**
+ * File layout: FileHeader, entries (EntryHeader followed by method, url, request headers,
+ * response headers and response body), index (IndexItem[entryCount] sorted by keyHash).
+ * Numbers are stored in the byte order of the machine which recorded the file.
+ */
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t entryCount;
+    uint64_t indexOffset;
+};
+
+struct EntryHeader
+{
+    uint64_t keyHash;
+    uint64_t requestBodyHash;
+    int64_t requestBodySize;
+    int32_t code;
+    uint32_t methodSize;
+    uint32_t urlSize;
+    uint32_t requestHeadersSize;
+    uint32_t responseHeadersSize;
+    uint32_t reserved;
+    uint64_t bodySize;
+    int64_t timings[7];
+};
+
+uint64_t KeyHash(const std::string& method, const std::string& url, uint64_t bodyHash) {
+    uint64_t hash = NetworkClientInternal::Fnv1a64(method.data(), method.size());
+    hash = NetworkClientInternal::Fnv1a64("\n", 1, hash);
+    hash = NetworkClientInternal::Fnv1a64(url.data(), url.size(), hash);
+    return NetworkClientInternal::Fnv1a64(reinterpret_cast<const char*>(&bodyHash), sizeof(bodyHash), hash);
+}
+
+}
+
+void TrafficRecorder::attach(NetworkClient& client) {
+    client.addRequestObserver(this);
+}
+
+void TrafficRecorder::detach(NetworkClient& client) {
+    client.removeRequestObserver(this);
+}
+
+void TrafficRecorder::onRequestFinish(NetworkClient& client) {
+    if (client.getCurlResult() != CURLE_OK) {
+        return;
+    }
+    Entry entry;
+    entry.request = client.requestInfo();
+    entry.code = client.responseCode();
+    entry.responseHeaders = client.responseHeaderText();
+    entry.body = client.responseBody();
+    entry.timings = client.responseTimings();
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.push_back(std::move(entry));
+}
+
+bool TrafficRecorder::save(const std::string& fileName) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    FILE* f = NetworkClientInternal::Fopen(fileName.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    FileHeader header;
+    memcpy(header.magic, ReplayMagic, sizeof(header.magic));
+    header.version = ReplayVersion;
+    header.entryCount = static_cast<uint32_t>(entries_.size());
+    header.indexOffset = 0;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    std::vector<std::pair<uint64_t, uint64_t>> index;
+    uint64_t offset = sizeof(header);
+    for (const auto& entry : entries_) {
+        std::string requestHeaders;
+        for (const auto& it : entry.request.headers) {
+            requestHeaders += it.first + ": " + it.second + "\r\n";
+        }
+        EntryHeader item;
+        memset(&item, 0, sizeof(item));
+        item.keyHash = KeyHash(entry.request.method, entry.request.url, entry.request.bodyHash);
+        item.requestBodyHash = entry.request.bodyHash;
+        item.requestBodySize = entry.request.bodySize;
+        item.code = entry.code;
+        item.methodSize = static_cast<uint32_t>(entry.request.method.size());
+        item.urlSize = static_cast<uint32_t>(entry.request.url.size());
+        item.requestHeadersSize = static_cast<uint32_t>(requestHeaders.size());
+        item.responseHeadersSize = static_cast<uint32_t>(entry.responseHeaders.size());
+        item.bodySize = entry.body.size();
+        const NetworkClient::Timings& t = entry.timings;
+        int64_t timings[7] = { t.nameLookup, t.connect, t.appConnect, t.preTransfer, t.startTransfer, t.total, t.redirect };
+        memcpy(item.timings, timings, sizeof(timings));
+
+        ok = ok && fwrite(&item, sizeof(item), 1, f) == 1
+            && fwrite(entry.request.method.data(), 1, item.methodSize, f) == item.methodSize
+            && fwrite(entry.request.url.data(), 1, item.urlSize, f) == item.urlSize
+            && fwrite(requestHeaders.data(), 1, item.requestHeadersSize, f) == item.requestHeadersSize
+            && fwrite(entry.responseHeaders.data(), 1, item.responseHeadersSize, f) == item.responseHeadersSize
+            && fwrite(entry.body.data(), 1, entry.body.size(), f) == entry.body.size();
+        index.emplace_back(item.keyHash, offset);
+        offset += sizeof(item) + item.methodSize + item.urlSize + item.requestHeadersSize
+            + item.responseHeadersSize + item.bodySize;
+    }
+
+    // Stable order keeps repeated requests in the order they were made
+    std::stable_sort(index.begin(), index.end(), [](const std::pair<uint64_t, uint64_t>& a, const std::pair<uint64_t, uint64_t>& b) {
+        return a.first < b.first;
+    });
+    for (const auto& it : index) {
+        uint64_t values[2] = { it.first, it.second };
+        ok = ok && fwrite(values, sizeof(values), 1, f) == 1;
+    }
+    header.indexOffset = offset;
+    ok = ok && fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1;
+    return fclose(f) == 0 && ok;
+}
+
+size_t TrafficRecorder::entryCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+void TrafficRecorder::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+}
+
+TrafficReplayer::TrafficReplayer():
+    data_(nullptr),
+    size_(0),
+#ifdef _WIN32
+    mapping_(nullptr),
+#endif
+    reproduceLatency_(false),
+    hits_(0),
+    misses_(0)
+{
+}
+
+TrafficReplayer::~TrafficReplayer() {
+    close();
+}
+
+bool TrafficReplayer::open(const std::string& fileName) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileW(NetworkClientInternal::Utf8ToWide(fileName).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    bool ok = GetFileSizeEx(file, &fileSize) != 0;
+    size_ = ok ? static_cast<size_t>(fileSize.QuadPart) : 0;
+    if (ok && size_) {
+        mapping_ = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        data_ = mapping_ ? static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+    }
+    CloseHandle(file);
+#else
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat info;
+    size_ = fstat(fd, &info) == 0 ? static_cast<size_t>(info.st_size) : 0;
+    if (size_) {
+        void* address = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        data_ = address != MAP_FAILED ? static_cast<const char*>(address) : nullptr;
+    }
+    ::close(fd);
+#endif
+    FileHeader header;
+    if (!data_ || size_ < sizeof(header)) {
+        close();
+        return false;
+    }
+    memcpy(&header, data_, sizeof(header));
+    if (memcmp(header.magic, ReplayMagic, sizeof(header.magic)) != 0 || header.version != ReplayVersion
+        || header.indexOffset > size_ || (size_ - header.indexOffset) / sizeof(IndexItem) < header.entryCount) {
+        close();
+        return false;
+    }
+    index_.resize(header.entryCount);
+    if (!index_.empty()) {
+        memcpy(&index_[0], data_ + header.indexOffset, index_.size() * sizeof(IndexItem));
+    }
+    return true;
+}
+
+void TrafficReplayer::close() {
+#ifdef _WIN32
+    if (data_) {
+        UnmapViewOfFile(data_);
+    }
+    if (mapping_) {
+        CloseHandle(mapping_);
+        mapping_ = nullptr;
+    }
+#else
+    if (data_) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+    data_ = nullptr;
+    size_ = 0;
+    index_.clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    nextMatch_.clear();
+}
+
+void TrafficReplayer::attach(NetworkClient& client) {
+    client.setResponseSource(this);
+}
+
+void TrafficReplayer::detach(NetworkClient& client) {
+    client.setResponseSource(nullptr);
+}
+
+void TrafficReplayer::setReproduceLatency(bool reproduce) {
+    reproduceLatency_ = reproduce;
+}
+
+size_t TrafficReplayer::entryCount() const {
+    return index_.size();
+}
+
+uint64_t TrafficReplayer::hits() const {
+    return hits_;
+}
+
+uint64_t TrafficReplayer::misses() const {
+    return misses_;
+}
+
+bool TrafficReplayer::findResponse(const NetworkClient::RequestInfo& request, NetworkClient::ReplayedResponse& response) {
+    uint64_t keyHash = KeyHash(request.method, request.url, request.bodyHash);
+    IndexItem key = { keyHash, 0 };
+    auto range = std::equal_range(index_.begin(), index_.end(), key, [](const IndexItem& a, const IndexItem& b) {
+        return a.keyHash < b.keyHash;
+    });
+    std::vector<uint64_t> matches;
+    for (auto it = range.first; it != range.second; ++it) {
+        NetworkClient::ReplayedResponse candidate;
+        if (parseEntry(it->offset, request, candidate)) {
+            matches.push_back(it->offset);
+        }
+    }
+    if (matches.empty()) {
+        misses_++;
+        return false;
+    }
+    size_t match;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        match = nextMatch_[keyHash]++ % matches.size();
+    }
+    parseEntry(matches[match], request, response);
+    hits_++;
+    if (reproduceLatency_ && response.timings.total > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(response.timings.total));
+    }
+    return true;
+}
+
+bool TrafficReplayer::parseEntry(uint64_t offset, const NetworkClient::RequestInfo& request, NetworkClient::ReplayedResponse& response) const {
+    EntryHeader item;
+    if (offset > size_ || size_ - offset < sizeof(item)) {
+        return false;
+    }
+    memcpy(&item, data_ + offset, sizeof(item));
+    const char* pos = data_ + offset + sizeof(item);
+    uint64_t available = size_ - offset - sizeof(item);
+    uint64_t required = static_cast<uint64_t>(item.methodSize) + item.urlSize + item.requestHeadersSize
+        + item.responseHeadersSize + item.bodySize;
+    if (required > available || item.requestBodyHash != request.bodyHash || item.requestBodySize != request.bodySize
+        || request.method.compare(0, std::string::npos, pos, item.methodSize) != 0
+        || request.url.compare(0, std::string::npos, pos + item.methodSize, item.urlSize) != 0) {
+        return false;
+    }
+    pos += item.methodSize + item.urlSize + item.requestHeadersSize;
+    response.code = item.code;
+    response.headers.data = pos;
+    response.headers.size = item.responseHeadersSize;
+    response.body.data = pos + item.responseHeadersSize;
+    response.body.size = static_cast<size_t>(item.bodySize);
+    NetworkClient::Timings& t = response.timings;
+    t.nameLookup = item.timings[0];
+    t.connect = item.timings[1];
+    t.appConnect = item.timings[2];
+    t.preTransfer = item.timings[3];
+    t.startTransfer = item.timings[4];
+    t.total = item.timings[5];
+    t.redirect = item.timings[6];
+    return true;
+}
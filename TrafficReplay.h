@@ -0,0 +1,130 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef CURL_CPP_WRAPPER_TRAFFIC_REPLAY_H
+#define CURL_CPP_WRAPPER_TRAFFIC_REPLAY_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "NetworkClient.h"
+
+/**
+ * Records requests of attached clients (method, url, headers, body hash) together with
+ * their responses (status, header block, body, timings), so they can be served later
+ * by TrafficReplayer without network.
+ * Only requests finished with CURLE_OK are recorded. Bodies written to an output file
+ * or consumed by a body callback are not kept.
+ */
+class TrafficRecorder: public NetworkClient::RequestObserver
+{
+public:
+    TrafficRecorder() = default;
+    TrafficRecorder(TrafficRecorder const&) = delete;
+    void operator=(TrafficRecorder const& x) = delete;
+
+    void attach(NetworkClient& client);
+    void detach(NetworkClient& client);
+
+    /**
+     * Writes the recorded exchanges to an indexed file.
+     */
+    bool save(const std::string& fileName) const;
+    size_t entryCount() const;
+    void clear();
+
+    void onRequestFinish(NetworkClient& client) override;
+
+private:
+    struct Entry
+    {
+        NetworkClient::RequestInfo request;
+        int code;
+        std::string responseHeaders;
+        std::string body;
+        NetworkClient::Timings timings;
+    };
+
+    mutable std::mutex mutex_;
+    std::vector<Entry> entries_;
+};
+
+/**
+ * Serves responses from a file written by TrafficRecorder. The file is memory-mapped,
+ * response bodies are passed to clients without copying.
+ * Requests are matched by method, url and body hash. Repeated requests get the recorded
+ * responses in their original order (starting over when they are exhausted).
+ * One replayer can be shared by clients on different threads.
+ */
+class TrafficReplayer: public NetworkClient::ResponseSource
+{
+public:
+    TrafficReplayer();
+    ~TrafficReplayer();
+    TrafficReplayer(TrafficReplayer const&) = delete;
+    void operator=(TrafficReplayer const& x) = delete;
+
+    bool open(const std::string& fileName);
+    void close();
+
+    /**
+     * Makes the client take responses from the replayer (see NetworkClient::setResponseSource()).
+     */
+    void attach(NetworkClient& client);
+    void detach(NetworkClient& client);
+
+    /**
+     * If enabled, every replayed request takes as long as the recorded one did.
+     */
+    void setReproduceLatency(bool reproduce);
+
+    size_t entryCount() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+    bool findResponse(const NetworkClient::RequestInfo& request, NetworkClient::ReplayedResponse& response) override;
+
+private:
+    struct IndexItem
+    {
+        uint64_t keyHash;
+        uint64_t offset;
+    };
+
+    bool parseEntry(uint64_t offset, const NetworkClient::RequestInfo& request, NetworkClient::ReplayedResponse& response) const;
+
+    const char* data_;
+    size_t size_;
+#ifdef _WIN32
+    void* mapping_;
+#endif
+    std::vector<IndexItem> index_;
+    std::mutex mutex_;
+    std::map<uint64_t, size_t> nextMatch_;
+    bool reproduceLatency_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+};
+
+#endif
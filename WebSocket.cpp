@@ -0,0 +1,484 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+#include "WebSocket.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+#if LIBCURL_VERSION_NUM >= 0x075600
+#define CURL_CPP_WRAPPER_HAVE_WEBSOCKETS
+#endif
+
+namespace {
+
+const size_t DefaultReceiveBufferSize = 64 * 1024;
+// Control frames carry at most 125 bytes and must be received in one piece
+const size_t MinReceiveBufferSize = 256;
+
+int MillisecondsUntil(WebSocket::Clock::time_point time, WebSocket::Clock::time_point now) {
+    if (time <= now) {
+        return 0;
+    }
+    return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(time - now).count()) + 1;
+}
+
+// Shortest of two timeouts, where -1 means infinite
+int MinTimeout(int a, int b) {
+    if (a < 0) {
+        return b;
+    }
+    if (b < 0) {
+        return a;
+    }
+    return std::min(a, b);
+}
+
+#ifdef CURL_CPP_WRAPPER_HAVE_WEBSOCKETS
+unsigned int FrameTypeFlags(WebSocket::FrameType type) {
+    switch (type) {
+        case WebSocket::ftText:
+            return CURLWS_TEXT;
+        case WebSocket::ftClose:
+            return CURLWS_CLOSE;
+        case WebSocket::ftPing:
+            return CURLWS_PING;
+        case WebSocket::ftPong:
+            return CURLWS_PONG;
+        default:
+            return CURLWS_BINARY;
+    }
+}
+
+// The frame argument of curl_ws_recv() became a pointer to const in later libcurl versions
+template <typename WsFrame>
+CURLcode ReceiveChunk(CURLcode (*recv)(CURL*, void*, size_t, size_t*, WsFrame**), CURL* curl, char* buffer,
+                      size_t size, size_t* received, const struct curl_ws_frame** meta) {
+    WsFrame* frame = nullptr;
+    CURLcode result = recv(curl, buffer, size, received, &frame);
+    *meta = frame;
+    return result;
+}
+
+WebSocket::FrameType FlagsFrameType(int flags) {
+    if (flags & CURLWS_CLOSE) {
+        return WebSocket::ftClose;
+    }
+    if (flags & CURLWS_PING) {
+        return WebSocket::ftPing;
+    }
+    if (flags & CURLWS_PONG) {
+        return WebSocket::ftPong;
+    }
+    if (flags & CURLWS_TEXT) {
+        return WebSocket::ftText;
+    }
+    return WebSocket::ftBinary;
+}
+#endif
+
+}
+
+WebSocket::WebSocket(NetworkClient& client):
+    client_(client),
+    buffer_(DefaultReceiveBufferSize),
+    open_(false),
+    attached_(false),
+    inMessage_(false),
+    sendingMessage_(false),
+    receiveType_(ftBinary),
+    sendType_(ftBinary),
+    keepaliveInterval_(0),
+    keepaliveTimeout_(0),
+    pingPending_(false),
+    closeCode_(0),
+    lastResult_(CURLE_OK)
+{
+}
+
+WebSocket::~WebSocket() {
+    close();
+}
+
+bool WebSocket::isSupported() {
+#ifdef CURL_CPP_WRAPPER_HAVE_WEBSOCKETS
+    curl_version_info_data* info = curl_version_info(CURLVERSION_NOW);
+    for (const char* const* protocol = info->protocols; protocol && *protocol; ++protocol) {
+        if (!strcmp(*protocol, "ws")) {
+            return true;
+        }
+    }
+#endif
+    return false;
+}
+
+bool WebSocket::connect(const std::string& url) {
+    if (!startConnect(url)) {
+        return false;
+    }
+    return finishConnect(curl_easy_perform(client_.getCurlHandle()));
+}
+
+bool WebSocket::startConnect(const std::string& url) {
+    close();
+    lastResult_ = CURLE_OK;
+    error_.clear();
+    closeCode_ = 0;
+    closeReason_.clear();
+#ifdef CURL_CPP_WRAPPER_HAVE_WEBSOCKETS
+    client_.setCurlOptionInt(CURLOPT_CONNECT_ONLY, 2);
+    attached_ = true;
+    if (!client_.startGet(url)) {
+        CURLcode result = static_cast<CURLcode>(client_.getCurlResult());
+        std::string error = client_.errorString();
+        detach();
+        return fail(result, error);
+    }
+    return true;
+#else
+    (void)url;
+    return fail(CURLE_NOT_BUILT_IN, "WebSockets require libcurl 7.86.0 or newer");
+#endif
+}
+
+bool WebSocket::finishConnect(CURLcode result) {
+    if (!attached_) {
+        return fail(CURLE_BAD_FUNCTION_ARGUMENT, "startConnect() has not been called");
+    }
+    bool success = client_.finishRequest(result);
+    if (!success || client_.responseCode() != 101) {
+        CURLcode error = success ? CURLE_HTTP_RETURNED_ERROR : static_cast<CURLcode>(client_.getCurlResult());
+        std::string message = success ? "Unexpected response code " + std::to_string(client_.responseCode())
+                                      : client_.errorString();
+        detach();
+        return fail(error, message);
+    }
+    open_ = true;
+    inMessage_ = false;
+    sendingMessage_ = false;
+    pingPending_ = false;
+    lastReceived_ = Clock::now();
+    return true;
+}
+
+void WebSocket::close(uint16_t code, const std::string& reason) {
+    if (open_) {
+        std::string payload;
+        payload += static_cast<char>(code >> 8);
+        payload += static_cast<char>(code & 0xff);
+        payload += reason.substr(0, 123);
+        sendFrame(ftClose, payload.data(), payload.size());
+    }
+    if (attached_) {
+        detach();
+    }
+}
+
+bool WebSocket::isOpen() const {
+    return open_;
+}
+
+bool WebSocket::sendFrame(FrameType type, const char* data, size_t size, bool final) {
+    lastResult_ = CURLE_OK;
+    error_.clear();
+    if (!open_) {
+        return fail(CURLE_SEND_ERROR, "Connection is not open");
+    }
+#ifdef CURL_CPP_WRAPPER_HAVE_WEBSOCKETS
+    unsigned int flags;
+    if (type == ftText || type == ftBinary) {
+        if (!sendingMessage_) {
+            sendType_ = type;
+        }
+        flags = FrameTypeFlags(sendType_);
+        if (!final) {
+            flags |= CURLWS_CONT;
+        }
+        sendingMessage_ = !final;
+    } else {
+        flags = FrameTypeFlags(type);
+    }
+    return sendRaw(data, size, flags);
+#else
+    (void)type;
+    (void)data;
+    (void)size;
+    (void)final;
+    return fail(CURLE_NOT_BUILT_IN);
+#endif
+}
+
+bool WebSocket::sendText(const std::string& text) {
+    return sendFrame(ftText, text.data(), text.size());
+}
+
+bool WebSocket::sendBinary(const void* data, size_t size) {
+    return sendFrame(ftBinary, static_cast<const char*>(data), size);
+}
+
+bool WebSocket::ping(const std::string& payload) {
+    return sendFrame(ftPing, payload.data(), std::min<size_t>(payload.size(), 125));
+}
+
+bool WebSocket::receiveFrame(Frame& frame, int timeoutMs) {
+    lastResult_ = CURLE_OK;
+    error_.clear();
+    if (!open_) {
+        return fail(CURLE_RECV_ERROR, "Connection is not open");
+    }
+#ifdef CURL_CPP_WRAPPER_HAVE_WEBSOCKETS
+    CURL* handle = client_.getCurlHandle();
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(std::max(timeoutMs, 0));
+    for (;;) {
+        size_t received = 0;
+        const struct curl_ws_frame* meta = nullptr;
+        CURLcode result = ReceiveChunk(curl_ws_recv, handle, buffer_.data(), buffer_.size(), &received, &meta);
+        if (result == CURLE_OK && meta) {
+            lastReceived_ = Clock::now();
+            pingPending_ = false;
+            frame.type = FlagsFrameType(meta->flags);
+            frame.data = buffer_.data();
+            frame.size = received;
+            frame.offset = meta->offset;
+            frame.bytesLeft = meta->bytesleft;
+            frame.final = !(meta->flags & CURLWS_CONT);
+            if (frame.type == ftText || frame.type == ftBinary) {
+                // Continuation frames have the type of the first frame of the message
+                if (inMessage_) {
+                    frame.type = receiveType_;
+                } else {
+                    receiveType_ = frame.type;
+                }
+                inMessage_ = !(frame.final && frame.bytesLeft == 0);
+            } else if (frame.type == ftClose && frame.bytesLeft == 0) {
+                if (frame.size >= 2) {
+                    closeCode_ = static_cast<uint16_t>((static_cast<unsigned char>(frame.data[0]) << 8) |
+                                                       static_cast<unsigned char>(frame.data[1]));
+                    closeReason_.assign(frame.data + 2, frame.size - 2);
+                } else {
+                    closeCode_ = 1005; // no status code present
+                }
+                // Echo the status code back as required by RFC 6455
+                sendRaw(frame.data, std::min<size_t>(frame.size, 2), CURLWS_CLOSE);
+                open_ = false;
+            }
+            return true;
+        }
+        if (result != CURLE_AGAIN) {
+            open_ = false;
+            return fail(result);
+        }
+        if (!processKeepalive()) {
+            return false;
+        }
+        int wait = keepaliveTimeout();
+        if (timeoutMs >= 0) {
+            Clock::time_point now = Clock::now();
+            if (now >= deadline) {
+                return fail(CURLE_AGAIN, "Timeout was reached");
+            }
+            wait = MinTimeout(wait, MillisecondsUntil(deadline, now));
+        }
+        if (!waitSocket(false, wait)) {
+            return false;
+        }
+    }
+#else
+    (void)frame;
+    (void)timeoutMs;
+    return fail(CURLE_NOT_BUILT_IN);
+#endif
+}
+
+bool WebSocket::receiveMessage(std::string& message, FrameType& type, int timeoutMs) {
+    message.clear();
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(std::max(timeoutMs, 0));
+    bool started = false;
+    for (;;) {
+        int wait = timeoutMs < 0 ? -1 : MillisecondsUntil(deadline, Clock::now());
+        Frame frame;
+        if (!receiveFrame(frame, wait)) {
+            return false;
+        }
+        if (frame.type == ftClose) {
+            if (frame.bytesLeft == 0) {
+                return fail(CURLE_RECV_ERROR, "Connection closed by peer");
+            }
+            continue;
+        }
+        if (frame.type == ftPing || frame.type == ftPong) {
+            continue;
+        }
+        if (!started) {
+            type = frame.type;
+            started = true;
+        }
+        message.append(frame.data, frame.size);
+        if (frame.final && frame.bytesLeft == 0) {
+            return true;
+        }
+    }
+}
+
+WebSocket& WebSocket::setKeepalive(int intervalMs, int timeoutMs) {
+    keepaliveInterval_ = std::max(intervalMs, 0);
+    keepaliveTimeout_ = std::max(timeoutMs, 0);
+    pingPending_ = false;
+    return *this;
+}
+
+bool WebSocket::processKeepalive() {
+    if (!keepaliveInterval_ || !open_) {
+        return true;
+    }
+    Clock::time_point now = Clock::now();
+    if (pingPending_) {
+        if (now - pingSent_ >= std::chrono::milliseconds(keepaliveTimeout_)) {
+            open_ = false;
+            return fail(CURLE_OPERATION_TIMEDOUT, "Keepalive timeout");
+        }
+        return true;
+    }
+    if (now - lastReceived_ >= std::chrono::milliseconds(keepaliveInterval_)) {
+        if (!ping()) {
+            return false;
+        }
+        pingSent_ = now;
+        pingPending_ = true;
+    }
+    return true;
+}
+
+int WebSocket::keepaliveTimeout() const {
+    if (!keepaliveInterval_ || !open_) {
+        return -1;
+    }
+    Clock::time_point now = Clock::now();
+    if (pingPending_) {
+        return MillisecondsUntil(pingSent_ + std::chrono::milliseconds(keepaliveTimeout_), now);
+    }
+    return MillisecondsUntil(lastReceived_ + std::chrono::milliseconds(keepaliveInterval_), now);
+}
+
+WebSocket& WebSocket::setReceiveBufferSize(size_t size) {
+    buffer_.resize(std::max(size, MinReceiveBufferSize));
+    return *this;
+}
+
+curl_socket_t WebSocket::socket() const {
+    curl_socket_t socket = CURL_SOCKET_BAD;
+    if (attached_) {
+        curl_easy_getinfo(client_.getCurlHandle(), CURLINFO_ACTIVESOCKET, &socket);
+    }
+    return socket;
+}
+
+uint16_t WebSocket::closeCode() const {
+    return closeCode_;
+}
+
+const std::string& WebSocket::closeReason() const {
+    return closeReason_;
+}
+
+CURLcode WebSocket::lastResult() const {
+    return lastResult_;
+}
+
+std::string WebSocket::errorString() const {
+    if (!error_.empty()) {
+        return error_;
+    }
+    return curl_easy_strerror(lastResult_);
+}
+
+bool WebSocket::fail(CURLcode result, const std::string& error) {
+    lastResult_ = result;
+    error_ = error;
+    return false;
+}
+
+bool WebSocket::waitSocket(bool forWrite, int timeoutMs) {
+    curl_socket_t sock = socket();
+    if (sock == CURL_SOCKET_BAD) {
+        open_ = false;
+        return fail(CURLE_COULDNT_CONNECT, "Connection is lost");
+    }
+    // poll() has no FD_SETSIZE limit on the descriptor value, unlike select()
+#ifdef _WIN32
+    WSAPOLLFD pfd;
+#else
+    struct pollfd pfd;
+#endif
+    pfd.fd = sock;
+    pfd.events = forWrite ? POLLOUT : POLLIN;
+    pfd.revents = 0;
+#ifdef _WIN32
+    int result = WSAPoll(&pfd, 1, timeoutMs < 0 ? -1 : timeoutMs);
+#else
+    int result = poll(&pfd, 1, timeoutMs < 0 ? -1 : timeoutMs);
+#endif
+    if (result < 0) {
+        return fail(forWrite ? CURLE_SEND_ERROR : CURLE_RECV_ERROR, "poll() failed");
+    }
+    return true;
+}
+
+bool WebSocket::sendRaw(const char* data, size_t size, unsigned int flags) {
+#ifdef CURL_CPP_WRAPPER_HAVE_WEBSOCKETS
+    CURL* handle = client_.getCurlHandle();
+    size_t offset = 0;
+    for (;;) {
+        size_t sent = 0;
+        CURLcode result = curl_ws_send(handle, data + offset, size - offset, &sent, 0, flags);
+        offset += sent;
+        if (result == CURLE_AGAIN) {
+            if (!waitSocket(true, -1)) {
+                return false;
+            }
+            continue;
+        }
+        if (result != CURLE_OK) {
+            open_ = false;
+            return fail(result);
+        }
+        if (offset >= size) {
+            return true;
+        }
+    }
+#else
+    (void)data;
+    (void)size;
+    (void)flags;
+    return fail(CURLE_NOT_BUILT_IN);
+#endif
+}
+
+void WebSocket::detach() {
+    client_.setCurlOptionInt(CURLOPT_CONNECT_ONLY, 0);
+    attached_ = false;
+    open_ = false;
+    inMessage_ = false;
+    sendingMessage_ = false;
+    pingPending_ = false;
+}
@@ -0,0 +1,180 @@
+/*
+
+    curl-cpp-wrapper (NetworkClient)
+
+    Copyright 2023 Sergey Svistunov (zenden2k@gmail.com)
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef CURL_CPP_WRAPPER_WEBSOCKET_H
+#define CURL_CPP_WRAPPER_WEBSOCKET_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "NetworkClient.h"
+
+/**
+ * WebSocket connection on top of a NetworkClient (libcurl 7.86 or newer built with WebSockets support).
+ * The handshake is an ordinary request of the client (proxy, headers, socket options and observers
+ * apply), after which the connection is detached from HTTP with CURLOPT_CONNECT_ONLY=2.
+ * The client must not be used for other requests until close() is called.
+ */
+class WebSocket
+{
+public:
+    enum FrameType { ftText, ftBinary, ftClose, ftPing, ftPong };
+
+    /**
+     * A piece of a received frame. data points into the internal receive buffer and
+     * stays valid until the next receive call.
+     */
+    struct Frame
+    {
+        FrameType type;
+        const char* data;
+        size_t size;
+        /**
+         * Offset of data in the payload of the frame.
+         */
+        int64_t offset;
+        /**
+         * Payload bytes of the frame which have not been received yet.
+         */
+        int64_t bytesLeft;
+        /**
+         * False if more frames of the same message follow.
+         */
+        bool final;
+
+        Frame(): type(ftBinary), data(nullptr), size(0), offset(0), bytesLeft(0), final(true) {
+        }
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    explicit WebSocket(NetworkClient& client);
+    ~WebSocket();
+    WebSocket(WebSocket const&) = delete;
+    void operator=(WebSocket const& x) = delete;
+
+    /**
+     * True if the linked libcurl can open ws:// and wss:// URLs.
+     */
+    static bool isSupported();
+
+    /**
+     * Performs the handshake. url must use the ws:// or wss:// scheme.
+     */
+    bool connect(const std::string& url);
+
+    /**
+     * Starts the handshake without performing it, for use with a curl multi handle:
+     * add client.getCurlHandle() to the multi handle and call finishConnect() with the transfer result.
+     */
+    bool startConnect(const std::string& url);
+    bool finishConnect(CURLcode result);
+
+    /**
+     * Sends the close frame (if the connection is still open) and detaches from the client.
+     */
+    void close(uint16_t code = 1000, const std::string& reason = std::string());
+
+    bool isOpen() const;
+
+    /**
+     * Sends one frame. With final=false the frame is a fragment of a message continued by
+     * further sendFrame() calls; the type of the continuation frames is ignored.
+     */
+    bool sendFrame(FrameType type, const char* data, size_t size, bool final = true);
+    bool sendText(const std::string& text);
+    bool sendBinary(const void* data, size_t size);
+    bool ping(const std::string& payload = std::string());
+
+    /**
+     * Receives the next piece of a frame. Frames larger than the receive buffer are returned in several pieces.
+     * Pings are answered by libcurl automatically but are still reported.
+     * @param timeoutMs -1 waits indefinitely, 0 only returns data which has already arrived
+     * A close frame of the peer is answered and reported, after which the connection is no longer open.
+     * @return false on error, timeout (lastResult() is CURLE_AGAIN) or if the connection is not open
+     */
+    bool receiveFrame(Frame& frame, int timeoutMs = -1);
+
+    /**
+     * Receives a complete (possibly fragmented) text or binary message. Control frames are consumed.
+     */
+    bool receiveMessage(std::string& message, FrameType& type, int timeoutMs = -1);
+
+    /**
+     * Sends a ping after intervalMs without incoming data and fails the connection if nothing arrives
+     * within timeoutMs after it. 0 disables keepalive.
+     */
+    WebSocket& setKeepalive(int intervalMs, int timeoutMs);
+
+    /**
+     * Sends a due keepalive ping or detects a keepalive timeout. Called by the blocking receive methods;
+     * event loop users call it when keepaliveTimeout() expires.
+     */
+    bool processKeepalive();
+
+    /**
+     * Milliseconds until processKeepalive() has work to do, -1 if keepalive is disabled.
+     */
+    int keepaliveTimeout() const;
+
+    WebSocket& setReceiveBufferSize(size_t size);
+
+    /**
+     * Socket of the connection for the caller's event loop (e.g. extra_fds of curl_multi_wait()).
+     */
+    curl_socket_t socket() const;
+
+    /**
+     * Close code and reason sent by the peer, 0 if the peer did not close the connection.
+     */
+    uint16_t closeCode() const;
+    const std::string& closeReason() const;
+
+    CURLcode lastResult() const;
+    std::string errorString() const;
+
+private:
+    bool fail(CURLcode result, const std::string& error = std::string());
+    bool waitSocket(bool forWrite, int timeoutMs);
+    bool sendRaw(const char* data, size_t size, unsigned int flags);
+    void detach();
+
+    NetworkClient& client_;
+    std::vector<char> buffer_;
+    bool open_;
+    bool attached_;
+    bool inMessage_;
+    bool sendingMessage_;
+    FrameType receiveType_;
+    FrameType sendType_;
+    int keepaliveInterval_;
+    int keepaliveTimeout_;
+    Clock::time_point lastReceived_;
+    Clock::time_point pingSent_;
+    bool pingPending_;
+    uint16_t closeCode_;
+    std::string closeReason_;
+    CURLcode lastResult_;
+    std::string error_;
+};
+
+#endif